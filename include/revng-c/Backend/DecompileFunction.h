@@ -4,6 +4,10 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/Module.h"
 
 #include "revng/EarlyFunctionAnalysis/ControlFlowGraphCache.h"
@@ -11,12 +15,35 @@
 #include "revng/Pipes/StringMap.h"
 
 #include "revng-c/Backend/DecompilePipe.h"
+#include "revng-c/RestructureCFG/ASTTree.h"
+#include "revng-c/Support/ModelHelpers.h"
 
 namespace ptml {
 class CTypeBuilder;
 }
 
+/// Decompile \a F, against the model of \a TypeCache. Like \a Cache,
+/// \a TypeCache is meant to be shared by all the functions decompiled in the
+/// same pipe run.
+std::string decompile(ControlFlowGraphCache &Cache,
+                      ModelTypeCache &TypeCache,
+                      llvm::Function &F,
+                      ptml::CTypeBuilder &B);
+
+/// Like `decompile`, but starting from \a GHAST, the restructured GHAST of
+/// \a F.
 std::string decompile(ControlFlowGraphCache &Cache,
+                      ModelTypeCache &TypeCache,
                       llvm::Function &F,
-                      const model::Binary &Model,
+                      ASTTree &GHAST,
                       ptml::CTypeBuilder &B);
+
+/// Restructure all of \a Functions, returning the GHAST of `Functions[I]` as
+/// the `I`-th element of the result.
+///
+/// Restructuring only reads the IR, and never the model, so it runs on up to
+/// `-decompiler-jobs` threads (a single one, if any of the restructuring
+/// loggers is enabled). All the steps that read the model, and therefore need
+/// the pipeline to track the reads, are left to `decompile`, which must run
+/// on the thread executing the pipe.
+std::vector<ASTTree> restructure(llvm::ArrayRef<llvm::Function *> Functions);
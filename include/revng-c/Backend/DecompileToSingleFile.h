@@ -4,6 +4,9 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+
 #include "revng/Pipes/StringMap.h"
 #include "revng/Support/MetaAddress.h"
 
@@ -20,3 +23,13 @@ using DecompiledStringMap = revng::pipes::DecompileStringMap;
 void printSingleCFile(ptml::CTypeBuilder &B,
                       const detail::DecompiledStringMap &Functions,
                       const std::set<MetaAddress> &Targets);
+
+using FunctionBodyPrinter = llvm::function_ref<void(llvm::StringRef)>;
+
+/// Print a single C file whose function bodies are provided by \a Bodies,
+/// which is expected to invoke the printer it receives on each of them, in
+/// order.
+/// This allows to stream the function bodies in the file as soon as they are
+/// available, without ever holding all of them in memory.
+void printSingleCFile(ptml::CTypeBuilder &B,
+                      llvm::function_ref<void(FunctionBodyPrinter)> Bodies);
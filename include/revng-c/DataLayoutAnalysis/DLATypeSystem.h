@@ -4,6 +4,7 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <algorithm>
 #include <compare>
 #include <cstddef>
 #include <functional>
@@ -13,13 +14,18 @@
 #include <optional>
 #include <set>
 #include <type_traits>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/GraphTraits.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/IntEqClasses.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/iterator.h"
+#include "llvm/ADT/iterator_range.h"
 #include "llvm/Support/Allocator.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -90,6 +96,17 @@ struct OffsetExpression {
 
 }; // end class OffsetExpression
 
+inline llvm::hash_code hash_value(const OffsetExpression &OE) {
+  llvm::hash_code Result = llvm::hash_value(OE.Offset);
+  for (uint64_t Stride : OE.Strides)
+    Result = llvm::hash_combine(Result, Stride);
+  for (const std::optional<uint64_t> &TripCount : OE.TripCounts)
+    Result = llvm::hash_combine(Result,
+                                TripCount.has_value(),
+                                TripCount.value_or(0));
+  return Result;
+}
+
 class TypeLinkTag {
 public:
   enum LinkKind {
@@ -154,6 +171,12 @@ public:
   friend void
   writeToLog(Logger<true> &L, const dla::TypeLinkTag &T, int /* Ignore */);
 
+  struct Hash {
+    size_t operator()(const TypeLinkTag &Tag) const {
+      return llvm::hash_combine(Tag.Kind, Tag.OE);
+    }
+  };
+
 }; // end class TypeLinkTag
 
 class LayoutTypeSystem;
@@ -191,16 +214,108 @@ struct LayoutTypeSystemNode {
         if (nullptr == TagPointer or nullptr == Other.TagPointer)
           return TagPointer < Other.TagPointer;
 
+        // Tags are interned by the LayoutTypeSystem, so the same pointer
+        // means the same tag, and we can avoid comparing the offset
+        // expressions.
+        if (TagPointer == Other.TagPointer)
+          return false;
+
         return *TagPointer < *Other.TagPointer;
       }
     };
 
-    bool operator()(const Helper &&LHS, const Helper &&RHS) const {
+    bool operator()(const Helper &LHS, const Helper &RHS) const {
       return LHS < RHS;
     }
   };
 
-  using NeighborsSet = std::set<Link, NeighborLinkComparison>;
+  /// Sorted flat set of Links, ordered by NeighborLinkComparison.
+  ///
+  /// Links are stored by value in a vector, so every insertion or erasure
+  /// invalidates all the iterators. Code that mutates the graph while visiting
+  /// the neighbors of a node has to hold on to the Links, not to iterators.
+  class NeighborsSet {
+  private:
+    using Container = llvm::SmallVector<Link, 2>;
+    using Helper = NeighborLinkComparison::Helper;
+
+    Container Links;
+
+  public:
+    using value_type = Link;
+    using size_type = size_t;
+    using iterator = Container::const_iterator;
+    using const_iterator = Container::const_iterator;
+
+  public:
+    iterator begin() const { return Links.begin(); }
+    iterator end() const { return Links.end(); }
+    size_t size() const { return Links.size(); }
+    bool empty() const { return Links.empty(); }
+
+    iterator lower_bound(const Helper &Key) const {
+      return std::lower_bound(begin(), end(), Key, NeighborLinkComparison());
+    }
+
+    iterator upper_bound(const Helper &Key) const {
+      return std::upper_bound(begin(), end(), Key, NeighborLinkComparison());
+    }
+
+    iterator find(const Link &L) const {
+      auto It = lower_bound(L);
+      if (It != end() and not(Helper(L) < Helper(*It)))
+        return It;
+      return end();
+    }
+
+    bool contains(const Link &L) const { return find(L) != end(); }
+    size_t count(const Link &L) const { return contains(L) ? 1 : 0; }
+
+    std::pair<iterator, bool> insert(const Link &L) {
+      auto It = lower_bound(L);
+      if (It != end() and not(Helper(L) < Helper(*It)))
+        return { It, false };
+      return { Links.insert(toMutable(It), L), true };
+    }
+
+    /// Insert all the Links in the range, merging them with the existing ones
+    template<typename IteratorT>
+    void insert(IteratorT First, IteratorT Last) {
+      NeighborLinkComparison Less;
+      const auto Equal = [&Less](const Link &LHS, const Link &RHS) {
+        return not Less(LHS, RHS) and not Less(RHS, LHS);
+      };
+      size_t OldSize = Links.size();
+      Links.append(First, Last);
+      auto Middle = Links.begin() + OldSize;
+      if (not std::is_sorted(Middle, Links.end(), Less))
+        std::sort(Middle, Links.end(), Less);
+      std::inplace_merge(Links.begin(), Middle, Links.end(), Less);
+      Links.erase(std::unique(Links.begin(), Links.end(), Equal), Links.end());
+    }
+
+    size_t erase(const Link &L) {
+      auto It = find(L);
+      if (It == end())
+        return 0;
+      erase(It);
+      return 1;
+    }
+
+    iterator erase(iterator It) { return Links.erase(toMutable(It)); }
+
+    iterator erase(iterator First, iterator Last) {
+      return Links.erase(toMutable(First), toMutable(Last));
+    }
+
+    void clear() { Links.clear(); }
+
+  private:
+    Container::iterator toMutable(iterator It) {
+      return Links.begin() + std::distance(begin(), It);
+    }
+  };
+
   using NeighborIterator = NeighborsSet::iterator;
   NeighborsSet Successors{};
   NeighborsSet Predecessors{};
@@ -283,12 +398,62 @@ public:
   using Node = LayoutTypeSystemNode;
   using NodePtr = LayoutTypeSystemNode *;
   using NodeUniquePtr = std::unique_ptr<LayoutTypeSystemNode>;
-  using NeighborIterator = LayoutTypeSystemNode::NeighborIterator;
+  using Link = LayoutTypeSystemNode::Link;
+
+  /// Iterates over the live nodes in Layouts, in ID order.
+  ///
+  /// The iterator holds an index, so it stays valid while nodes are created or
+  /// removed. The end of the range is checked against the current number of
+  /// IDs, so nodes created during the iteration are visited too.
+  class LayoutIterator
+    : public llvm::iterator_facade_base<LayoutIterator,
+                                        std::forward_iterator_tag,
+                                        LayoutTypeSystemNode *,
+                                        std::ptrdiff_t,
+                                        LayoutTypeSystemNode *const *,
+                                        LayoutTypeSystemNode *const &> {
+  private:
+    const std::vector<LayoutTypeSystemNode *> *Layouts = nullptr;
+    size_t Index = 0;
+
+  public:
+    LayoutIterator() = default;
+    LayoutIterator(const std::vector<LayoutTypeSystemNode *> &L, size_t I) :
+      Layouts(&L), Index(I) {
+      skipRemoved();
+    }
+
+    LayoutTypeSystemNode *const &operator*() const {
+      return (*Layouts)[Index];
+    }
+
+    LayoutIterator &operator++() {
+      ++Index;
+      skipRemoved();
+      return *this;
+    }
+
+    bool operator==(const LayoutIterator &Other) const {
+      if (isEnd() or Other.isEnd())
+        return isEnd() and Other.isEnd();
+      return Index == Other.Index;
+    }
+
+  private:
+    bool isEnd() const {
+      return Layouts == nullptr or Index >= Layouts->size();
+    }
+
+    void skipRemoved() {
+      while (not isEnd() and (*Layouts)[Index] == nullptr)
+        ++Index;
+    }
+  };
 
   LayoutTypeSystem() : DebugPrinter(new TSDebugPrinter) {}
 
   ~LayoutTypeSystem() {
-    for (auto *Layout : Layouts) {
+    for (auto *Layout : getLayoutsRange()) {
       Layout->~LayoutTypeSystemNode();
       NodeAllocator.Deallocate(Layout);
     }
@@ -308,8 +473,8 @@ protected:
   addLink(LayoutTypeSystemNode *Src, LayoutTypeSystemNode *Tgt, TagT &&Tag) {
     if (Src == nullptr or Tgt == nullptr or Src == Tgt)
       return std::make_pair(nullptr, false);
-    revng_assert(Layouts.contains(Src));
-    revng_assert(Layouts.contains(Tgt));
+    revng_assert(hasLayout(Src));
+    revng_assert(hasLayout(Tgt));
     auto It = LinkTags.insert(std::forward<TagT>(Tag)).first;
     revng_assert(It != LinkTags.end());
     const TypeLinkTag *T = &*It;
@@ -360,10 +525,15 @@ public:
     dumpDotOnFile(FName.c_str(), ShowCollapsed);
   }
 
-  auto getNumLayouts() const { return Layouts.size(); }
+  auto getNumLayouts() const { return NumLayouts; }
 
-  auto getLayoutsRange() const {
-    return llvm::make_range(Layouts.begin(), Layouts.end());
+  /// The live nodes, in ID order, which is also the order of `llvm::nodes`.
+  ///
+  /// \note Before Layouts was indexed by ID, the nodes were visited in pointer
+  ///       order, which was not deterministic across runs.
+  llvm::iterator_range<LayoutIterator> getLayoutsRange() const {
+    return llvm::make_range(LayoutIterator(Layouts, 0),
+                            LayoutIterator(Layouts, Layouts.size()));
   }
 
 public:
@@ -371,31 +541,77 @@ public:
 
   void removeNode(LayoutTypeSystemNode *N);
 
+  // The edges are passed by value, since moving or erasing them invalidates
+  // any iterator or reference into the neighbors of the involved nodes.
+
   void moveEdgeTarget(LayoutTypeSystemNode *OldTgt,
                       LayoutTypeSystemNode *NewTgt,
-                      NeighborIterator InverseEdgeIt,
+                      Link InverseEdge,
                       int64_t OffsetToSum);
 
   void moveEdgeSource(LayoutTypeSystemNode *OldSrc,
                       LayoutTypeSystemNode *NewSrc,
-                      NeighborIterator EdgeIt,
+                      Link Edge,
                       int64_t OffsetToSum);
 
-  NeighborIterator eraseEdge(LayoutTypeSystemNode *Src,
-                             NeighborIterator EdgeIt);
+  void eraseEdge(LayoutTypeSystemNode *Src, Link Edge);
 
   void dropOutgoingEdges(LayoutTypeSystemNode *N);
 
+public:
+  using ComponentVector = std::vector<std::unique_ptr<LayoutTypeSystem>>;
+
+  /// Move each weakly connected component into a LayoutTypeSystem of its own,
+  /// so that the components can be processed independently, even
+  /// concurrently.
+  ///
+  /// The nodes of each component get new IDs, in the same relative order as
+  /// the original ones. This LayoutTypeSystem is left without nodes until
+  /// `joinComponents` is called, but keeps the equivalence classes of the
+  /// original IDs.
+  ComponentVector splitComponents();
+
+  /// Move back the nodes of \a Components, obtained from `splitComponents`.
+  ///
+  /// The nodes get new IDs, following the order of the components and the
+  /// order of the IDs in each of them, so that they do not depend on how the
+  /// components were scheduled. Each original ID is moved into the
+  /// equivalence class of the node that replaced it.
+  void joinComponents(ComponentVector &&Components);
+
+  /// Returns true if any of the loggers used by the methods above is enabled.
+  static bool isLoggingEnabled();
+
 private:
   uint64_t NID = 0ULL;
 
-  // Holds all the LayoutTypeSystemNode
+  // Holds all the LayoutTypeSystemNode, indexed by ID. Removed nodes leave a
+  // nullptr behind, so that the IDs of the others stay valid indices.
   llvm::BumpPtrAllocator NodeAllocator = {};
-  std::set<LayoutTypeSystemNode *> Layouts = {};
+  std::vector<LayoutTypeSystemNode *> Layouts = {};
+  size_t NumLayouts = 0;
+
+  bool hasLayout(const LayoutTypeSystemNode *N) const {
+    return N->ID < Layouts.size() and Layouts[N->ID] == N;
+  }
+
+  /// Drop \a N from Layouts and free it, leaving its edges and equivalence
+  /// class to the caller
+  void destroyNode(LayoutTypeSystemNode *N);
+
+  // Each node moved into a component by splitComponents, identified by its ID
+  // before the split, by the index of the component, and by its ID in there.
+  struct SplitNode {
+    uint64_t OriginalID;
+    unsigned Component;
+    uint64_t ComponentID;
+  };
+  std::vector<SplitNode> SplitNodes = {};
 
   // Holds the link tags, so that they can be deduplicated and referred to using
-  // TypeLinkTag * in the links inside LayoutTypeSystemNode
-  std::set<TypeLinkTag> LinkTags = {};
+  // TypeLinkTag * in the links inside LayoutTypeSystemNode.
+  // Elements of an unordered_set are never moved, so the pointers stay valid.
+  std::unordered_set<TypeLinkTag, TypeLinkTag::Hash> LinkTags = {};
 
 public:
   // Checks that is valid, and returns true if it is, false otherwise
@@ -571,7 +787,7 @@ struct llvm::GraphTraits<const dla::LayoutTypeSystem *>
   : public llvm::GraphTraits<const dla::LayoutTypeSystemNode *> {
 
 public:
-  using nodes_iterator = std::set<dla::LayoutTypeSystemNode *>::iterator;
+  using nodes_iterator = dla::LayoutTypeSystem::LayoutIterator;
 
   static NodeRef getEntryNode(const dla::LayoutTypeSystem *) { return nullptr; }
 
@@ -593,7 +809,7 @@ struct llvm::GraphTraits<dla::LayoutTypeSystem *>
   : public llvm::GraphTraits<dla::LayoutTypeSystemNode *> {
 
 public:
-  using nodes_iterator = std::set<dla::LayoutTypeSystemNode *>::iterator;
+  using nodes_iterator = dla::LayoutTypeSystem::LayoutIterator;
 
   static NodeRef getEntryNode(const dla::LayoutTypeSystem *) { return nullptr; }
 
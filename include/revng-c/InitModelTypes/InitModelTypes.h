@@ -4,13 +4,33 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
-#include <map>
+#include <optional>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Pass.h"
+
+#include "revng/Model/Binary.h"
+
+#include "revng-c/Support/ModelHelpers.h"
 
 namespace llvm {
 class Value;
 class Function;
+class Instruction;
 } // namespace llvm
 
+/// The model type of each `llvm::Value`.
+///
+/// This is looked up for pretty much every instruction during canonicalization
+/// and C emission, hence it's a flat, open addressing, hash table rather than a
+/// node-based tree: no allocation per entry and lookups touching a single
+/// array.
+///
+/// \note Unlike with `std::map`, insertions invalidate iterators and
+///       references to the stored types: copy the type before inserting.
+using ModelTypesMap = llvm::DenseMap<const llvm::Value *,
+                                     model::UpcastableType>;
+
 /// Associate a model type to each `llvm::Instruction`. This is done in 3 ways:
 ///
 /// 1. If the Value has a well defined type in the model (e.g. the stack), use
@@ -21,8 +41,70 @@ class Function;
 ///
 /// \note If the `PointersOnly` flag is set, only pointer types will be added to
 /// the map
-extern std::map<const llvm::Value *, const model::UpcastableType>
-initModelTypes(const llvm::Function &F,
-               const model::Function *ModelF,
-               const model::Binary &Model,
-               bool PointersOnly);
+extern ModelTypesMap initModelTypes(const llvm::Function &F,
+                                    const model::Function *ModelF,
+                                    ModelTypeCache &TypeCache,
+                                    bool PointersOnly);
+
+/// Function analysis caching the results of `initModelTypes`, so that passes
+/// processing the same function can share them instead of recomputing them.
+///
+/// The maps are computed lazily, on the first request. Like any other
+/// analysis, they are dropped when a pass modifies the function without
+/// preserving this analysis. Since the maps are keyed by instruction, this is
+/// not a CFG-only analysis: preserving the CFG does not preserve it. Passes
+/// that only change the type of a few instructions can preserve it explicitly,
+/// as long as they keep it up to date through `forget` and `update`.
+class InitModelTypesAnalysis : public llvm::FunctionPass {
+public:
+  static char ID;
+
+private:
+  const llvm::Function *F = nullptr;
+  const model::Function *ModelF = nullptr;
+  const model::Binary *Model = nullptr;
+
+  /// The types deserialized from LLVM strings, shared by all the functions
+  /// processed in this pass run
+  std::optional<ModelTypeCache> TypeCache;
+
+  /// The cached maps, indexed by the `PointersOnly` flag
+  std::optional<ModelTypesMap> Cache[2];
+
+public:
+  InitModelTypesAnalysis() : llvm::FunctionPass(ID) {}
+
+  bool runOnFunction(llvm::Function &F) override;
+
+  void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+
+  bool doFinalization(llvm::Module &M) override {
+    TypeCache.reset();
+    return false;
+  }
+
+  void releaseMemory() override {
+    Cache[false].reset();
+    Cache[true].reset();
+  }
+
+public:
+  /// Get the types of the function being processed, see `initModelTypes`
+  const ModelTypesMap &get(bool PointersOnly);
+
+  /// Like `get`, but moves the map out of the cache, so that the caller can
+  /// extend it without copying it. Only meant for passes that do not preserve
+  /// this analysis, since the cache would be dropped anyway.
+  ModelTypesMap take(bool PointersOnly);
+
+  /// Get the types deserialized from LLVM strings in this pass run, so that
+  /// the passes using this analysis can share them
+  ModelTypeCache &getTypeCache() { return *TypeCache; }
+
+  /// Drop \a V from the cached maps. Must be called before erasing \a V.
+  void forget(const llvm::Value *V);
+
+  /// Recompute the type of \a I, which has been either created or modified,
+  /// and of all the instructions whose type transitively depends on it.
+  void update(const llvm::Instruction &I);
+};
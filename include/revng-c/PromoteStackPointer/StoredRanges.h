@@ -0,0 +1,206 @@
+#pragma once
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <tuple>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include "revng/Support/Assert.h"
+
+namespace llvm {
+class StoreInst;
+} // namespace llvm
+
+/// The bytes in `[Start, End)` of the stack have been written by \a Store,
+/// whose first byte targets \a StoreStart.
+struct StoredRange {
+  int64_t Start = 0;
+  int64_t End = 0;
+  llvm::StoreInst *Store = nullptr;
+  int64_t StoreStart = 0;
+
+  bool operator<(const StoredRange &Other) const {
+    auto ThisTuple = std::tie(Start, Store, End, StoreStart);
+    auto OtherTuple = std::tie(Other.Start,
+                               Other.Store,
+                               Other.End,
+                               Other.StoreStart);
+    return ThisTuple < OtherTuple;
+  }
+
+  bool operator==(const StoredRange &Other) const = default;
+};
+
+/// Set of stack bytes along with the store that wrote them.
+///
+/// Bytes are tracked as ranges. Ranges belonging to the same store are kept
+/// disjoint and non-adjacent, so that two equivalent sets of bytes always have
+/// the same representation.
+///
+/// The underlying set is shared among copies and it's copied only upon
+/// modification: most of the blocks do not touch the stack and the result of
+/// the join of identical values is one of the operands.
+class StoredRanges {
+private:
+  using RangeSet = std::set<StoredRange>;
+
+  struct Data {
+    RangeSet Ranges;
+    /// Upper bound on the size of each element of Ranges
+    uint64_t MaxSize = 0;
+  };
+
+private:
+  std::shared_ptr<Data> Shared;
+
+public:
+  bool empty() const { return Shared == nullptr or Shared->Ranges.empty(); }
+
+  auto begin() const { return ranges().begin(); }
+  auto end() const { return ranges().end(); }
+
+public:
+  void clear() { Shared.reset(); }
+
+  /// Forget about all the bytes in `[Start, End)`
+  void erase(int64_t Start, int64_t End) {
+    if (not overlaps(Start, End))
+      return;
+
+    Data &Mutable = getMutable();
+    RangeSet &Ranges = Mutable.Ranges;
+    llvm::SmallVector<StoredRange, 2> Leftovers;
+    auto It = firstCandidate(Start);
+    while (It != Ranges.end() and It->Start < End) {
+      if (It->End <= Start) {
+        ++It;
+        continue;
+      }
+
+      // Preserve the parts of the range outside of [Start, End)
+      if (It->Start < Start)
+        Leftovers.push_back({ It->Start, Start, It->Store, It->StoreStart });
+      if (It->End > End)
+        Leftovers.push_back({ End, It->End, It->Store, It->StoreStart });
+
+      It = Ranges.erase(It);
+    }
+
+    Ranges.insert(Leftovers.begin(), Leftovers.end());
+  }
+
+  /// Record that \a Store wrote all of its bytes. The range it targets must
+  /// have been erased beforehand.
+  void insert(llvm::StoreInst *Store, int64_t Start, uint64_t Size) {
+    int64_t End = Start + static_cast<int64_t>(Size);
+    revng_assert(not overlaps(Start, End));
+    Data &Mutable = getMutable();
+    Mutable.Ranges.insert({ Start, End, Store, Start });
+    Mutable.MaxSize = std::max(Mutable.MaxSize, Size);
+  }
+
+public:
+  static StoredRanges combineValues(const StoredRanges &LHS,
+                                    const StoredRanges &RHS) {
+    if (isLessOrEqual(RHS, LHS))
+      return LHS;
+    if (isLessOrEqual(LHS, RHS))
+      return RHS;
+
+    StoredRanges Result = LHS;
+    Data &Mutable = Result.getMutable();
+    Mutable.MaxSize = std::max(Mutable.MaxSize, RHS.Shared->MaxSize);
+    for (const StoredRange &Range : RHS)
+      Result.merge(Range);
+
+    return Result;
+  }
+
+  static bool isLessOrEqual(const StoredRanges &LHS,
+                            const StoredRanges &RHS) {
+    if (LHS.Shared == RHS.Shared or LHS.empty())
+      return true;
+
+    return llvm::all_of(LHS, [&RHS](const StoredRange &Range) {
+      return RHS.covers(Range);
+    });
+  }
+
+private:
+  const RangeSet &ranges() const {
+    static const RangeSet Empty;
+    return Shared == nullptr ? Empty : Shared->Ranges;
+  }
+
+  Data &getMutable() {
+    if (Shared == nullptr)
+      Shared = std::make_shared<Data>();
+    else if (Shared.use_count() > 1)
+      Shared = std::make_shared<Data>(*Shared);
+
+    return *Shared;
+  }
+
+  /// Return the first range that might overlap a range starting at \a Start
+  RangeSet::const_iterator firstCandidate(int64_t Start) const {
+    int64_t MaxSize = static_cast<int64_t>(Shared->MaxSize);
+    return Shared->Ranges.lower_bound(StoredRange{ Start - MaxSize });
+  }
+
+  bool overlaps(int64_t Start, int64_t End) const {
+    if (empty())
+      return false;
+
+    for (auto It = firstCandidate(Start);
+         It != Shared->Ranges.end() and It->Start < End;
+         ++It)
+      if (It->End > Start)
+        return true;
+
+    return false;
+  }
+
+  /// Is \a Range a subset of a range of the same store? Since ranges of the
+  /// same store are never adjacent, there's no need to consider several of
+  /// them.
+  bool covers(const StoredRange &Range) const {
+    if (empty())
+      return false;
+
+    for (auto It = firstCandidate(Range.Start);
+         It != Shared->Ranges.end() and It->Start <= Range.Start;
+         ++It)
+      if (It->Store == Range.Store and It->End >= Range.End)
+        return true;
+
+    return false;
+  }
+
+  /// Add \a Range, coalescing it with the ranges of the same store it overlaps
+  /// or is adjacent to
+  void merge(StoredRange Range) {
+    RangeSet &Ranges = getMutable().Ranges;
+    auto It = firstCandidate(Range.Start);
+    while (It != Ranges.end() and It->Start <= Range.End) {
+      if (It->Store != Range.Store or It->End < Range.Start) {
+        ++It;
+        continue;
+      }
+
+      revng_assert(It->StoreStart == Range.StoreStart);
+      Range.Start = std::min(Range.Start, It->Start);
+      Range.End = std::max(Range.End, It->End);
+      It = Ranges.erase(It);
+    }
+
+    Ranges.insert(Range);
+  }
+};
@@ -4,8 +4,10 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <cstdint>
 #include <cstdlib>
 
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
@@ -63,6 +65,77 @@ protected:
   /// will be inserted in an ASTTree.
   unsigned ID = 0;
 
+  /// Cache for `getStructuralHash`, which is not copied along with the node,
+  /// since clones usually have their children replaced right afterwards.
+  struct HashCache {
+    /// The hash is valid only if this matches the epoch of the tree
+    uint64_t Epoch = 0;
+    llvm::hash_code Hash;
+
+    /// The node whose hash has last been computed from this one, i.e., the
+    /// parent of this node at that time
+    const ASTNode *Parent = nullptr;
+
+    HashCache() = default;
+    HashCache(const HashCache &) {}
+    HashCache &operator=(const HashCache &) {
+      Epoch = 0;
+      Parent = nullptr;
+      return *this;
+    }
+  };
+  mutable HashCache CachedHash;
+
+public:
+  /// State shared by the nodes of an `ASTTree` to validate the hashes they
+  /// cache, see `ASTTree::StructuralHashScope`.
+  struct StructuralHashState {
+    /// Hashes are only cached while this is set
+    bool Enabled = false;
+
+    /// Bumped whenever hashes start being cached, so that the hashes cached
+    /// before, which might have gone stale in the meantime, are dropped
+    uint64_t Epoch = 1;
+  };
+
+protected:
+  /// The state of the `ASTTree` this node belongs to, if any
+  StructuralHashState *HashState = nullptr;
+
+  bool hasCachedStructuralHash() const {
+    return cachesStructuralHashes() and CachedHash.Epoch == HashState->Epoch;
+  }
+
+  /// Must be called whenever the structure of the node changes.
+  ///
+  /// It drops the hash cached by this node and by its ancestors, which are
+  /// reached through the parent recorded when their hash was computed. If the
+  /// hash of a node is cached, so are the ones of its children, hence the walk
+  /// can stop at the first node that has no cached hash.
+  ///
+  ///       \note This relies on the AST being a tree: the hash of a node that
+  ///       has more than one parent would only invalidate the hash of one of
+  ///       them.
+  void invalidateStructuralHashes() {
+    for (const ASTNode *Node = this;
+         Node != nullptr and Node->hasCachedStructuralHash();
+         Node = Node->CachedHash.Parent)
+      Node->CachedHash.Epoch = 0;
+  }
+
+  bool cachesStructuralHashes() const {
+    return HashState != nullptr and HashState->Enabled;
+  }
+
+  /// The mutable accessors to the children hand out references through which
+  /// the structure of the node can be changed without the node noticing, hence
+  /// they cannot be used while the hashes are cached.
+  void assertNotCachingStructuralHashes() const {
+    revng_assert(not cachesStructuralHashes(),
+                 "Mutable access to the children of a node while structural "
+                 "hashes are cached");
+  }
+
   ASTNode(NodeKind K, const std::string &Name) : Kind(K), Name(Name) {}
 
   ASTNode(NodeKind K, const std::string &Name, llvm::BasicBlock *BB) :
@@ -94,12 +167,44 @@ public:
 
   inline bool isEqual(const ASTNode *Node) const;
 
+  /// Hash of the subtree rooted in this node, consistent with `isEqual`: equal
+  /// subtrees have the same hash.
+  ///
+  /// \note This visits the whole subtree, unless the hashes are being cached.
+  llvm::hash_code getStructuralHash() const {
+    if (not cachesStructuralHashes())
+      return computeStructuralHash();
+
+    if (not hasCachedStructuralHash()) {
+      CachedHash.Hash = computeStructuralHash();
+      CachedHash.Epoch = HashState->Epoch;
+    }
+    return CachedHash.Hash;
+  }
+
+private:
+  llvm::hash_code computeStructuralHash() const;
+
+  /// Hash of \a Child, recording this node as its parent
+  llvm::hash_code getChildStructuralHash(const ASTNode *Child) const {
+    if (Child == nullptr)
+      return llvm::hash_code(0);
+
+    Child->CachedHash.Parent = this;
+    return Child->getStructuralHash();
+  }
+
+public:
   std::string getName() const {
     return "ID:" + std::to_string(getID()) + " Name:" + Name;
   }
 
   void setID(unsigned NewID) { ID = NewID; }
 
+  void setStructuralHashState(StructuralHashState *State) {
+    HashState = State;
+  }
+
   unsigned getID() const { return ID; }
 
   llvm::BasicBlock *getBB() const { return BB; }
@@ -236,9 +341,15 @@ public:
 
   ASTNode *getElse() const { return Else; }
 
-  void setThen(ASTNode *Node) { Then = Node; }
+  void setThen(ASTNode *Node) {
+    invalidateStructuralHashes();
+    Then = Node;
+  }
 
-  void setElse(ASTNode *Node) { Else = Node; }
+  void setElse(ASTNode *Node) {
+    invalidateStructuralHashes();
+    Else = Node;
+  }
 
   bool hasThen() const {
     if (Then != nullptr) {
@@ -317,7 +428,10 @@ public:
 
   ASTNode *getBody() const { return Body; }
 
-  void setBody(ASTNode *Node) { Body = Node; }
+  void setBody(ASTNode *Node) {
+    invalidateStructuralHashes();
+    Body = Node;
+  }
 
   void dump(llvm::raw_fd_ostream &ASTFile);
 
@@ -384,6 +498,7 @@ public:
   static bool classof(const ASTNode *N) { return N->getKind() == NK_List; }
 
   links_range nodes() {
+    assertNotCachingStructuralHashes();
     return llvm::make_range(NodeVec.begin(), NodeVec.end());
   }
 
@@ -392,6 +507,7 @@ public:
   }
 
   void addNode(ASTNode *Node) {
+    invalidateStructuralHashes();
     NodeVec.push_back(Node);
     if (Node->getSuccessor() != nullptr) {
       this->addNode(Node->consumeSuccessor());
@@ -399,6 +515,7 @@ public:
   }
 
   void removeNode(ASTNode *Node) {
+    invalidateStructuralHashes();
     NodeVec.erase(std::remove(NodeVec.begin(), NodeVec.end(), Node),
                   NodeVec.end());
   }
@@ -409,7 +526,10 @@ public:
 
   ASTNode *getNodeN(links_container::size_type N) const { return NodeVec[N]; }
 
-  links_container &getChildVec() { return NodeVec; }
+  links_container &getChildVec() {
+    assertNotCachingStructuralHashes();
+    return NodeVec;
+  }
 
   void dump(llvm::raw_fd_ostream &ASTFile);
 
@@ -603,7 +723,10 @@ public:
 
   ASTNode *Clone() const { return new SwitchNode(*this); }
 
-  case_container &cases() { return LabelCaseVec; }
+  case_container &cases() {
+    assertNotCachingStructuralHashes();
+    return LabelCaseVec;
+  }
 
   case_const_range cases_const_range() const {
     return llvm::iterator_range(LabelCaseVec.begin(), LabelCaseVec.end());
@@ -613,6 +736,7 @@ public:
 
   void removeCaseN(size_t N) {
     revng_assert(N < LabelCaseVec.size());
+    invalidateStructuralHashes();
     LabelCaseVec.erase(LabelCaseVec.begin() + N);
   }
 
@@ -791,6 +915,14 @@ inline void ASTNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
 }
 
 inline bool ASTNode::isEqual(const ASTNode *Node) const {
+  // Rule out most of the unequal subtrees without visiting them. This is only
+  // worth it if the hashes are cached, otherwise computing them visits the
+  // subtrees anyway.
+  if (Node != nullptr and cachesStructuralHashes()
+      and Node->cachesStructuralHashes()
+      and getStructuralHash() != Node->getStructuralHash())
+    return false;
+
   switch (getKind()) {
   case NK_Code:
     return llvm::cast<CodeNode>(this)->nodeIsEqual(Node);
@@ -5,6 +5,7 @@
 //
 
 #include <cstdlib>
+#include <memory>
 #include <type_traits>
 
 #include "revng-c/RestructureCFG/ASTNode.h"
@@ -68,6 +69,12 @@ private:
   unsigned IDCounter = 0;
   links_container_expr CondExprList = {};
 
+  /// Shared with all the nodes. It's allocated separately so that it doesn't
+  /// move along with the tree.
+  using StructuralHashState = ASTNode::StructuralHashState;
+  std::unique_ptr<StructuralHashState>
+    HashState = std::make_unique<StructuralHashState>();
+
 public:
   ASTTree() = default;
 
@@ -127,4 +134,31 @@ public:
                                     const std::string &FileName) const;
 
   ExprNode *addCondExpr(expr_unique_ptr &&Expr);
+
+public:
+  /// Let the nodes of \a AST cache their structural hashes, which speeds up
+  /// repeated calls to `ASTNode::isEqual`, for the lifetime of this object.
+  ///
+  /// Meanwhile, nodes can only be changed through the methods that explicitly
+  /// set their children (e.g., `IfNode::setThen`), which invalidate the hashes
+  /// cached by the changed node and by its ancestors: the mutable accessors to
+  /// the children (e.g., `SequenceNode::nodes`) assert.
+  class StructuralHashScope {
+  private:
+    StructuralHashState &State;
+
+  public:
+    StructuralHashScope(ASTTree &AST) : State(*AST.HashState) {
+      revng_assert(not State.Enabled);
+      State.Enabled = true;
+
+      // Drop whatever has been cached in a previous scope
+      ++State.Epoch;
+    }
+
+    ~StructuralHashScope() { State.Enabled = false; }
+
+    StructuralHashScope(const StructuralHashScope &) = delete;
+    StructuralHashScope &operator=(const StructuralHashScope &) = delete;
+  };
 };
@@ -6,6 +6,7 @@
 
 #include <cstdlib>
 
+#include "llvm/ADT/Hashing.h"
 #include "llvm/Support/Casting.h"
 
 #include "revng/Support/Assert.h"
@@ -42,6 +43,14 @@ public:
 
   static void deleteExprNode(ExprNode *E);
 
+  /// Whether the expression rooted in this node is structurally equal to the
+  /// one rooted in \a Other
+  bool isEqual(const ExprNode *Other) const;
+
+  /// Hash of the expression rooted in this node, consistent with `isEqual`:
+  /// equal expressions have the same hash.
+  llvm::hash_code getStructuralHash() const;
+
 protected:
   ExprNode(NodeKind K) : Kind(K) {}
   ~ExprNode() = default;
@@ -456,6 +456,11 @@ generateAst(RegionCFG<llvm::BasicBlock *> &Region,
   std::string RegionName = Region.getRegionName();
   std::string FunctionName = Region.getFunctionName();
 
+  // Once too many nodes have been cloned, the AST is discarded, see
+  // `DuplicationLimit`: give up as soon as possible.
+  if (isDuplicationLimitExceeded())
+    return;
+
   Region.markUnreachableAsInlined();
 
   // Invoke the weave function.
@@ -463,6 +468,8 @@ generateAst(RegionCFG<llvm::BasicBlock *> &Region,
 
   // Invoke the inflate function.
   Region.inflate();
+  if (isDuplicationLimitExceeded())
+    return;
 
   // After we are done with the combing, we need to pre-compute the weight of
   // the current RegionCFG, so that during the untangle phase of other
@@ -514,10 +521,16 @@ generateAst(RegionCFG<llvm::BasicBlock *> &Region,
                 "Inspecting collapsed node: " << Node->getNameStr());
 
       // Call recursively the generation of the AST for the collapsed node.
-      const auto &[It, New] = CollapsedMap.insert({ BodyGraph, ASTTree() });
+      // Look it up before inserting, since with `-restructure-region-jobs`
+      // sibling regions share a read-only `CollapsedMap`.
+      auto It = CollapsedMap.find(BodyGraph);
+      if (It == CollapsedMap.end()) {
+        It = CollapsedMap.insert({ BodyGraph, ASTTree() }).first;
+        generateAst(*BodyGraph, It->second, CollapsedMap);
+        if (isDuplicationLimitExceeded())
+          return;
+      }
       ASTTree &CollapsedAST = It->second;
-      if (New)
-        generateAst(*BodyGraph, CollapsedAST, CollapsedMap);
 
       ASTNode *Body = AST.copyASTNodesFrom(CollapsedAST);
 
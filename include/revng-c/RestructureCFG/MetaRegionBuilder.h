@@ -0,0 +1,443 @@
+#pragma once
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include "revng/Support/Debug.h"
+#include "revng/Support/GraphAlgorithms.h"
+
+#include "revng-c/RestructureCFG/BasicBlockNode.h"
+#include "revng-c/RestructureCFG/MetaRegion.h"
+#include "revng-c/RestructureCFG/Utils.h"
+
+/// Builds the metaregions of a RegionCFG starting from its backedges.
+///
+/// Each SCS is represented as a `llvm::BitVector` indexed by node ID (the
+/// metaregions are built before any region is restructured, so node IDs are
+/// still dense, see `BasicBlockNodeArena`), so that merges and inclusion tests
+/// are word-wise operations instead of `std::set` walks. The SCSs that may
+/// interact with a given one are found through the nodes they share, instead
+/// of trying all the pairs, and merged SCSs are tracked with a union-find.
+///
+/// SCSs are merged in the same order as a pairwise fixed-point iteration over
+/// the SCSs (one per backedge, in the order of \a Backedges) would, so the
+/// resulting metaregions are the same.
+template<class NodeT>
+class MetaRegionBuilder {
+public:
+  using BasicBlockNodeT = BasicBlockNode<NodeT>;
+  using EdgeDescriptor = typename BasicBlockNodeT::EdgeDescriptor;
+  using MetaRegionT = MetaRegion<NodeT>;
+  using MetaRegionTVect = std::vector<MetaRegionT>;
+  using MetaRegionTPtrVect = std::vector<MetaRegionT *>;
+
+private:
+  static constexpr unsigned None = std::numeric_limits<unsigned>::max();
+
+  /// The nodes belonging to an SCS, indexed by ID
+  std::vector<BasicBlockNodeT *> Nodes;
+
+  /// Source and target of each backedge. The i-th SCS is the one originated
+  /// by the i-th backedge.
+  std::vector<std::pair<unsigned, unsigned>> Backedges;
+
+  /// For each node, the backedges it is an endpoint of.
+  std::vector<llvm::SmallVector<unsigned, 2>> IncidentBackedges;
+
+  std::vector<llvm::BitVector> SCSNodes;
+
+  /// Union-find over the SCSs: an SCS merged into another one points to it.
+  std::vector<unsigned> Leader;
+
+  /// The SCSs each node belongs to, as of the beginning of `mergeOverlapping`.
+  /// SCSs merged later on are resolved to their leader.
+  std::vector<llvm::SmallVector<unsigned>> NodeSCSs;
+
+  /// The smallest SCS including each SCS, as computed by `mergeOverlapping`.
+  std::vector<unsigned> Parent;
+
+public:
+  explicit MetaRegionBuilder(const llvm::SmallDenseSet<EdgeDescriptor>
+                               &Backedges);
+
+  /// Merge each SCS with the SCSs originated by the backedges having only one
+  /// endpoint in it.
+  void mergeAbnormalRetreating();
+
+  /// Merge SCSs that intersect without one including the other, or that are
+  /// equal, until the SCSs form a laminar family. Also computes the parent of
+  /// each SCS.
+  void mergeOverlapping();
+
+  /// Check that each SCS contains either both endpoints of a backedge or
+  /// neither of them.
+  bool isConsistent() const;
+
+  /// Create a metaregion for each surviving SCS, sorted by increasing number
+  /// of nodes and with the parent relationship in place.
+  MetaRegionTVect createMetaRegions() const;
+
+  /// Order the metaregions so that each one comes before its parent.
+  static MetaRegionTPtrVect applyPartialOrder(MetaRegionTVect &V);
+
+private:
+  unsigned getID(BasicBlockNodeT *Node) {
+    unsigned ID = Node->getID();
+    if (ID >= Nodes.size())
+      Nodes.resize(ID + 1, nullptr);
+    Nodes[ID] = Node;
+    return ID;
+  }
+
+  bool isAlive(unsigned SCS) const { return Leader[SCS] == SCS; }
+
+  unsigned findLeader(unsigned SCS) {
+    while (Leader[SCS] != SCS) {
+      Leader[SCS] = Leader[Leader[SCS]];
+      SCS = Leader[SCS];
+    }
+    return SCS;
+  }
+
+  bool isSubSet(unsigned SCS, unsigned Other) const {
+    // `BitVector::test` checks whether there's any bit set in the first operand
+    // which is not set in the second one.
+    return not SCSNodes[SCS].test(SCSNodes[Other]);
+  }
+
+  /// Merge \a From into \a Into, and return the nodes that were not already in
+  /// \a Into.
+  llvm::BitVector merge(unsigned Into, unsigned From) {
+    revng_assert(isAlive(Into) and Into != From);
+    llvm::BitVector Additional = SCSNodes[From];
+    Additional.reset(SCSNodes[Into]);
+    SCSNodes[Into] |= Additional;
+    Leader[From] = Into;
+    return Additional;
+  }
+
+  unsigned findFirstOverlapping(unsigned SCS, bool Preceding);
+
+  void computeParents();
+
+  llvm::SmallVector<unsigned> getAliveSCSs() const {
+    llvm::SmallVector<unsigned> Result;
+    for (unsigned SCS = 0; SCS < SCSNodes.size(); ++SCS)
+      if (isAlive(SCS))
+        Result.push_back(SCS);
+    return Result;
+  }
+};
+
+template<class NodeT>
+MetaRegionBuilder<NodeT>::MetaRegionBuilder(const llvm::SmallDenseSet<
+                                            EdgeDescriptor> &Edges) {
+  // Collect all the nodes belonging to an SCS.
+  std::vector<llvm::SmallVector<unsigned>> SCSList;
+  SCSList.reserve(Edges.size());
+  for (const EdgeDescriptor &Backedge : Edges) {
+    auto SCS = nodesBetween(Backedge.second, Backedge.first);
+
+    if (CombLogger.isEnabled()) {
+      CombLogger << "SCS identified by: ";
+      CombLogger << Backedge.first->getNameStr() << " -> "
+                 << Backedge.second->getNameStr() << "\n";
+      CombLogger << "Is composed of nodes:\n";
+      for (auto Node : SCS) {
+        CombLogger << Node->getNameStr() << "\n";
+      }
+    }
+
+    llvm::SmallVector<unsigned> &IDs = SCSList.emplace_back();
+    for (BasicBlockNodeT *Node : SCS)
+      IDs.push_back(getID(Node));
+    Backedges.emplace_back(getID(Backedge.first), getID(Backedge.second));
+  }
+
+  const size_t NodesCount = Nodes.size();
+  IncidentBackedges.resize(NodesCount);
+  for (unsigned I = 0; I < Backedges.size(); ++I) {
+    IncidentBackedges[Backedges[I].first].push_back(I);
+    IncidentBackedges[Backedges[I].second].push_back(I);
+  }
+
+  // Build the node set of each SCS, and the union of the SCSs sharing the
+  // same head.
+  llvm::DenseMap<unsigned, llvm::BitVector> HeadNodes;
+  SCSNodes.reserve(SCSList.size());
+  for (unsigned I = 0; I < SCSList.size(); ++I) {
+    llvm::BitVector &SCS = SCSNodes.emplace_back(NodesCount);
+    for (unsigned Node : SCSList[I])
+      SCS.set(Node);
+
+    auto It = HeadNodes.try_emplace(Backedges[I].second, NodesCount).first;
+    It->second |= SCS;
+  }
+
+  // Include in the regions found before other possible sub-regions, if an edge
+  // which is the target of a backedge is included in an outer region. Each
+  // node is visited only once per SCS, when it's added to it.
+  for (unsigned I = 0; I < SCSNodes.size(); ++I) {
+    unsigned Head = Backedges[I].second;
+    llvm::BitVector &SCS = SCSNodes[I];
+    llvm::SmallVector<unsigned> Worklist;
+    for (unsigned Node : SCS.set_bits())
+      Worklist.push_back(Node);
+
+    while (not Worklist.empty()) {
+      unsigned Node = Worklist.pop_back_val();
+      if (Node == Head)
+        continue;
+
+      auto It = HeadNodes.find(Node);
+      if (It == HeadNodes.end())
+        continue;
+
+      CombLogger << "Adding additional nodes for region with head: ";
+      CombLogger << Nodes[Head]->getNameStr();
+      CombLogger << " and relative to node: ";
+      CombLogger << Nodes[Node]->getNameStr() << "\n";
+
+      llvm::BitVector Additional = It->second;
+      Additional.reset(SCS);
+      SCS |= Additional;
+      for (unsigned NewNode : Additional.set_bits())
+        Worklist.push_back(NewNode);
+    }
+  }
+
+  Leader.resize(SCSNodes.size());
+  std::iota(Leader.begin(), Leader.end(), 0);
+  Parent.resize(SCSNodes.size(), None);
+}
+
+template<class NodeT>
+void MetaRegionBuilder<NodeT>::mergeAbnormalRetreating() {
+  // The SCS each backedge has been last merged into. Note that this is not
+  // necessarily an SCS that is still alive: in that case, the nodes it had
+  // when it has been merged are used.
+  std::vector<unsigned> BackedgeSCS(Backedges.size());
+  std::iota(BackedgeSCS.begin(), BackedgeSCS.end(), 0);
+
+  // Merging never shrinks an SCS, so an SCS that does not need to be merged
+  // stays so, unless it is merged itself into another one. This means that a
+  // single pass over the SCSs is enough.
+  for (unsigned I = 0; I < SCSNodes.size(); ++I) {
+    if (not isAlive(I))
+      continue;
+
+    // Keep track of the backedges with only one endpoint in the SCS, updating
+    // them as nodes are added to it.
+    llvm::BitVector &SCS = SCSNodes[I];
+    std::set<unsigned> Abnormal;
+    auto AddNodes = [&](const llvm::BitVector &NewNodes) {
+      for (unsigned Node : NewNodes.set_bits()) {
+        for (unsigned Backedge : IncidentBackedges[Node]) {
+          auto [Source, Target] = Backedges[Backedge];
+          if (SCS.test(Source) != SCS.test(Target))
+            Abnormal.insert(Backedge);
+          else
+            Abnormal.erase(Backedge);
+        }
+      }
+    };
+    AddNodes(SCS);
+
+    while (not Abnormal.empty()) {
+      unsigned Backedge = *Abnormal.begin();
+
+      // The SCS associated to the backedge contains both its endpoints, so it
+      // cannot be the current one.
+      unsigned Other = BackedgeSCS[Backedge];
+      AddNodes(merge(I, Other));
+      BackedgeSCS[Backedge] = I;
+      revng_assert(not Abnormal.contains(Backedge));
+    }
+  }
+}
+
+template<class NodeT>
+unsigned MetaRegionBuilder<NodeT>::findFirstOverlapping(unsigned SCS,
+                                                        bool Preceding) {
+  // Only the SCSs sharing a node with the current one can overlap with it.
+  llvm::SmallVector<unsigned> Candidates;
+  for (unsigned Node : SCSNodes[SCS].set_bits()) {
+    for (unsigned Other : NodeSCSs[Node]) {
+      Other = findLeader(Other);
+      if (Preceding ? Other < SCS : Other > SCS)
+        Candidates.push_back(Other);
+    }
+  }
+  llvm::sort(Candidates);
+  Candidates.erase(std::unique(Candidates.begin(), Candidates.end()),
+                   Candidates.end());
+
+  // Two intersecting SCSs have to be merged if neither includes the other, or
+  // if they are equal.
+  for (unsigned Other : Candidates)
+    if (isSubSet(SCS, Other) == isSubSet(Other, SCS))
+      return Other;
+
+  return None;
+}
+
+template<class NodeT>
+void MetaRegionBuilder<NodeT>::mergeOverlapping() {
+  NodeSCSs.assign(Nodes.size(), {});
+  for (unsigned SCS : getAliveSCSs())
+    for (unsigned Node : SCSNodes[SCS].set_bits())
+      NodeSCSs[Node].push_back(SCS);
+
+  // All the pairs of SCSs whose first element precedes Current do not need to
+  // be merged. Growing Current can only break this invariant for the pairs
+  // Current is the second element of, which are handled first.
+  unsigned Current = 0;
+  while (Current < SCSNodes.size()) {
+    if (not isAlive(Current)) {
+      ++Current;
+      continue;
+    }
+
+    unsigned Following = findFirstOverlapping(Current, false);
+    if (Following == None) {
+      ++Current;
+      continue;
+    }
+
+    merge(Current, Following);
+
+    unsigned Preceding = findFirstOverlapping(Current, true);
+    while (Preceding != None) {
+      merge(Preceding, Current);
+      Current = Preceding;
+      Preceding = findFirstOverlapping(Current, true);
+    }
+  }
+
+  computeParents();
+}
+
+template<class NodeT>
+void MetaRegionBuilder<NodeT>::computeParents() {
+  llvm::SmallVector<unsigned> Order = getAliveSCSs();
+  std::vector<size_t> Sizes(SCSNodes.size());
+  for (unsigned SCS : Order)
+    Sizes[SCS] = SCSNodes[SCS].count();
+  llvm::stable_sort(Order, [&Sizes](unsigned First, unsigned Second) {
+    return Sizes[First] > Sizes[Second];
+  });
+
+  // Visit the SCSs from the largest to the smallest, keeping track of the
+  // innermost SCS containing each node seen so far. Since the SCSs form a
+  // laminar family, that's the parent of all the SCSs visited later containing
+  // that node.
+  std::vector<unsigned> Owner(Nodes.size(), None);
+  for (unsigned SCS : Order) {
+    const llvm::BitVector &SCSSet = SCSNodes[SCS];
+    Parent[SCS] = Owner[SCSSet.find_first()];
+
+    if (CombLogger.isEnabled()) {
+      CombLogger << "For metaregion with index: " << SCS + 1 << "\n";
+      if (Parent[SCS] != None)
+        CombLogger << "parent found with index: " << Parent[SCS] + 1 << "\n";
+      else
+        CombLogger << "no parent found\n";
+    }
+
+    for (unsigned Node : SCSSet.set_bits()) {
+      revng_assert(Owner[Node] == Parent[SCS]);
+      Owner[Node] = SCS;
+    }
+  }
+}
+
+template<class NodeT>
+bool MetaRegionBuilder<NodeT>::isConsistent() const {
+  for (unsigned SCS : getAliveSCSs()) {
+    for (auto [Source, Target] : Backedges) {
+      bool HasSource = SCSNodes[SCS].test(Source);
+      bool HasTarget = SCSNodes[SCS].test(Target);
+      if (HasSource != HasTarget)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+template<class NodeT>
+typename MetaRegionBuilder<NodeT>::MetaRegionTVect
+MetaRegionBuilder<NodeT>::createMetaRegions() const {
+  llvm::SmallVector<unsigned> Order = getAliveSCSs();
+  std::vector<size_t> Sizes(SCSNodes.size());
+  for (unsigned SCS : Order)
+    Sizes[SCS] = SCSNodes[SCS].count();
+  llvm::stable_sort(Order, [&Sizes](unsigned First, unsigned Second) {
+    return Sizes[First] < Sizes[Second];
+  });
+
+  MetaRegionTVect MetaRegions;
+  MetaRegions.reserve(Order.size());
+  std::vector<unsigned> Position(SCSNodes.size(), None);
+  for (unsigned SCS : Order) {
+    std::set<BasicBlockNodeT *> SCSSet;
+    for (unsigned Node : SCSNodes[SCS].set_bits())
+      SCSSet.insert(Nodes[Node]);
+
+    Position[SCS] = MetaRegions.size();
+    MetaRegions.push_back(MetaRegionT(SCS + 1, SCSSet, true));
+  }
+
+  for (unsigned SCS : Order) {
+    if (Parent[SCS] != None) {
+      MetaRegionT &ParentRegion = MetaRegions[Position[Parent[SCS]]];
+      MetaRegions[Position[SCS]].setParent(&ParentRegion);
+    }
+  }
+
+  return MetaRegions;
+}
+
+template<class NodeT>
+typename MetaRegionBuilder<NodeT>::MetaRegionTPtrVect
+MetaRegionBuilder<NodeT>::applyPartialOrder(MetaRegionTVect &V) {
+  // Visit the metaregions top-down, each time picking, among the ones whose
+  // parent has already been visited, the first one in `V`.
+  std::vector<llvm::SmallVector<size_t, 4>> Children(V.size());
+  std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> Ready;
+  for (size_t I = 0; I < V.size(); ++I) {
+    if (MetaRegionT *Parent = V[I].getParent())
+      Children[Parent - V.data()].push_back(I);
+    else
+      Ready.push(I);
+  }
+
+  MetaRegionTPtrVect OrderedVector;
+  OrderedVector.reserve(V.size());
+  while (not Ready.empty()) {
+    size_t I = Ready.top();
+    Ready.pop();
+    OrderedVector.push_back(&V[I]);
+    for (size_t Child : Children[I])
+      Ready.push(Child);
+  }
+  revng_assert(OrderedVector.size() == V.size());
+
+  std::reverse(OrderedVector.begin(), OrderedVector.end());
+  return OrderedVector;
+}
@@ -15,10 +15,9 @@
 #include "revng-c/RestructureCFG/MetaRegion.h"
 
 template<class NodeT>
-void MetaRegion<NodeT>::replaceNodes(BasicBlockNodeTUPVect &N) {
+void MetaRegion<NodeT>::replaceNodes(const BasicBlockNodeTVect &N) {
   Nodes.erase(Nodes.begin(), Nodes.end());
-  for (std::unique_ptr<BasicBlockNodeT> &Node : N)
-    Nodes.insert(Node.get());
+  Nodes.insert(N.begin(), N.end());
 }
 
 template<class NodeT>
@@ -4,18 +4,24 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <algorithm>
 #include <cstdlib>
+#include <memory>
+#include <optional>
 #include <set>
+#include <vector>
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/GenericDomTreeConstruction.h"
 
 #include "revng/ADT/FilteredGraphTraits.h"
 #include "revng/ADT/SmallMap.h"
+#include "revng/Support/Assert.h"
 
 #include "revng-c/RestructureCFG/ASTTree.h"
 #include "revng-c/RestructureCFG/BasicBlockNodeBB.h"
@@ -42,23 +48,127 @@ inline bool isASwitch(BasicBlockNode<llvm::BasicBlock *> *Node) {
   return false;
 }
 
+/// Storage for the BasicBlockNodes of one or more RegionCFGs
+///
+/// Nodes are never freed one by one: removing a node from a RegionCFG only
+/// unlinks it, and all the nodes are destroyed at once together with the arena.
+/// Since the address of a removed node is never reused, the restructuring can
+/// keep maps and sets (e.g. Backedges) indexed by BasicBlockNode pointers
+/// across removals.
+///
+/// The arena also hands out the IDs of the nodes, which are unique among all
+/// the RegionCFGs sharing it. All the RegionCFGs built while restructuring a
+/// function share the arena of the root one, so per-node data can be stored in
+/// vectors and bitvectors indexed by ID (see `NodeIDMap`).
+///
+/// Regions restructured concurrently (see `-restructure-region-jobs`) each
+/// allocate from a fork of the arena. A fork hands out IDs interleaved with the
+/// ones of its siblings, so the ID and the allocation order of each node depend
+/// only on the region that created it, and not on the scheduling.
+template<class NodeT>
+class BasicBlockNodeArena {
+public:
+  using ForkVector = std::vector<std::shared_ptr<BasicBlockNodeArena>>;
+
+private:
+  llvm::SpecificBumpPtrAllocator<BasicBlockNode<NodeT>> Allocator;
+  unsigned IDCounter = 0;
+  unsigned IDStride = 1;
+
+  /// Forks joined back into this arena, kept alive for their nodes
+  ForkVector Joined;
+
+public:
+  BasicBlockNodeArena() = default;
+  BasicBlockNodeArena(unsigned FirstID, unsigned IDStride) :
+    IDCounter(FirstID), IDStride(IDStride) {}
+  BasicBlockNodeArena(const BasicBlockNodeArena &) = delete;
+  BasicBlockNodeArena &operator=(const BasicBlockNodeArena &) = delete;
+
+  unsigned getNewID() {
+    unsigned Result = IDCounter;
+    IDCounter += IDStride;
+    return Result;
+  }
+
+  /// All the IDs handed out so far are lower than this
+  unsigned getIDBound() const { return IDCounter; }
+
+  template<typename... ArgTypes>
+  BasicBlockNode<NodeT> *create(ArgTypes &&...Args) {
+    void *Memory = Allocator.Allocate();
+    return new (Memory) BasicBlockNode<NodeT>(std::forward<ArgTypes>(Args)...);
+  }
+
+  /// Create \a Count arenas that can be used concurrently, the I-th one
+  /// handing out the IDs `getIDBound() + I + N * Count`
+  ForkVector fork(unsigned Count) {
+    revng_assert(IDStride == 1);
+    ForkVector Result;
+    for (unsigned I = 0; I < Count; ++I)
+      Result.push_back(std::make_shared<BasicBlockNodeArena>(IDCounter + I,
+                                                             Count));
+    return Result;
+  }
+
+  /// Take over the nodes of the arenas returned by `fork`, and skip all the
+  /// IDs they handed out
+  void join(ForkVector &&Forks) {
+    for (std::shared_ptr<BasicBlockNodeArena> &Fork : Forks) {
+      IDCounter = std::max(IDCounter, Fork->getIDBound());
+      Joined.push_back(std::move(Fork));
+    }
+  }
+};
+
+/// Associates values to BasicBlockNodes, storing them in a vector indexed by
+/// node ID
+///
+/// All the nodes used as keys must come from the same BasicBlockNodeArena.
+template<class NodeT, typename ValueT>
+class NodeIDMap {
+private:
+  std::vector<std::optional<ValueT>> Values;
+
+public:
+  NodeIDMap() = default;
+  explicit NodeIDMap(unsigned IDBound) { Values.reserve(IDBound); }
+
+  bool contains(const BasicBlockNode<NodeT> *Node) const {
+    unsigned ID = Node->getID();
+    return ID < Values.size() and Values[ID].has_value();
+  }
+
+  /// Return the value associated to \a Node, default-constructing it if absent
+  ValueT &operator[](const BasicBlockNode<NodeT> *Node) {
+    unsigned ID = Node->getID();
+    if (ID >= Values.size())
+      Values.resize(ID + 1);
+    if (not Values[ID].has_value())
+      Values[ID].emplace();
+    return *Values[ID];
+  }
+
+  const ValueT &at(const BasicBlockNode<NodeT> *Node) const {
+    revng_assert(contains(Node));
+    return *Values[Node->getID()];
+  }
+};
+
 /// The RegionCFG, a container for BasicBlockNodes
 template<class NodeT = llvm::BasicBlock *>
 class RegionCFG {
 
   using BBNodeT = BasicBlockNode<NodeT>;
-  using BBNodeTUniquePtr = typename std::unique_ptr<BBNodeT>;
-  using getPointerT = BBNodeT *(*) (BBNodeTUniquePtr &);
-  using getConstPointerT = const BBNodeT *(*) (const BBNodeTUniquePtr &);
+  using getPointerT = BBNodeT *(*) (BBNodeT *const &);
+  using getConstPointerT = const BBNodeT *(*) (BBNodeT *const &);
 
-  static BBNodeT *getPointer(BBNodeTUniquePtr &Original) {
-    return Original.get();
-  }
+  static BBNodeT *getPointer(BBNodeT *const &Original) { return Original; }
 
   static_assert(std::is_same_v<decltype(&getPointer), getPointerT>);
 
-  static const BBNodeT *getConstPointer(const BBNodeTUniquePtr &Original) {
-    return Original.get();
+  static const BBNodeT *getConstPointer(BBNodeT *const &Original) {
+    return Original;
   }
 
   static_assert(std::is_same_v<decltype(&getConstPointer), getConstPointerT>);
@@ -68,13 +178,14 @@ public:
   using BasicBlockNodeType = typename BasicBlockNodeT::Type;
   using BasicBlockNodeTSet = std::set<BasicBlockNodeT *>;
   using BasicBlockNodeTVect = std::vector<BasicBlockNodeT *>;
-  using BasicBlockNodeTUPVect = std::vector<std::unique_ptr<BasicBlockNodeT>>;
   using BBNodeMap = typename BBNodeT::BBNodeMap;
   using RegionCFGT = typename BBNodeT::RegionCFGT;
 
   using EdgeDescriptor = typename BBNodeT::EdgeDescriptor;
 
-  using links_container = std::vector<BBNodeTUniquePtr>;
+  using ArenaT = BasicBlockNodeArena<NodeT>;
+
+  using links_container = std::vector<BBNodeT *>;
   using internal_iterator = typename links_container::iterator;
   using internal_const_iterator = typename links_container::const_iterator;
   using links_iterator = llvm::mapped_iterator<internal_iterator, getPointerT>;
@@ -100,36 +211,13 @@ private:
   /// Storage for basic block nodes, associated to their original counterpart
   links_container BlockNodes;
 
-  /// Quarantine for dead nodes.
-  //  When nodes are removed from RegionCFG, they are not really freed, but they
-  //  are held here until the RegionCFG itself goes out of scope.
-  //  This is unfortunately necessary now, since the CFG restructuring algorithm
-  //  uses maps and sets (e.g. Backedges.) that are indexed using a
-  //  BasicBlockNodeT *.
-  //  If we don't hold the removed nodes in quarantine, the system allocator can
-  //  reuse the blocks, allocating new nodes at the same address, and causing
-  //  false-positive hits in some of the mentioned maps. This was the most
-  //  straightforward solution for now.
-  //
-  //  Other solutions we have considered:
-  //    - use a special monotonic allocator for BasicBlockNodes
-  //      - this should work, but in principle it gives the same results as the
-  //        current solution, with more boilerplate. Also, at the moment
-  //        std::unique_ptr is not allocator aware, so we would need to change
-  //        BlockNodes to not use them, and this would require even more
-  //        boilerplate.
-  //    - change the API for RegionCFG::removeNode, to take as arguments the
-  //      reference to the data structure and maps that must be updated, so that
-  //      when we remove the node from RegionCFG we also clear it from the maps.
-  //      However, this is very invasive, it requires changing the public facing
-  //      API, it requirese coupling the RegionCFG API with internal details,
-  //      and in the future it would need to be updated for every new map that
-  //      must be updated on removal of a node.
-  links_container DeadNodesQuarantine;
+  /// The arena where the nodes are allocated, possibly shared with other
+  /// RegionCFGs. Nodes removed from BlockNodes stay alive until the arena
+  /// itself goes out of scope.
+  std::shared_ptr<ArenaT> Arena;
 
   /// Pointer to the entry basic block of this function
   BasicBlockNodeT *EntryNode = nullptr;
-  unsigned IDCounter = 0;
   std::string FunctionName;
   std::string RegionName;
   bool ToInflate = true;
@@ -138,6 +226,12 @@ private:
   FPostDomTree IFPDT;
 
 private:
+  template<typename... ArgTypes>
+  BBNodeT *createNode(ArgTypes &&...Args) {
+    BBNodeT *New = Arena->create(std::forward<ArgTypes>(Args)...);
+    return BlockNodes.emplace_back(New);
+  }
+
   template<typename GraphNodeT>
   void addSuccessorEdges(GraphNodeT N,
                          const std::map<GraphNodeT, BBNodeT *> &NodeMap) {
@@ -192,10 +286,14 @@ private:
   }
 
 public:
-  RegionCFG() = default;
-  RegionCFG(const RegionCFG &) = default;
+  RegionCFG() : Arena(std::make_shared<ArenaT>()) {}
+
+  /// Build an empty RegionCFG allocating its nodes in \a Arena
+  explicit RegionCFG(std::shared_ptr<ArenaT> Arena) : Arena(std::move(Arena)) {}
+
+  RegionCFG(const RegionCFG &) = delete;
   RegionCFG(RegionCFG &&) = default;
-  RegionCFG &operator=(const RegionCFG &) = default;
+  RegionCFG &operator=(const RegionCFG &) = delete;
   RegionCFG &operator=(RegionCFG &&) = default;
 
   template<class GraphT>
@@ -224,7 +322,14 @@ public:
     EntryNode = NodeToBBNodeMap.at(GT::getEntryNode(Graph));
   }
 
-  unsigned getNewID() { return IDCounter++; }
+  unsigned getNewID() { return Arena->getNewID(); }
+
+  const std::shared_ptr<ArenaT> &getArena() const { return Arena; }
+
+  /// Allocate the nodes created from now on in \a NewArena
+  void setArena(std::shared_ptr<ArenaT> NewArena) {
+    Arena = std::move(NewArena);
+  }
 
   links_range nodes() { return llvm::make_range(begin(), end()); }
 
@@ -261,8 +366,7 @@ public:
   BBNodeT *addNode(NodeT Node) { return addNode(Node, Node->getName()); }
 
   BBNodeT *createCollapsedNode(RegionCFG *Collapsed) {
-    BlockNodes.emplace_back(std::make_unique<BasicBlockNodeT>(this, Collapsed));
-    return BlockNodes.back().get();
+    return createNode(this, Collapsed);
   }
 
   BBNodeT *addArtificialNode(llvm::StringRef Name = "dummy",
@@ -270,8 +374,7 @@ public:
     revng_assert(T == BasicBlockNodeType::Empty
                  or T == BasicBlockNodeType::Break
                  or T == BasicBlockNodeType::Continue);
-    BlockNodes.emplace_back(std::make_unique<BasicBlockNodeT>(this, Name, T));
-    return BlockNodes.back().get();
+    return createNode(this, Name, T);
   }
 
   BBNodeT *addContinue() {
@@ -283,9 +386,7 @@ public:
   }
 
   BBNodeT *addDispatcher(llvm::StringRef Name, BasicBlockNodeT::Type T) {
-    using BBNodeT = BasicBlockNodeT;
-    auto D = std::make_unique<BBNodeT>(this, Name, T);
-    return BlockNodes.emplace_back(std::move(D)).get();
+    return createNode(this, Name, T);
   }
 
   BBNodeT *addEntryDispatcher() {
@@ -301,13 +402,10 @@ public:
   BBNodeT *addSetStateNode(unsigned StateVariableValue,
                            llvm::StringRef TargetName,
                            BasicBlockNodeT::Type T) {
-    using BBNodeT = BasicBlockNodeT;
     std::string IdStr = std::to_string(StateVariableValue);
     std::string Name = "set idx " + IdStr + " (desired target) "
                        + TargetName.str();
-    auto Tmp = std::make_unique<BBNodeT>(this, Name, T, StateVariableValue);
-    BlockNodes.emplace_back(std::move(Tmp));
-    return BlockNodes.back().get();
+    return createNode(this, llvm::StringRef(Name), T, StateVariableValue);
   }
 
   BBNodeT *addEntrySetStateNode(unsigned StateVariableValue,
@@ -324,9 +422,7 @@ public:
 
   BBNodeT *addTile() {
     using Type = typename BasicBlockNodeT::Type;
-    auto Tmp = std::make_unique<BBNodeT>(this, "tile", Type::Tile);
-    BlockNodes.emplace_back(std::move(Tmp));
-    return BlockNodes.back().get();
+    return createNode(this, llvm::StringRef("tile"), Type::Tile);
   }
 
   BBNodeT *cloneNode(BasicBlockNodeT &OriginalNode);
@@ -341,9 +437,11 @@ public:
 
   BBNodeT &getEntryNode() const { return *EntryNode; }
 
+  void setEntryNode(BBNodeT *Node) { EntryNode = Node; }
+
   BBNodeT &front() const { return *EntryNode; }
 
-  std::vector<BBNodeTUniquePtr> &getNodes() { return BlockNodes; }
+  const links_container &getNodes() const { return BlockNodes; }
 
 public:
   /// Dump a GraphViz representing this function on any stream
@@ -369,11 +467,19 @@ public:
 
   void purgeVirtualSink(BBNodeT *Sink);
 
-  BBNodeT *cloneUntilExit(BBNodeT *Node, BBNodeT *Sink);
+  /// Clone the nodes from \a Node to \a Sink, excluded, adding the clones to
+  /// \a Clones
+  BBNodeT *
+  cloneUntilExit(BBNodeT *Node, BBNodeT *Sink, BasicBlockNodeTSet &Clones);
 
   /// Apply the untangle preprocessing pass.
   void untangle();
 
+  /// Check `DT` and `IFPDT`, updated incrementally by `untangle`, against a
+  /// computation from scratch. \a Clones, which `IFPDT` is never told about,
+  /// are skipped: any other node missing from `IFPDT` is an error.
+  bool verifyUntangleDomTrees(const BasicBlockNodeTSet &Clones);
+
   /// Apply comb to the region.
   void inflate();
 
@@ -444,7 +550,21 @@ struct GraphTraits<Inverse<RegionCFG<NodeT> *>>
 
 } // namespace llvm
 
-extern unsigned DuplicationCounter;
+/// Number of nodes cloned by `RegionCFG::inflate`.
+extern thread_local unsigned DuplicationCounter;
+
+/// Number of nodes cloned by `RegionCFG::untangle`.
+extern thread_local unsigned UntangleDuplicationCounter;
+
+extern thread_local unsigned UntangleTentativeCounter;
+extern thread_local unsigned UntanglePerformedCounter;
 
-extern unsigned UntangleTentativeCounter;
-extern unsigned UntanglePerformedCounter;
+/// Maximum number of nodes that can be cloned by `RegionCFG::inflate` and
+/// `RegionCFG::untangle`, 0 means no limit. Once it's exceeded, they stop
+/// cloning and `generateAst` gives up, leaving an incomplete AST.
+extern thread_local unsigned DuplicationLimit;
+
+inline bool isDuplicationLimitExceeded() {
+  unsigned Duplications = DuplicationCounter + UntangleDuplicationCounter;
+  return DuplicationLimit != 0 and Duplications > DuplicationLimit;
+}
@@ -25,6 +25,7 @@
 
 #include "revng/ADT/ReversePostOrderTraversal.h"
 #include "revng/MFP/MFP.h"
+#include "revng/Support/Debug.h"
 #include "revng/Support/GraphAlgorithms.h"
 #include "revng/Support/IRHelpers.h"
 
@@ -91,9 +92,7 @@ inline std::string RegionCFG<NodeT>::getRegionName() const {
 template<class NodeT>
 inline BasicBlockNode<NodeT> *
 RegionCFG<NodeT>::addNode(NodeT Node, llvm::StringRef Name) {
-  using BBNodeT = BasicBlockNodeT;
-  BlockNodes.emplace_back(std::make_unique<BBNodeT>(this, Node, Name));
-  BasicBlockNodeT *Result = BlockNodes.back().get();
+  BasicBlockNodeT *Result = createNode(this, Node, Name);
   revng_log(CombLogger,
             "Building " << Name << " at address: " << Result << "\n");
   return Result;
@@ -102,9 +101,7 @@ RegionCFG<NodeT>::addNode(NodeT Node, llvm::StringRef Name) {
 template<class NodeT>
 inline BasicBlockNode<NodeT> *
 RegionCFG<NodeT>::cloneNode(BasicBlockNodeT &OriginalNode) {
-  using BBNodeT = BasicBlockNodeT;
-  BlockNodes.emplace_back(std::make_unique<BBNodeT>(OriginalNode, this));
-  BasicBlockNodeT *New = BlockNodes.back().get();
+  BasicBlockNodeT *New = createNode(OriginalNode, this);
   New->setName(OriginalNode.getName().str() + " cloned");
   New->setWeaved(OriginalNode.isWeaved());
   return New;
@@ -121,13 +118,10 @@ inline void RegionCFG<NodeT>::removeNode(BasicBlockNodeT *Node) {
   for (BasicBlockNodeT *Successor : Node->successors())
     Successor->removePredecessor(Node);
 
-  for (auto It = BlockNodes.begin(); It != BlockNodes.end(); It++) {
-    if ((*It).get() == Node) {
-      DeadNodesQuarantine.push_back(std::move(*It));
-      BlockNodes.erase(It);
-      break;
-    }
-  }
+  // The node itself is not freed: its memory belongs to the arena.
+  auto It = llvm::find(BlockNodes, Node);
+  if (It != BlockNodes.end())
+    BlockNodes.erase(It);
 }
 
 template<class NodeT>
@@ -151,8 +145,7 @@ inline void RegionCFG<NodeT>::insertBulkNodes(BasicBlockNodeTSet &Nodes,
   revng_assert(BlockNodes.empty());
 
   for (BasicBlockNodeT *Node : Nodes) {
-    BlockNodes.emplace_back(std::make_unique<BasicBlockNodeT>(*Node, this));
-    BasicBlockNodeT *New = BlockNodes.back().get();
+    BasicBlockNodeT *New = createNode(*Node, this);
     SubMap[Node] = New;
 
     // The copy constructor used above does not bring along the successors and
@@ -203,7 +196,7 @@ inline void RegionCFG<NodeT>::insertBulkNodes(BasicBlockNodeTSet &Nodes,
   EntryNode = SubMap[Head];
   revng_assert(EntryNode != nullptr);
   // Fix the hack above
-  for (BBNodeTUniquePtr &Node : BlockNodes)
+  for (BasicBlockNodeT *Node : BlockNodes)
     Node->updatePointers(SubMap);
 
   // Connect all the `ContinueBackedges` to `continue` nodes
@@ -246,8 +239,8 @@ template<typename StreamT>
 inline void RegionCFG<NodeT>::dumpDot(StreamT &S) const {
   S << "digraph CFGFunction {\n";
 
-  for (const std::unique_ptr<BasicBlockNode<NodeT>> &BB : BlockNodes) {
-    streamNode(S, BB.get());
+  for (const BasicBlockNode<NodeT> *BB : BlockNodes) {
+    streamNode(S, BB);
     unsigned Counter = 0;
     for (const auto &[Successor, EdgeInfo] : BB->labeled_successors()) {
       unsigned PredID = BB->getID();
@@ -371,11 +364,14 @@ inline bool isGreater(unsigned Op1, unsigned Op2) {
 template<class NodeT>
 inline BasicBlockNode<NodeT> *
 RegionCFG<NodeT>::cloneUntilExit(BasicBlockNode<NodeT> *Node,
-                                 BasicBlockNode<NodeT> *Sink) {
+                                 BasicBlockNode<NodeT> *Sink,
+                                 BasicBlockNodeTSet &Clones) {
 
   // Clone the postdominator node.
   BBNodeMap CloneMap;
   BasicBlockNode<NodeT> *Clone = cloneNode(*Node);
+  UntangleDuplicationCounter++;
+  Clones.insert(Clone);
 
   // Insert the postdominator clone in the map.
   CloneMap[Node] = Clone;
@@ -413,6 +409,8 @@ RegionCFG<NodeT>::cloneUntilExit(BasicBlockNode<NodeT> *Node,
         } else {
           // The clone of the successor does not exist, create it in place.
           SuccessorClone = cloneNode(*Succ);
+          UntangleDuplicationCounter++;
+          Clones.insert(SuccessorClone);
           CloneMap[Succ] = SuccessorClone;
         }
 
@@ -478,15 +476,24 @@ inline void RegionCFG<NodeT>::untangle() {
     }
   }
 
+  // The dominator and postdominator trees are computed only once, and then
+  // updated incrementally after each untangle. Recomputing them from scratch
+  // for each conditional node made untangle quadratic on large regions.
+  DT.recalculate(Graph);
+  IFPDT.recalculate(Graph);
+
+  // The nodes created by `cloneUntilExit`, which `IFPDT` does not know about
+  BasicBlockNodeTSet Clones;
+
   while (not ConditionalNodes.empty()) {
 
+    // Stop cloning, the region is going to be discarded anyway.
+    if (isDuplicationLimitExceeded())
+      break;
+
     BasicBlockNode<NodeT> *Conditional = ConditionalNodes.back();
     ConditionalNodes.pop_back();
 
-    // Update the information of the dominator and postdominator trees.
-    DT.recalculate(Graph);
-    IFPDT.recalculate(Graph);
-
     // Update the postdominator
     BasicBlockNodeT *PostDominator = IFPDT[Conditional]->getIDom()->getBlock();
 
@@ -633,32 +640,67 @@ inline void RegionCFG<NodeT>::untangle() {
       // Perform the split from the first node of the then/else branches.
       // We fully inline all the nodes belonging to the branch we are untangling
       // till the exit node.
-      BasicBlockNode<NodeT> *UntangledChild = cloneUntilExit(ToUntangle, Sink);
+      BasicBlockNode<NodeT> *UntangledChild = cloneUntilExit(ToUntangle,
+                                                             Sink,
+                                                             Clones);
+
+      // We mark the edge going into the `UntangleChild` as an inlined edge.
+      // In this way, in all the next phases, these edges will be ignored by the
+      // dominator and postdominator trees.
+      // The edge is marked before being moved, so that `IFPDT` sees a single
+      // edge deletion. It never sees the clones, which are only reachable
+      // through inlined edges, and are never queried in here.
+      const auto &ToUntangleEdge = Conditional->getSuccessorEdge(ToUntangle);
+      bool WasInlined = ToUntangleEdge.second.Inlined;
+      markEdgeInlined(EdgeDescriptor(Conditional, ToUntangle));
+      if (not WasInlined)
+        IFPDT.deleteEdge(Conditional, ToUntangle);
 
       // Move the edge coming out of the conditional node to the new clone of
       // the node.
       moveEdgeTarget(EdgeDescriptor(Conditional, ToUntangle), UntangledChild);
 
-      // We mark the edge going into the `UntangleChild` as an inlined edge.
-      // In this way, in all the next phases, these edges will be ignored by the
-      // dominator and postdominator trees.
-      markEdgeInlined(EdgeDescriptor(Conditional, UntangledChild));
+      // Update the dominator tree.
+      using DomUpdate = typename llvm::DominatorTreeBase<BasicBlockNodeT,
+                                                         false>::UpdateType;
+      const auto Insert = llvm::DominatorTree::Insert;
+      const auto Delete = llvm::DominatorTree::Delete;
+      std::vector<DomUpdate> Updates;
+      Updates.push_back({ Delete, Conditional, ToUntangle });
+      Updates.push_back({ Insert, Conditional, UntangledChild });
+      DT.applyUpdates(Updates);
 
       // Remove nodes that have no predecessors (nodes that are the result of
       // node cloning and that remains dandling around).
-      // While doing this, update InlineEdges.
-      bool Removed = true;
-      while (Removed) {
-        Removed = false;
-        BasicBlockNode<NodeT> *Entry = &getEntryNode();
-        for (auto It = begin(); It != end(); ++It) {
-          if ((Entry != *It and (*It)->predecessor_size() == 0)) {
-            removeNode(*It);
-            Removed = true;
-            break;
-          }
+      // These are unreachable, hence already gone from `DT`, but `IFPDT` has
+      // to be told about each of their outgoing edges.
+      BasicBlockNodeTVect Dangling;
+      if (ToUntangle->predecessor_size() == 0)
+        Dangling.push_back(ToUntangle);
+
+      while (not Dangling.empty()) {
+        BasicBlockNodeT *Node = Dangling.back();
+        Dangling.pop_back();
+        revng_assert(Node != &getEntryNode());
+        revng_assert(DT.getNode(Node) == nullptr);
+
+        while (Node->successor_size() != 0) {
+          BasicBlockNodeT *Succ = Node->getSuccessorI(0);
+          auto Edge = extractLabeledEdge(EdgeDescriptor(Node, Succ));
+          if (not Edge.second.Inlined)
+            IFPDT.deleteEdge(Node, Succ);
+
+          if (Succ->predecessor_size() == 0)
+            Dangling.push_back(Succ);
         }
+
+        removeNode(Node);
+        if (IFPDT.getNode(Node) != nullptr)
+          IFPDT.eraseNode(Node);
       }
+
+      if (VerifyLog.isEnabled())
+        revng_assert(verifyUntangleDomTrees(Clones));
     }
   }
 
@@ -679,6 +721,40 @@ inline void RegionCFG<NodeT>::untangle() {
   }
 }
 
+template<class NodeT>
+inline bool
+RegionCFG<NodeT>::verifyUntangleDomTrees(const BasicBlockNodeTSet &Clones) {
+  RegionCFG<NodeT> &Graph = *this;
+
+  if (not DT.verify())
+    return false;
+
+  FPostDomTree FreshIFPDT;
+  FreshIFPDT.recalculate(Graph);
+  for (BasicBlockNodeT *Node : Graph.nodes()) {
+    auto *TreeNode = IFPDT.getNode(Node);
+    if (TreeNode == nullptr) {
+      if (Clones.contains(Node))
+        continue;
+      return false;
+    }
+
+    auto *FreshTreeNode = FreshIFPDT.getNode(Node);
+    if (FreshTreeNode == nullptr)
+      return false;
+
+    auto *IDom = TreeNode->getIDom();
+    auto *FreshIDom = FreshTreeNode->getIDom();
+    if ((IDom == nullptr) != (FreshIDom == nullptr))
+      return false;
+
+    if (IDom != nullptr and IDom->getBlock() != FreshIDom->getBlock())
+      return false;
+  }
+
+  return true;
+}
+
 template<class NodeT>
 struct ReachableExitsAnalysis
   : public SetUnionLattice<std::set<BasicBlockNode<NodeT> *>> {
@@ -896,6 +972,10 @@ inline void RegionCFG<NodeT>::inflate() {
   // into ConditionalNodes in RPOT, this iteration is in post-order.
   while (not ConditionalNodes.empty()) {
 
+    // Stop cloning, the region is going to be discarded anyway.
+    if (isDuplicationLimitExceeded())
+      return;
+
     // Process each conditional node after ordering it.
     BasicBlockNode<NodeT> *Conditional = ConditionalNodes.back();
     ConditionalNodes.pop_back();
@@ -1035,6 +1115,9 @@ inline void RegionCFG<NodeT>::inflate() {
 
       } else {
 
+        if (isDuplicationLimitExceeded())
+          return;
+
         // Duplicate node.
         DuplicationCounter++;
         revng_log(CombLogger, "Duplicating node " << Candidate->getNameStr());
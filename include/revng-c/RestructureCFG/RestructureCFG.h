@@ -23,3 +23,7 @@ public:
 };
 
 bool restructureCFG(llvm::Function &F, ASTTree &AST);
+
+/// Loggers are not thread-safe: callers restructuring several functions
+/// concurrently must use a single thread if this returns true.
+bool isRestructureLoggingEnabled();
@@ -0,0 +1,35 @@
+#pragma once
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <map>
+
+#include "revng/ABI/FunctionType/Layout.h"
+#include "revng/Model/Binary.h"
+
+/// Cache of the `abi::FunctionType::Layout` of the prototypes of a model.
+///
+/// Prototypes are shared by many functions and call sites, and computing their
+/// layout is not cheap. Layouts are indexed by the key of the prototype, so the
+/// cache must be dropped through `clear` whenever a prototype changes. The
+/// typical usage is one instance per run of a pass that doesn't change the
+/// prototypes (or per worker, if the pass runs on multiple threads).
+class FunctionLayoutCache {
+private:
+  std::map<model::TypeDefinition::Key, abi::FunctionType::Layout> Layouts;
+
+public:
+  const abi::FunctionType::Layout &get(const model::TypeDefinition &Prototype) {
+    auto It = Layouts.find(Prototype.key());
+    if (It == Layouts.end()) {
+      using abi::FunctionType::Layout;
+      It = Layouts.emplace(Prototype.key(), Layout::make(Prototype)).first;
+    }
+
+    return It->second;
+  }
+
+  void clear() { Layouts.clear(); }
+};
@@ -5,6 +5,7 @@
 //
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Type.h"
 
 #include "revng/ABI/FunctionType/Layout.h"
@@ -37,6 +38,30 @@ extern model::UpcastableType llvmIntToModelType(const llvm::Type *LLVMType,
 extern model::UpcastableType fromLLVMString(llvm::Value *V,
                                             const model::Binary &Model);
 
+/// Cache of the model types deserialized from LLVM constant strings, already
+/// rooted in a model.
+///
+/// The same few strings are referenced by a lot of calls (e.g., to `ModelGEP`
+/// or `ModelCast`), and deserializing them is expensive. Each string goes
+/// through `fromLLVMString` only once: afterwards, the same type is returned.
+///
+/// The model must outlive the cache and must not change in the meantime, so a
+/// cache is meant to live as long as a pass (or pipe) run. It's not
+/// thread-safe.
+class ModelTypeCache {
+private:
+  const model::Binary &Model;
+  llvm::StringMap<model::UpcastableType> Types;
+
+public:
+  explicit ModelTypeCache(const model::Binary &Model) : Model(Model) {}
+
+  const model::Binary &getModel() const { return Model; }
+
+  /// Like `fromLLVMString`, but \a V is deserialized only the first time
+  const model::UpcastableType &get(llvm::Value *V);
+};
+
 /// Create a global string in the given LLVM module that contains a
 /// serialization of \a Type.
 llvm::Constant *toLLVMString(const model::UpcastableType &Type,
@@ -56,7 +81,7 @@ inline llvm::IntegerType *getPointerSizedInteger(llvm::LLVMContext &C,
 /// \return nothing if no information could be deduced locally on Inst
 /// \return one or more types associated to the instruction
 extern RecursiveCoroutine<llvm::SmallVector<model::UpcastableType, 8>>
-getStrongModelInfo(const llvm::Instruction *Inst, const model::Binary &Model);
+getStrongModelInfo(const llvm::Instruction *Inst, ModelTypeCache &TypeCache);
 
 /// If possible, deduce the expected model type of an operand (e.g. the base
 /// operand of a ModelGEP) by looking only at the User. Note that, in the case
@@ -65,7 +90,7 @@ getStrongModelInfo(const llvm::Instruction *Inst, const model::Binary &Model);
 /// \return nothing if no information could be deduced locally on U
 /// \return one or more types associated to the use
 extern llvm::SmallVector<model::UpcastableType>
-getExpectedModelType(const llvm::Use *U, const model::Binary &Model);
+getExpectedModelType(const llvm::Use *U, ModelTypeCache &TypeCache);
 
 extern llvm::SmallVector<model::UpcastableType>
 flattenReturnTypes(const abi::FunctionType::Layout &Layout,
@@ -0,0 +1,52 @@
+#pragma once
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <cstddef>
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace revng::options {
+
+// 1 by default, i.e., everything runs on the calling thread.
+extern llvm::cl::opt<unsigned> DecompilerJobs;
+
+} // namespace revng::options
+
+/// Return the number of workers that `parallelFor` will use to process
+/// \a Size work items. It's always at least 1 and never more than \a Size.
+///
+/// Callers that need per-worker state (e.g. a `ptml::CTypeBuilder` or a
+/// `ControlFlowGraphCache`) should allocate this many instances of it and
+/// pick one through the `Worker` argument of the body.
+unsigned getWorkerCount(size_t Size);
+
+/// Return how many functions to process in each batch, when \a Size functions
+/// are processed in batches spread across all the workers, keeping only the
+/// results of one batch in memory at a time.
+size_t getFunctionBatchSize(size_t Size);
+
+/// Invoke \a Body on every index in `[0, Size)`, using up to
+/// `-decompiler-jobs` threads.
+///
+/// \a Body receives the index of the worker running it (in
+/// `[0, getWorkerCount(Size))`) and the index of the work item. No two
+/// invocations with the same `Worker` run concurrently.
+///
+/// The order in which work items are processed is unspecified: callers that
+/// need deterministic results should write the result of item `I` into the
+/// `I`-th slot of a preallocated container, and merge them afterwards.
+///
+/// \note When a single worker is used, items are processed in order on the
+///       calling thread.
+void parallelFor(size_t Size,
+                 llvm::function_ref<void(unsigned Worker, size_t Index)> Body);
+
+/// Like `parallelFor`, but using up to \a Jobs threads instead of
+/// `-decompiler-jobs`. As for that option, 0 means one per available core.
+void parallelFor(unsigned Jobs,
+                 size_t Size,
+                 llvm::function_ref<void(unsigned Worker, size_t Index)> Body);
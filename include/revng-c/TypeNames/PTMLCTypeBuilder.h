@@ -61,18 +61,23 @@ private:
 
   /// This is the cache containing the dependency data for the types.
   /// It is here so that we don't have to recompute it with multiple invocations
-  std::optional<DependencyGraph> DependencyCache = std::nullopt;
+  /// It's never modified once built, so it's shared between builders.
+  std::shared_ptr<const DependencyGraph> DependencyCache = nullptr;
 
-  /// This is the cache containing the keys of the types that should be inlined
-  /// into their only user.
-  std::set<model::TypeDefinition::Key> TypesToInlineCache = {};
+  struct InlinableTypes {
+    /// The keys of the types that should be inlined into their only user.
+    std::set<model::TypeDefinition::Key> TypesToInline = {};
 
-  /// This is the cache containing the keys of the stack frame types that
-  /// should be inlined into the functions they belong to.
-  std::set<model::TypeDefinition::Key> StackFrameTypeCache = {};
+    /// The keys of the stack frame types that should be inlined into the
+    /// functions they belong to.
+    std::set<model::TypeDefinition::Key> StackFrameTypes = {};
+  };
 
-  /// Is only set to true if \ref collectInlinableTypes was invoked.
-  bool InlinableCacheIsReady = false;
+  /// This is the cache containing the results of \ref collectInlinableTypes.
+  /// It's immutable once computed, so builders created from one another
+  /// share it instead of copying it.
+  /// Is only set if \ref collectInlinableTypes was invoked.
+  std::shared_ptr<const InlinableTypes> InlinableCache = nullptr;
 
 public:
   /// Gather (and store internally) the list of types that can (and should)
@@ -81,16 +86,16 @@ public:
   void collectInlinableTypes(const model::Binary &Model);
 
   bool shouldInline(model::TypeDefinition::Key Key) const {
-    revng_assert(InlinableCacheIsReady,
+    revng_assert(InlinableCache != nullptr,
                  "`shouldInline` must not be called before "
                  "`collectInlinableTypes`.");
 
-    if (not TypesToInlineCache.contains(Key)) {
+    if (not InlinableCache->TypesToInline.contains(Key)) {
       // This type is not allowed be inlined.
       return false;
     }
 
-    if (StackFrameTypeCache.contains(Key)) {
+    if (InlinableCache->StackFrameTypes.contains(Key)) {
       // This is a stack frame.
       return Configuration.EnableStackFrameInlining;
 
@@ -134,6 +139,23 @@ public:
   CTypeBuilder(llvm::raw_ostream &OutputStream) :
     CTypeBuilder(OutputStream, {}, {}) {}
 
+  /// Build a new builder printing to \a OutputStream, with the same
+  /// configuration as \a Other, and sharing its set of inlinable types and
+  /// its dependency graph.
+  ///
+  /// \note The caches that are filled while printing (like the artificial
+  ///       type names) are not shared, which makes this suitable for creating
+  ///       one builder per thread (or one per printed type) out of a single
+  ///       `collectInlinableTypes`.
+  CTypeBuilder(llvm::raw_ostream &OutputStream, const CTypeBuilder &Other) :
+    CBuilder(Other),
+    Out(std::make_unique<OutStream>(OutputStream,
+                                    *this,
+                                    DecompiledCCodeIndentation)),
+    Configuration(Other.Configuration),
+    DependencyCache(Other.DependencyCache),
+    InlinableCache(Other.InlinableCache) {}
+
 public:
   void setOutputStream(llvm::raw_ostream &OutputStream) {
     Out = std::make_unique<OutStream>(OutputStream,
@@ -4,7 +4,11 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <memory>
+
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 #include "mlir/IR/BuiltinOps.h"
 #include "mlir/IR/FunctionInterfaces.h"
@@ -16,6 +20,12 @@
 
 namespace revng::pipes {
 
+/// Container of an MLIR module, whose targets are its functions
+///
+/// The const methods are not thread-safe: the MLIRContext is not, and they may
+/// load the bodies of the functions that have been lazily deserialized, see
+/// -mlir-container-lazy-deserialize. A container must not be used from
+/// different threads at the same time.
 class MLIRContainer : public pipeline::Container<MLIRContainer> {
 public:
   static const char ID;
@@ -23,18 +33,36 @@ public:
   static constexpr auto MIMEType = "application/x.mlir.bc";
 
 private:
-  // unique_ptr is used to allow moving the context.
-  std::unique_ptr<mlir::MLIRContext> Context;
+  // shared_ptr is used to allow moving the context, and sharing it among the
+  // containers produced by cloneFiltered, see -mlir-container-shared-context.
+  std::shared_ptr<mlir::MLIRContext> Context;
   mlir::OwningOpRef<mlir::ModuleOp> Module;
 
+  // The reader of the bytecode Module has been deserialized from, as long as
+  // the body of some of its functions has not been loaded yet, see
+  // -mlir-container-lazy-deserialize. It's declared after Module, so that it's
+  // destroyed before it.
+  struct LazyReader;
+  std::unique_ptr<LazyReader> Lazy;
+
 public:
   explicit MLIRContainer(const llvm::StringRef Name) :
     pipeline::Container<MLIRContainer>(Name) {
     clear();
   }
 
-  mlir::MLIRContext *getContext() { return Context.get(); }
-  mlir::ModuleOp getModule() { return *Module; }
+  ~MLIRContainer() override;
+
+  mlir::MLIRContext *getContext() {
+    loadAll();
+    return Context.get();
+  }
+
+  mlir::ModuleOp getModule() {
+    loadAll();
+    return *Module;
+  }
+
   void setModule(mlir::OwningOpRef<mlir::ModuleOp> &&NewModule);
 
   std::unique_ptr<pipeline::ContainerBase>
@@ -57,6 +85,17 @@ public:
   static std::vector<pipeline::Kind *> possibleKinds() {
     return { &kinds::MLIRFunctionKind };
   }
+
+private:
+  /// Whether \a F has no body, not even one still to be loaded
+  bool isExternal(mlir::FunctionOpInterface F) const;
+
+  /// Load the body of the functions in \a Targets that have not been loaded yet
+  llvm::Error load(const pipeline::TargetsList &Targets) const;
+
+  /// Load the body of all the functions and drop the bytecode reader, before
+  /// Module is modified or handed out
+  void loadAll();
 };
 
 } // namespace revng::pipes
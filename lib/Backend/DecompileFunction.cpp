@@ -2,8 +2,10 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <optional>
 #include <utility>
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
@@ -23,9 +25,11 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Progress.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -65,6 +69,7 @@
 #include "revng-c/Support/IRHelpers.h"
 #include "revng-c/Support/ModelHelpers.h"
 #include "revng-c/Support/PTMLC.h"
+#include "revng-c/Support/Parallel.h"
 #include "revng-c/TypeNames/LLVMTypeNames.h"
 #include "revng-c/TypeNames/PTMLCTypeBuilder.h"
 
@@ -93,8 +98,6 @@ namespace tokens = ptml::c::tokens;
 using tokenDefinition::types::StringToken;
 
 using TokenMapT = std::map<const llvm::Value *, std::string>;
-using ModelTypesMap = std::map<const llvm::Value *,
-                               const model::UpcastableType>;
 
 static constexpr const char *StackFrameVarName = "_stack";
 
@@ -233,6 +236,9 @@ struct CCodeGenerator {
 private:
   /// The model of the binary being analysed
   const Binary &Model;
+  /// The types deserialized from LLVM strings, shared by all the functions
+  /// decompiled in the same pipe run
+  ModelTypeCache &TypeCache;
   /// The LLVM function that is being decompiled
   const llvm::Function &LLVMFunction;
   /// The model function corresponding to LLVMFunction
@@ -287,11 +293,20 @@ private:
   VarNameGenerator NameGenerator;
 
   /// Keep track of the names associated with function arguments, and local
-  /// variables. In the past it also kept track of intermediate expressions, but
-  /// with the new design all the tokens corresponding to instructions that
-  /// don't represent local variables are recomputed every time.
+  /// variables.
   TokenMapT TokenMap;
 
+  /// Memoized tokens of all the other values (i.e. expressions), so that a
+  /// subexpression shared by many expressions is only built once.
+  /// Expressions embed the names in TokenMap, so this has to be invalidated
+  /// whenever one of them is rebound, see `setVarName`.
+  mutable llvm::DenseMap<const llvm::Value *, llvm::StringRef> ExpressionCache;
+
+  /// The arena holding the strings in ExpressionCache. Memoized tokens are
+  /// never freed one by one, so they are bump-allocated and released all at
+  /// once, when the cache is invalidated or the function has been emitted.
+  mutable llvm::BumpPtrAllocator ExpressionArena;
+
 private:
   /// Name of the local variable used to break out from loops
   std::string LoopStateVar;
@@ -303,12 +318,13 @@ private:
 
 public:
   CCodeGenerator(ControlFlowGraphCache &Cache,
-                 const Binary &Model,
+                 ModelTypeCache &TypeCache,
                  const llvm::Function &LLVMFunction,
                  const ASTTree &GHAST,
                  const ASTVarDeclMap &VarToDeclare,
                  ptml::CTypeBuilder &B) :
-    Model(Model),
+    Model(TypeCache.getModel()),
+    TypeCache(TypeCache),
     LLVMFunction(LLVMFunction),
     ModelFunction(*llvmToModelFunction(Model, LLVMFunction)),
     Prototype(*Model.prototypeOrDefault(ModelFunction.prototype())),
@@ -316,7 +332,7 @@ public:
     VariablesToDeclare(VarToDeclare),
     TypeMap(initModelTypes(LLVMFunction,
                            &ModelFunction,
-                           Model,
+                           TypeCache,
                            /* PointersOnly = */ false)),
     B(B),
     SwitchStateVars(),
@@ -363,6 +379,22 @@ private:
 private:
   RecursiveCoroutine<std::string> getToken(const llvm::Value *V) const;
 
+  /// Append the token of \a V to \a Out. Variable names and memoized
+  /// expressions are copied straight from where they are stored.
+  RecursiveCoroutine<void> appendToken(std::string &Out,
+                                       const llvm::Value *V) const;
+
+  /// Return the token of \a V if it's a variable name or a memoized
+  /// expression. The result points into TokenMap or ExpressionArena, so it
+  /// has to be consumed before any other token is built.
+  std::optional<llvm::StringRef> lookupToken(const llvm::Value *V) const;
+
+  /// Build the token of \a V, which must not have been looked up successfully
+  RecursiveCoroutine<std::string> buildToken(const llvm::Value *V) const;
+
+  /// Return the token of \a I, terminated as a statement
+  std::string getStatementToken(const llvm::Instruction *I) const;
+
   RecursiveCoroutine<std::string>
   getCallToken(const llvm::CallInst *Call,
                const llvm::StringRef FuncName,
@@ -400,12 +432,30 @@ private:
                             const model::Type &DestType) const;
 
 private:
+  void setVarName(const llvm::Value *V, std::string &&Name) {
+    auto [It, New] = TokenMap.try_emplace(V, std::move(Name));
+    if (New)
+      return;
+
+    // V is being rebound: all the memoized expressions might refer to its old
+    // name, so just drop them.
+    It->second = std::move(Name);
+    clearExpressionCache();
+  }
+
+  void clearExpressionCache() const {
+    ExpressionCache.clear();
+    ExpressionArena.Reset();
+  }
+
+  void cacheExpression(const llvm::Value *V, const std::string &Token) const;
+
   std::string createStackFrameVarDeclName(const llvm::Instruction *I) {
     revng_assert(isStackFrameDecl(I));
     revng_assert(not TokenMap.contains(I));
 
     std::string VarName = StackFrameVarName;
-    TokenMap[I] = B.getVariableLocationReference(VarName, ModelFunction);
+    setVarName(I, B.getVariableLocationReference(VarName, ModelFunction));
     return B.getVariableLocationDefinition(VarName, ModelFunction);
   }
 
@@ -415,7 +465,7 @@ private:
     std::string VarName = NameGenerator.nextVarName();
     // This may override the entry for I, if I belongs to a "duplicated"
     // BasicBlock that is reachable from many paths on the GHAST.
-    TokenMap[I] = B.getVariableLocationReference(VarName, ModelFunction);
+    setVarName(I, B.getVariableLocationReference(VarName, ModelFunction));
     return B.getVariableLocationDefinition(VarName, ModelFunction);
   }
 
@@ -428,6 +478,28 @@ private:
   };
 };
 
+/// Upper bound, in bytes, to the size of the expressions memoized by each
+/// CCodeGenerator.
+static constexpr size_t MaxExpressionCacheSize = 64 * 1024 * 1024;
+
+void CCodeGenerator::cacheExpression(const llvm::Value *V,
+                                     const std::string &Token) const {
+  // Tokens that alone exceed the budget are never memoized.
+  if (Token.size() > MaxExpressionCacheSize)
+    return;
+
+  // Start from scratch when the budget is exhausted. This keeps the memory
+  // bounded, at the price of recomputing some expressions.
+  if (ExpressionArena.getBytesAllocated() + Token.size()
+      > MaxExpressionCacheSize)
+    clearExpressionCache();
+
+  if (ExpressionCache.contains(V))
+    return;
+
+  ExpressionCache[V] = llvm::StringSaver(ExpressionArena).save(Token);
+}
+
 std::string CCodeGenerator::addParentheses(llvm::StringRef Expr) const {
   if (IsOperatorPrecedenceResolutionPassEnabled)
     return Expr.str();
@@ -590,7 +662,7 @@ CCodeGenerator::getModelGEPToken(const llvm::CallInst *Call) const {
 
   // First argument is a string containing the base type
   auto *CurArg = Call->arg_begin();
-  model::UpcastableType CurType = fromLLVMString(CurArg->get(), Model);
+  model::UpcastableType CurType = TypeCache.get(CurArg->get());
 
   // Second argument is the base llvm::Value
   ++CurArg;
@@ -743,9 +815,12 @@ CCodeGenerator::getCustomOpcodeToken(const llvm::CallInst *Call) const {
   if (isAssignment(Call)) {
     const llvm::Value *StoredVal = Call->getArgOperand(0);
     const llvm::Value *PointerVal = Call->getArgOperand(1);
-    rc_return rc_recur getToken(PointerVal) + " "
-      + B.getOperator(ptml::CBuilder::Operator::Assign) + " "
-      + rc_recur getToken(StoredVal);
+    std::string Assignment = rc_recur getToken(PointerVal);
+    Assignment += ' ';
+    Assignment += B.getOperator(ptml::CBuilder::Operator::Assign).toString();
+    Assignment += ' ';
+    rc_recur appendToken(Assignment, StoredVal);
+    rc_return Assignment;
   }
 
   if (isCallToTagged(Call, FunctionTags::Copy))
@@ -758,7 +833,7 @@ CCodeGenerator::getCustomOpcodeToken(const llvm::CallInst *Call) const {
   if (isCallToTagged(Call, FunctionTags::ModelCast)) {
     // First argument is a string containing the base type
     auto *CurArg = Call->arg_begin();
-    model::UpcastableType CurType = fromLLVMString(CurArg->get(), Model);
+    const model::UpcastableType &CurType = TypeCache.get(CurArg->get());
 
     // Second argument is the base llvm::Value
     ++CurArg;
@@ -777,8 +852,7 @@ CCodeGenerator::getCustomOpcodeToken(const llvm::CallInst *Call) const {
   if (isCallToTagged(Call, FunctionTags::AddressOf)) {
     // First operand is the type of the value being addressed (should not
     // introduce casts)
-    const model::UpcastableType ArgType = fromLLVMString(Call->getArgOperand(0),
-                                                         Model);
+    const auto &ArgType = TypeCache.get(Call->getArgOperand(0));
 
     // Second argument is the value being addressed
     llvm::Value *Arg = Call->getArgOperand(1);
@@ -806,7 +880,9 @@ CCodeGenerator::getCustomOpcodeToken(const llvm::CallInst *Call) const {
     // Emit RHS
     llvm::StringRef Separator = " {";
     for (const auto &Arg : Call->args()) {
-      StructInit += Separator.str() + " " + rc_recur getToken(Arg);
+      StructInit += Separator;
+      StructInit += ' ';
+      rc_recur appendToken(StructInit, Arg);
       Separator = ",";
     }
     StructInit += " }";
@@ -1143,8 +1219,10 @@ CCodeGenerator::getInstructionToken(const llvm::Instruction *I) const {
     std::string Result = B.getKeyword(ptml::CBuilder::Keyword::Return)
                            .toString();
     if (auto *Ret = llvm::cast<llvm::ReturnInst>(I);
-        llvm::Value *ReturnedVal = Ret->getReturnValue())
-      Result += " " + rc_recur getToken(ReturnedVal);
+        llvm::Value *ReturnedVal = Ret->getReturnValue()) {
+      Result += ' ';
+      rc_recur appendToken(Result, ReturnedVal);
+    }
 
     rc_return addDebugInfo(I, Result, B);
 
@@ -1185,10 +1263,8 @@ CCodeGenerator::getInstructionToken(const llvm::Instruction *I) const {
   rc_return "";
 }
 
-RecursiveCoroutine<std::string>
-CCodeGenerator::getToken(const llvm::Value *V) const {
-  revng_log(Log, "getToken(): " << dumpToString(V));
-  LoggerIndent Indent{ Log };
+std::optional<llvm::StringRef>
+CCodeGenerator::lookupToken(const llvm::Value *V) const {
   // If we already have a variable name for this, return it.
   auto It = TokenMap.find(V);
   if (It != TokenMap.end()) {
@@ -1197,7 +1273,7 @@ CCodeGenerator::getToken(const llvm::Value *V) const {
                  or isArtificialAggregateLocalVarDecl(V)
                  or isHelperAggregateLocalVarDecl(V));
     revng_log(Log, "Found!");
-    rc_return It->second;
+    return llvm::StringRef(It->second);
   }
 
   // We should always have names for stuff that is expected to have a name.
@@ -1206,11 +1282,56 @@ CCodeGenerator::getToken(const llvm::Value *V) const {
                and not isArtificialAggregateLocalVarDecl(V)
                and not isHelperAggregateLocalVarDecl(V));
 
-  if (isCConstant(V))
-    rc_return rc_recur getConstantToken(V);
+  if (auto CachedIt = ExpressionCache.find(V);
+      CachedIt != ExpressionCache.end()) {
+    revng_log(Log, "Memoized!");
+    return CachedIt->second;
+  }
+
+  return std::nullopt;
+}
+
+RecursiveCoroutine<std::string>
+CCodeGenerator::getToken(const llvm::Value *V) const {
+  revng_log(Log, "getToken(): " << dumpToString(V));
+  LoggerIndent Indent{ Log };
+  if (std::optional<llvm::StringRef> Token = lookupToken(V))
+    rc_return Token->str();
+
+  rc_return rc_recur buildToken(V);
+}
+
+RecursiveCoroutine<void>
+CCodeGenerator::appendToken(std::string &Out, const llvm::Value *V) const {
+  revng_log(Log, "appendToken(): " << dumpToString(V));
+  LoggerIndent Indent{ Log };
+  if (std::optional<llvm::StringRef> Token = lookupToken(V)) {
+    Out += *Token;
+    rc_return;
+  }
+
+  // Steal the buffer of the new token, if there's nothing to append it to.
+  if (Out.empty())
+    Out = rc_recur buildToken(V);
+  else
+    Out += rc_recur buildToken(V);
+
+  rc_return;
+}
+
+RecursiveCoroutine<std::string>
+CCodeGenerator::buildToken(const llvm::Value *V) const {
+  if (isCConstant(V)) {
+    std::string Token = rc_recur getConstantToken(V);
+    cacheExpression(V, Token);
+    rc_return Token;
+  }
 
-  if (auto *I = dyn_cast<llvm::Instruction>(V))
-    rc_return rc_recur getInstructionToken(I);
+  if (auto *I = dyn_cast<llvm::Instruction>(V)) {
+    std::string Token = rc_recur getInstructionToken(I);
+    cacheExpression(V, Token);
+    rc_return Token;
+  }
 
   std::string Error = "Cannot get token for llvm::Value: ";
   Error += dumpToString(V).c_str();
@@ -1230,7 +1351,8 @@ CCodeGenerator::getCallToken(const llvm::CallInst *Call,
   } else {
     llvm::StringRef Separator = "(";
     for (const auto &Arg : Call->args()) {
-      Expression += Separator.str() + rc_recur getToken(Arg);
+      Expression += Separator;
+      rc_recur appendToken(Expression, Arg);
       Separator = ", ";
     }
     Expression += ')';
@@ -1239,6 +1361,14 @@ CCodeGenerator::getCallToken(const llvm::CallInst *Call,
   rc_return Expression;
 }
 
+std::string CCodeGenerator::getStatementToken(const llvm::Instruction *I) const {
+  // Append the terminator in place, rather than building a new string.
+  std::string Statement;
+  appendToken(Statement, I);
+  Statement += ";\n";
+  return Statement;
+}
+
 static bool isStatement(const llvm::Instruction *I) {
   // Return are statements
   if (isa<llvm::ReturnInst>(I))
@@ -1299,7 +1429,7 @@ void CCodeGenerator::emitBasicBlock(const llvm::BasicBlock *BB,
       // Handle the implicit `return` emission. If the correct parameter is set,
       // avoid the emission of the `Instruction` token.
       if (not(llvm::isa<llvm::ReturnInst>(I) and not EmitReturn))
-        B.append(std::string(getToken(&I)) + ";\n");
+        B.append(getStatementToken(&I));
 
     } else if (isHelperAggregateLocalVarDecl(Call)
                or isArtificialAggregateLocalVarDecl(Call)) {
@@ -1775,10 +1905,13 @@ RecursiveCoroutine<void> CCodeGenerator::emitGHASTNode(const ASTNode *N) {
           if (SwitchVar) {
             llvm::Type *SwitchVarT = SwitchVar->getType();
             auto *IntType = cast<llvm::IntegerType>(SwitchVarT);
-            auto *CaseConst = llvm::ConstantInt::get(IntType, CaseVal);
+            // Build the APInt directly instead of going through a
+            // ConstantInt, so that emission never touches the LLVMContext and
+            // can run concurrently on different functions.
+            llvm::APInt CaseValue(IntType->getBitWidth(), CaseVal);
             // TODO: assigned the signedness based on the signedness of the
             // condition
-            B.append(B.getNumber(CaseConst->getValue()).toString());
+            B.append(B.getNumber(CaseValue).toString());
           } else {
             B.append(B.getNumber(CaseVal).toString());
           }
@@ -1896,7 +2029,7 @@ void CCodeGenerator::emitFunction(bool NeedsLocalStateVar) {
   // Set up the argument identifiers to be used in the function's body.
   for (const auto &Arg : LLVMFunction.args()) {
     std::string ArgString = getModelArgIdentifier(&Prototype, Arg);
-    TokenMap[&Arg] = B.getArgumentLocationReference(ArgString, ModelFunction);
+    setVarName(&Arg, B.getArgumentLocationReference(ArgString, ModelFunction));
   }
 
   // Print the function body
@@ -1955,9 +2088,9 @@ void CCodeGenerator::emitFunction(bool NeedsLocalStateVar) {
 }
 
 static std::string decompileFunction(ControlFlowGraphCache &Cache,
+                                     ModelTypeCache &TypeCache,
                                      const llvm::Function &LLVMFunc,
                                      const ASTTree &CombedAST,
-                                     const Binary &Model,
                                      const ASTVarDeclMap &VarToDeclare,
                                      bool NeedsLocalStateVar,
                                      ptml::CTypeBuilder &B) {
@@ -1966,7 +2099,12 @@ static std::string decompileFunction(ControlFlowGraphCache &Cache,
   llvm::raw_string_ostream Out(Result);
   B.setOutputStream(Out);
 
-  CCodeGenerator Backend(Cache, Model, LLVMFunc, CombedAST, VarToDeclare, B);
+  CCodeGenerator Backend(Cache,
+                         TypeCache,
+                         LLVMFunc,
+                         CombedAST,
+                         VarToDeclare,
+                         B);
   Backend.emitFunction(NeedsLocalStateVar);
   Out.flush();
 
@@ -2006,28 +2144,13 @@ static ASTVarDeclMap computeVariableDeclarationScope(const llvm::Function &F,
   return computeVarDeclMap(GHAST, PendingVariables);
 }
 
-std::string decompile(ControlFlowGraphCache &Cache,
-                      llvm::Function &F,
-                      const model::Binary &Model,
-                      ptml::CTypeBuilder &B) {
-  using namespace llvm;
-  Task T2(3, Twine("decompile Function: ") + Twine(F.getName()));
-
-  // TODO: this will eventually become a GHASTContainer for revng pipeline
-  ASTTree GHAST;
-
-  // Generate the GHAST and beautify it.
-  {
-    T2.advance("restructureCFG");
-    restructureCFG(F, GHAST);
-    // TODO: beautification should be optional, but at the moment it's not
-    // truly so (if disabled, things crash). We should strive to make it
-    // optional for real.
-    T2.advance("beautifyAST");
-    beautifyAST(Model, F, GHAST);
-  }
-
-  T2.advance("decompileFunction");
+/// Emit the C code of \a F, whose GHAST has already been restructured and
+/// beautified.
+static std::string emitC(ControlFlowGraphCache &Cache,
+                         ModelTypeCache &TypeCache,
+                         const llvm::Function &F,
+                         const ASTTree &GHAST,
+                         ptml::CTypeBuilder &B) {
   if (Log.isEnabled()) {
     GHAST.dumpASTOnFile(F.getName().str(),
                         "ast-backend",
@@ -2038,10 +2161,55 @@ std::string decompile(ControlFlowGraphCache &Cache,
   auto VariablesToDeclare = computeVariableDeclarationScope(F, GHAST);
   auto NeedsLoopStateVar = hasLoopDispatchers(GHAST);
   return decompileFunction(Cache,
+                           TypeCache,
                            F,
                            GHAST,
-                           Model,
                            VariablesToDeclare,
                            NeedsLoopStateVar,
                            B);
 }
+
+std::string decompile(ControlFlowGraphCache &Cache,
+                      ModelTypeCache &TypeCache,
+                      llvm::Function &F,
+                      ASTTree &GHAST,
+                      ptml::CTypeBuilder &B) {
+  using namespace llvm;
+  Task T2(2, Twine("decompile Function: ") + Twine(F.getName()));
+
+  // TODO: beautification should be optional, but at the moment it's not
+  // truly so (if disabled, things crash). We should strive to make it
+  // optional for real.
+  T2.advance("beautifyAST");
+  beautifyAST(TypeCache.getModel(), F, GHAST);
+
+  T2.advance("decompileFunction");
+  return emitC(Cache, TypeCache, F, GHAST, B);
+}
+
+std::string decompile(ControlFlowGraphCache &Cache,
+                      ModelTypeCache &TypeCache,
+                      llvm::Function &F,
+                      ptml::CTypeBuilder &B) {
+  // TODO: this will eventually become a GHASTContainer for revng pipeline
+  ASTTree GHAST;
+  restructureCFG(F, GHAST);
+  return decompile(Cache, TypeCache, F, GHAST, B);
+}
+
+std::vector<ASTTree> restructure(llvm::ArrayRef<llvm::Function *> Functions) {
+  using namespace llvm;
+  Task T(1, "restructure Functions");
+  T.advance("restructureCFG");
+
+  // Loggers are not thread-safe
+  unsigned Jobs = isRestructureLoggingEnabled() ? 1 :
+                                                  revng::options::DecompilerJobs;
+
+  std::vector<ASTTree> GHASTs(Functions.size());
+  parallelFor(Jobs, Functions.size(), [&](unsigned, size_t I) {
+    restructureCFG(*Functions[I], GHASTs[I]);
+  });
+
+  return GHASTs;
+}
@@ -2,16 +2,24 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+
 #include "revng/Model/Binary.h"
 #include "revng/Pipeline/AllRegistries.h"
 #include "revng/Pipes/Kinds.h"
 #include "revng/Pipes/ModelGlobal.h"
 #include "revng/Pipes/StringMap.h"
+#include "revng/Support/Assert.h"
 
 #include "revng-c/Backend/DecompileFunction.h"
 #include "revng-c/Backend/DecompilePipe.h"
 #include "revng-c/HeadersGeneration/Options.h"
 #include "revng-c/Pipes/Kinds.h"
+#include "revng-c/Support/Parallel.h"
 #include "revng-c/TypeNames/PTMLCTypeBuilder.h"
 
 namespace revng::pipes {
@@ -27,6 +35,7 @@ void Decompile::run(pipeline::ExecutionContext &EC,
   llvm::Module &Module = IRContainer.getModule();
   const model::Binary &Model = *getModelFromContext(EC);
   ControlFlowGraphCache Cache(CFGMap);
+  ModelTypeCache TypeCache(Model);
 
   namespace options = revng::options;
   ptml::CTypeBuilder
@@ -36,11 +45,75 @@ void Decompile::run(pipeline::ExecutionContext &EC,
         .EnableStackFrameInlining = !options::DisableStackFrameInlining });
   B.collectInlinableTypes(Model);
 
+  if (revng::options::DecompilerJobs == 1) {
+    for (const model::Function &Function :
+         getFunctionsAndCommit(EC, DecompiledFunctions.name())) {
+      llvm::Function *F = Module.getFunction(getLLVMFunctionName(Function));
+      std::string CCode = decompile(Cache, TypeCache, *F, B);
+      DecompiledFunctions.insert_or_assign(Function.Entry(), std::move(CCode));
+    }
+    return;
+  }
+
+  // Functions are restructured in batches, spread across all the workers:
+  // restructuring doesn't read the model, so it's irrelevant for the tracking
+  // of the reads. Everything reading the model runs on this thread, in the
+  // loop below, so that the reads are attributed to each function as in the
+  // serial case.
+  //
+  // Batches are taken from the requested targets, which are not necessarily
+  // visited in the same order by getFunctionsAndCommit. Hence each GHAST is
+  // kept until its function is emitted, and released right after, and a new
+  // batch only includes functions that have not been restructured yet. Since
+  // a batch never makes the pending GHASTs more than BatchSize, this bounds
+  // the memory usage.
+  std::vector<llvm::Function *> Functions;
+  for (const pipeline::Target &Target :
+       EC.getRequestedTargetsFor(DecompiledFunctions)) {
+    auto Entry = MetaAddress::fromString(Target.getPathComponents()[0]);
+    const model::Function &Function = Model.Functions().at(Entry);
+    Functions.push_back(Module.getFunction(getLLVMFunctionName(Function)));
+  }
+
+  llvm::DenseMap<const llvm::Function *, size_t> IndexOf;
+  for (size_t I = 0; I < Functions.size(); ++I)
+    IndexOf[Functions[I]] = I;
+
+  const size_t BatchSize = getFunctionBatchSize(Functions.size());
+  llvm::DenseSet<const llvm::Function *> Restructured;
+  std::map<const llvm::Function *, ASTTree> Pending;
+
   for (const model::Function &Function :
        getFunctionsAndCommit(EC, DecompiledFunctions.name())) {
     llvm::Function *F = Module.getFunction(getLLVMFunctionName(Function));
-    std::string CCode = decompile(Cache, *F, Model, B);
+
+    // Restructure a new batch, starting from F, if F is not pending
+    if (not Pending.contains(F)) {
+      revng_assert(not Restructured.contains(F));
+
+      // Always make room at least for F
+      size_t Room = 1;
+      if (Pending.size() < BatchSize)
+        Room = BatchSize - Pending.size();
+
+      std::vector<llvm::Function *> Batch;
+      for (size_t I = IndexOf.at(F);
+           I < Functions.size() and Batch.size() < Room;
+           ++I)
+        if (not Restructured.contains(Functions[I]))
+          Batch.push_back(Functions[I]);
+
+      std::vector<ASTTree> GHASTs = restructure(Batch);
+      for (size_t I = 0; I < Batch.size(); ++I) {
+        Restructured.insert(Batch[I]);
+        Pending.emplace(Batch[I], std::move(GHASTs[I]));
+      }
+    }
+
+    auto It = Pending.find(F);
+    std::string CCode = decompile(Cache, TypeCache, *F, It->second, B);
     DecompiledFunctions.insert_or_assign(Function.Entry(), std::move(CCode));
+    Pending.erase(It);
   }
 }
 
@@ -2,7 +2,18 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "revng/EarlyFunctionAnalysis/ControlFlowGraphCache.h"
@@ -16,6 +27,7 @@
 #include "revng-c/HeadersGeneration/Options.h"
 #include "revng-c/HeadersGeneration/PTMLHeaderBuilder.h"
 #include "revng-c/Support/PTMLC.h"
+#include "revng-c/Support/Parallel.h"
 
 namespace revng::pipes {
 
@@ -47,27 +59,81 @@ void DecompileToDirectory::run(pipeline::ExecutionContext &EC,
   B.collectInlinableTypes(Model);
 
   {
-    ControlFlowGraphCache Cache{ CFGMap };
-    DecompileStringMap DecompiledFunctions("tmp");
-    for (pipeline::Target &Target : CFGMap.enumerate()) {
-      auto Entry = MetaAddress::fromString(Target.getPathComponents()[0]);
-      llvm::Function *F = Module.getFunction(getLLVMFunctionName(Model
-                                                                   .Functions()
-                                                                   .at(Entry)));
-      std::string CCode = decompile(Cache, *F, Model, B);
-      DecompiledFunctions.insert_or_assign(Entry, std::move(CCode));
+    // Sort the functions by entry address, since that's the order in which
+    // they are printed in the single C file.
+    std::set<MetaAddress> Entries;
+    for (pipeline::Target &Target : CFGMap.enumerate())
+      Entries.insert(MetaAddress::fromString(Target.getPathComponents()[0]));
+
+    std::vector<llvm::Function *> Functions;
+    for (const MetaAddress &Entry : Entries) {
+      const model::Function &Function = Model.Functions().at(Entry);
+      Functions.push_back(Module.getFunction(getLLVMFunctionName(Function)));
     }
 
-    std::string DecompiledC;
-    llvm::raw_string_ostream Out{ DecompiledC };
-    B.setOutputStream(Out);
-    printSingleCFile(B, DecompiledFunctions, {} /* Targets */);
+    // The functions are written to a temporary file as soon as they are
+    // decompiled, so that we never need to hold all of their text in memory
+    // while decompiling. The file is then loaded back and appended to the tar
+    // in one piece, since the size of each file has to be known before its
+    // content is written. If no temporary file can be created, the functions
+    // are printed in memory instead.
+    int FD = 0;
+    llvm::SmallString<128> FunctionsPath;
+    using llvm::sys::fs::createTemporaryFile;
+    bool UseFile = not createTemporaryFile("functions", "c", FD, FunctionsPath);
+    std::optional<llvm::FileRemover> RemoveFunctionsFile;
+    if (UseFile)
+      RemoveFunctionsFile.emplace(FunctionsPath);
+
+    std::string FunctionsInMemory;
+    {
+      std::unique_ptr<llvm::raw_ostream> Out;
+      if (UseFile)
+        Out = std::make_unique<llvm::raw_fd_ostream>(FD,
+                                                     /* shouldClose = */ true);
+      else
+        Out = std::make_unique<llvm::raw_string_ostream>(FunctionsInMemory);
+      B.setOutputStream(*Out);
+
+      // Functions are decompiled in batches, whose restructuring is spread
+      // across all the workers. The rest of the decompilation reads the model,
+      // hence it runs here. The results of a batch are printed in order and
+      // released before starting the next one, which bounds the memory usage.
+      ControlFlowGraphCache Cache(CFGMap);
+      ModelTypeCache TypeCache(Model);
+      ptml::CTypeBuilder FunctionB(llvm::nulls(), B);
+      const size_t BatchSize = getFunctionBatchSize(Functions.size());
+      llvm::ArrayRef<llvm::Function *> ToDecompile = Functions;
+      printSingleCFile(B, [&](FunctionBodyPrinter Print) {
+        while (not ToDecompile.empty()) {
+          size_t Size = std::min(BatchSize, ToDecompile.size());
+          auto Batch = ToDecompile.take_front(Size);
+          ToDecompile = ToDecompile.drop_front(Size);
+
+          std::vector<ASTTree> GHASTs = restructure(Batch);
+          for (size_t I = 0; I < Batch.size(); ++I)
+            Print(decompile(Cache,
+                            TypeCache,
+                            *Batch[I],
+                            GHASTs[I],
+                            FunctionB));
+        }
+      });
+
+      Out->flush();
+    }
 
-    Out.flush();
+    if (UseFile) {
+      auto BufferOrError = llvm::MemoryBuffer::getFile(FunctionsPath);
+      auto Buffer = cantFail(errorOrToExpected(std::move(BufferOrError)));
 
-    TarWriter.append("decompiled/functions.c",
-                     llvm::ArrayRef{ DecompiledC.data(),
-                                     DecompiledC.length() });
+      TarWriter.append("decompiled/functions.c",
+                       { Buffer->getBufferStart(), Buffer->getBufferSize() });
+    } else {
+      TarWriter.append("decompiled/functions.c",
+                       llvm::ArrayRef{ FunctionsInMemory.data(),
+                                       FunctionsInMemory.length() });
+    }
   }
 
   {
@@ -10,22 +10,29 @@
 using namespace revng::pipes;
 
 void printSingleCFile(ptml::CTypeBuilder &B,
-                      const DecompileStringMap &Functions,
-                      const std::set<MetaAddress> &Targets) {
+                      llvm::function_ref<void(FunctionBodyPrinter)> Bodies) {
   auto Scope = B.getIndentedTag(ptml::tags::Div);
   // Print headers
   B.append(B.getIncludeQuote("types-and-globals.h")
            + B.getIncludeQuote("helpers.h") + "\n");
 
-  if (Targets.empty()) {
-    // If Targets is empty print all the Functions' bodies
-    for (const auto &[MetaAddress, CFunction] : Functions)
-      B.append(CFunction + '\n');
-  } else {
-    // Otherwise only print the bodies of the Targets
-    auto End = Functions.end();
-    for (const auto &MetaAddress : Targets)
-      if (auto It = Functions.find(MetaAddress); It != End)
-        B.append(It->second + '\n');
-  }
+  Bodies([&B](llvm::StringRef CFunction) { B.append(CFunction.str() + '\n'); });
+}
+
+void printSingleCFile(ptml::CTypeBuilder &B,
+                      const DecompileStringMap &Functions,
+                      const std::set<MetaAddress> &Targets) {
+  printSingleCFile(B, [&](FunctionBodyPrinter Print) {
+    if (Targets.empty()) {
+      // If Targets is empty print all the Functions' bodies
+      for (const auto &[MetaAddress, CFunction] : Functions)
+        Print(CFunction);
+    } else {
+      // Otherwise only print the bodies of the Targets
+      auto End = Functions.end();
+      for (const auto &MetaAddress : Targets)
+        if (auto It = Functions.find(MetaAddress); It != End)
+          Print(It->second);
+    }
+  });
 }
@@ -2,6 +2,8 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <optional>
+
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -23,6 +25,10 @@
 static Logger<> Log{ "fold-model-gep" };
 
 struct FoldModelGEP : public llvm::FunctionPass {
+private:
+  /// The types deserialized from LLVM strings, shared by all the functions
+  std::optional<ModelTypeCache> TypeCache;
+
 public:
   static char ID;
 
@@ -32,6 +38,11 @@ public:
   /// and type2 are the same
   bool runOnFunction(llvm::Function &F) override;
 
+  bool doFinalization(llvm::Module &M) override {
+    TypeCache.reset();
+    return false;
+  }
+
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.addRequired<LoadModelWrapperPass>();
     AU.setPreservesCFG();
@@ -53,7 +64,7 @@ inline llvm::Value *traverseTransparentInstructions(llvm::Value *V) {
 }
 
 static llvm::Value *getValueToSubstitute(llvm::Instruction &I,
-                                         const model::Binary &Model) {
+                                         ModelTypeCache &TypeCache) {
   if (auto *Call = getCallToTagged(&I, FunctionTags::ModelGEP)) {
     revng_log(Log, "--------Call: " << dumpToString(I));
 
@@ -66,7 +77,7 @@ static llvm::Value *getValueToSubstitute(llvm::Instruction &I,
 
     // First argument is the model type of the base pointer
     llvm::Value *GEPFirstArg = Call->getArgOperand(0);
-    auto GEPBaseType = fromLLVMString(GEPFirstArg, Model);
+    const model::UpcastableType &GEPBaseType = TypeCache.get(GEPFirstArg);
 
     // Second argument is the base pointer
     llvm::Value *SecondArg = Call->getArgOperand(1);
@@ -93,7 +104,7 @@ static llvm::Value *getValueToSubstitute(llvm::Instruction &I,
 
     // First argument of the AddressOf is the pointer's base type
     llvm::Value *AddrOfFirstArg = AddrOfCall->getArgOperand(0);
-    auto AddrOfBaseType = fromLLVMString(AddrOfFirstArg, Model);
+    const auto &AddrOfBaseType = TypeCache.get(AddrOfFirstArg);
 
     // Skip if the ModelGEP is dereferencing the AddressOf with a
     // different type
@@ -114,6 +125,8 @@ bool FoldModelGEP::runOnFunction(llvm::Function &F) {
   // Get the model
   const auto
     &Model = getAnalysis<LoadModelWrapperPass>().get().getReadOnlyModel().get();
+  if (not TypeCache.has_value() or &TypeCache->getModel() != Model)
+    TypeCache.emplace(*Model);
 
   // Initialize the IR builder to inject functions
   llvm::LLVMContext &LLVMCtx = F.getContext();
@@ -128,7 +141,8 @@ bool FoldModelGEP::runOnFunction(llvm::Function &F) {
   for (auto *BB : llvm::ReversePostOrderTraversal(&F)) {
     for (auto &I : llvm::make_early_inc_range(*BB)) {
 
-      if (llvm::Value *ValueToSubstitute = getValueToSubstitute(I, *Model)) {
+      if (llvm::Value *ValueToSubstitute = getValueToSubstitute(I,
+                                                                *TypeCache)) {
         auto *CallToFold = cast<CallInst>(&I);
         revng_assert(isCallToTagged(CallToFold, FunctionTags::ModelGEP));
         Builder.SetInsertPoint(CallToFold);
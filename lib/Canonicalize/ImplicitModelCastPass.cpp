@@ -42,6 +42,9 @@ public:
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesCFG();
     AU.addRequired<LoadModelWrapperPass>();
+    AU.addRequired<InitModelTypesAnalysis>();
+    // We only flag existing ModelCasts as implicit, which doesn't affect types
+    AU.addPreserved<InitModelTypesAnalysis>();
   }
 
   bool process(llvm::Function &F, const model::Binary &Model);
@@ -58,7 +61,8 @@ private:
                                                  const model::Binary &Model);
 
 private:
-  ValueTypeMap TypeMap;
+  const ModelTypesMap *TypeMap = nullptr;
+  ModelTypeCache *TypeCache = nullptr;
   ModelPromotedTypesMap PromotedTypes;
 };
 
@@ -300,7 +304,7 @@ ImplicitModelCastPass::getOperandsToPromote(llvm::Instruction *I,
     auto *CastedValue = CallToModelCast->getArgOperand(1);
     // Expected Type for the casted operand is the type of the cast, since the
     // MakeModelCast already made the cast.
-    const model::Type &ExpectedType = *TypeMap.at(CallToModelCast);
+    const model::Type &ExpectedType = *TypeMap->at(CallToModelCast);
 
     // Check if shift count < width of type.
     if (isShiftLikeInstruction(I) and Op.getOperandNo() == 0
@@ -313,7 +317,7 @@ ImplicitModelCastPass::getOperandsToPromote(llvm::Instruction *I,
       continue;
 
     auto PromotedTypeForCastedValue = PromotedTypesForInstruction[CastedValue];
-    const model::Type &CastedValueType = *TypeMap.at(CastedValue);
+    const model::Type &CastedValueType = *TypeMap->at(CastedValue);
     // If type of the value being casted or integer promoted type are implicit
     // casts, we can avoid the cast itself.
     bool IsImplicit = isImplicitCast(*PromotedTypeForCastedValue,
@@ -393,14 +397,14 @@ bool IMCP::collectTypeInfoForTypePromotion(llvm::Instruction *I,
       // already "casted" by the MakeModelCast Pass.
       llvm::CallInst *CallToModelCast = cast<llvm::CallInst>(Op.get());
       llvm::Value *CastedValue = CallToModelCast->getArgOperand(1);
-      OperandType = TypeMap.at(CastedValue).get();
+      OperandType = TypeMap->at(CastedValue).get();
       ValueToPromoteTypeFor = CastedValue;
-      ExpectedType = TypeMap.at(Op.get());
+      ExpectedType = TypeMap->at(Op.get());
     } else {
       // If it is not a ModelCast, promote the type for the llvm::Value itself.
-      OperandType = TypeMap.at(Op.get()).get();
+      OperandType = TypeMap->at(Op.get()).get();
       ValueToPromoteTypeFor = Op.get();
-      auto ModelTypes = getExpectedModelType(&Op, Model);
+      auto ModelTypes = getExpectedModelType(&Op, *TypeCache);
       if (ModelTypes.size() != 1)
         return;
       ExpectedType = std::move(ModelTypes.back());
@@ -515,10 +519,9 @@ bool ImplicitModelCastPass::runOnFunction(llvm::Function &F) {
   auto &ModelWrapper = getAnalysis<LoadModelWrapperPass>().get();
   const TupleTree<model::Binary> &Model = ModelWrapper.getReadOnlyModel();
 
-  auto ModelFunction = llvmToModelFunction(*Model, F);
-  revng_assert(ModelFunction != nullptr);
-
-  TypeMap = initModelTypes(F, ModelFunction, *Model, false);
+  auto &Types = getAnalysis<InitModelTypesAnalysis>();
+  TypeMap = &Types.get(/* PointersOnly = */ false);
+  TypeCache = &Types.getTypeCache();
 
   Changed = process(F, *Model);
 
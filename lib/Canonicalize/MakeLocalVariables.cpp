@@ -33,6 +33,7 @@ public:
 
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.addRequired<LoadModelWrapperPass>();
+    AU.addRequired<InitModelTypesAnalysis>();
     AU.setPreservesCFG();
   }
 };
@@ -72,14 +73,8 @@ bool MakeLocalVariables::runOnFunction(llvm::Function &F) {
   // that are reachable from F. If this fails, we just bail out because we
   // cannot infer any modelGEP in F, if we have no type information to rely
   // on.
-  const model::Function *ModelF = llvmToModelFunction(*Model, F);
-  revng_assert(ModelF);
-  using ModelTypesMap = std::map<const llvm::Value *,
-                                 const model::UpcastableType>;
-  ModelTypesMap KnownTypes = initModelTypes(F,
-                                            ModelF,
-                                            *Model,
-                                            /* PointersOnly = */ false);
+  const ModelTypesMap &KnownTypes = getAnalysis<InitModelTypesAnalysis>()
+                                      .get(/* PointersOnly = */ false);
 
   for (auto *Alloca : ToReplace) {
     Builder.SetInsertPoint(Alloca);
@@ -26,8 +26,6 @@
 #include "revng-c/TypeNames/LLVMTypeNames.h"
 
 using namespace llvm;
-using ModelTypesMap = std::map<const llvm::Value *,
-                               const model::UpcastableType>;
 
 struct SerializedType {
   Constant *StringType = nullptr;
@@ -39,8 +37,7 @@ struct SerializedType {
 
 struct MakeModelCastPass : public llvm::FunctionPass {
 private:
-  ModelTypesMap TypeMap;
-  const model::Function *ModelFunction = nullptr;
+  const ModelTypesMap *TypeMap = nullptr;
 
 public:
   static char ID;
@@ -52,29 +49,33 @@ public:
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesCFG();
     AU.addRequired<LoadModelWrapperPass>();
+    AU.addRequired<InitModelTypesAnalysis>();
+    // The types of the ModelCasts we inject, and of their users, are kept up
+    // to date in InitModelTypesAnalysis
+    AU.addPreserved<InitModelTypesAnalysis>();
   }
 
 private:
   std::vector<SerializedType> serializeTypesForModelCast(Instruction *,
-                                                         const model::Binary &);
-  void createAndInjectModelCast(Instruction *,
-                                const SerializedType &,
-                                OpaqueFunctionsPool<TypePair> &);
+                                                         ModelTypeCache &);
+  Instruction *createAndInjectModelCast(Instruction *,
+                                        const SerializedType &,
+                                        OpaqueFunctionsPool<TypePair> &);
 };
 
 using MMCP = MakeModelCastPass;
 
 std::vector<SerializedType>
-MMCP::serializeTypesForModelCast(Instruction *I, const model::Binary &Model) {
+MMCP::serializeTypesForModelCast(Instruction *I, ModelTypeCache &TypeCache) {
   using namespace model;
   using namespace abi::FunctionType;
 
   std::vector<SerializedType> Result;
   Module *M = I->getModule();
 
-  auto SerializeTypeFor = [this, &Model, &Result, &M](const llvm::Use &Op) {
+  auto SerializeTypeFor = [this, &TypeCache, &Result, &M](const llvm::Use &Op) {
     // Check if we have strong model information about this operand
-    auto ModelTypes = getExpectedModelType(&Op, Model);
+    auto ModelTypes = getExpectedModelType(&Op, TypeCache);
 
     // Aggregates that do not correspond to model structs (e.g. return types
     // of RawFunctionTypes that return more than one value) cannot be handled
@@ -83,7 +84,7 @@ MMCP::serializeTypesForModelCast(Instruction *I, const model::Binary &Model) {
       const model::UpcastableType &ExpectedType = ModelTypes.back();
       revng_assert(ExpectedType->verify());
 
-      const model::Type &OperandType = *TypeMap.at(Op.get());
+      const model::Type &OperandType = *TypeMap->at(Op.get());
       if (*ExpectedType->skipTypedefs() != *OperandType.skipTypedefs()) {
         revng_assert(ExpectedType->isScalar() and OperandType.isScalar());
         // Create a cast only if the expected type is different from the
@@ -170,9 +171,10 @@ static Value *createCallToModelCast(IRBuilder<> &Builder,
   return Call;
 }
 
-void MMCP::createAndInjectModelCast(Instruction *Ins,
-                                    const SerializedType &ST,
-                                    OpaqueFunctionsPool<TypePair> &Pool) {
+Instruction *
+MMCP::createAndInjectModelCast(Instruction *Ins,
+                               const SerializedType &ST,
+                               OpaqueFunctionsPool<TypePair> &Pool) {
   IRBuilder<> Builder(Ins);
 
   uint64_t OperandId = ST.OperandId;
@@ -185,6 +187,7 @@ void MMCP::createAndInjectModelCast(Instruction *Ins,
                                                  Operand,
                                                  Pool);
   Ins->setOperand(OperandId, CallToModelCast);
+  return cast<Instruction>(CallToModelCast);
 }
 
 bool MMCP::runOnFunction(Function &F) {
@@ -194,11 +197,7 @@ bool MMCP::runOnFunction(Function &F) {
   OpaqueFunctionsPool<TypePair> ModelCastPool(M, false);
   initModelCastPool(ModelCastPool, M);
 
-  auto &ModelWrapper = getAnalysis<LoadModelWrapperPass>().get();
-  const TupleTree<model::Binary> &Model = ModelWrapper.getReadOnlyModel();
-
-  ModelFunction = llvmToModelFunction(*Model, F);
-  revng_assert(ModelFunction != nullptr);
+  auto &Types = getAnalysis<InitModelTypesAnalysis>();
 
   // First of all, remove all SExt, ZExt and Trunc, and replace them with
   // ModelCasts.
@@ -247,16 +246,23 @@ bool MMCP::runOnFunction(Function &F) {
                                                        CastedOperand,
                                                        ModelCastPool);
         I.replaceAllUsesWith(CallToModelCast);
+        Types.forget(&I);
         I.eraseFromParent();
+        Types.update(*cast<Instruction>(CallToModelCast));
+        Changed = true;
       }
     }
   }
 
-  TypeMap = initModelTypes(F, ModelFunction, *Model, false);
+  TypeMap = &Types.get(/* PointersOnly = */ false);
 
+  // Casts are injected based on the types computed before injecting any of
+  // them, hence we update the analysis only at the end.
+  llvm::SmallVector<Instruction *, 16> Injected;
   for (BasicBlock &BB : F) {
     for (Instruction &I : BB) {
-      auto SerializedTypes = serializeTypesForModelCast(&I, *Model);
+      auto SerializedTypes = serializeTypesForModelCast(&I,
+                                                        Types.getTypeCache());
 
       if (SerializedTypes.empty())
         continue;
@@ -264,10 +270,15 @@ bool MMCP::runOnFunction(Function &F) {
       Changed = true;
 
       for (unsigned Idx = 0; Idx < SerializedTypes.size(); ++Idx)
-        createAndInjectModelCast(&I, SerializedTypes[Idx], ModelCastPool);
+        Injected.push_back(createAndInjectModelCast(&I,
+                                                    SerializedTypes[Idx],
+                                                    ModelCastPool));
     }
   }
 
+  for (Instruction *ModelCast : Injected)
+    Types.update(*ModelCast);
+
   return Changed;
 }
 
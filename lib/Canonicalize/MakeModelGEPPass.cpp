@@ -501,8 +501,6 @@ public:
   void dump() const debug_function { dump(llvm::dbgs()); }
 };
 
-using ModelTypesMap = std::map<const Value *, const model::UpcastableType>;
-
 static RecursiveCoroutine<std::optional<IRArithmetic>>
 getIRArithmetic(Use &AddressUse, const ModelTypesMap &PointerTypes) {
   revng_log(ModelGEPLog,
@@ -1852,21 +1850,18 @@ struct UseReplacementWithModelGEP {
 static std::vector<UseReplacementWithModelGEP>
 makeGEPReplacements(llvm::Function &F,
                     const model::Binary &Model,
+                    InitModelTypesAnalysis &Types,
                     model::VerifyHelper &VH) {
 
   std::vector<UseReplacementWithModelGEP> Result;
 
-  const model::Function *ModelF = llvmToModelFunction(Model, F);
-  revng_assert(ModelF);
-
   // First, try to initialize a map for the known model types of llvm::Values
   // that are reachable from F. If this fails, we just bail out because we
   // cannot infer any modelGEP in F, if we have no type information to rely
   // on.
-  ModelTypesMap PointerTypes = initModelTypes(F,
-                                              ModelF,
-                                              Model,
-                                              /* PointersOnly = */ true);
+  // Take ownership of the map, since we propagate the types we infer along
+  // the way. We don't preserve the analysis, so nobody else will need it.
+  ModelTypesMap PointerTypes = Types.take(/* PointersOnly = */ true);
   if (PointerTypes.empty()) {
     revng_log(ModelGEPLog, "Model Types not found for " << F.getName());
     return Result;
@@ -2076,6 +2071,7 @@ public:
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.setPreservesCFG();
     AU.addRequired<LoadModelWrapperPass>();
+    AU.addRequired<InitModelTypesAnalysis>();
   }
 };
 
@@ -2088,7 +2084,8 @@ bool MakeModelGEPPass::runOnFunction(llvm::Function &F) {
   auto &Model = getAnalysis<LoadModelWrapperPass>().get().getReadOnlyModel();
 
   model::VerifyHelper VH;
-  auto GEPReplacements = makeGEPReplacements(F, *Model, VH);
+  auto &Types = getAnalysis<InitModelTypesAnalysis>();
+  auto GEPReplacements = makeGEPReplacements(F, *Model, Types, VH);
 
   llvm::Module &M = *F.getParent();
   LLVMContext &Context = M.getContext();
@@ -39,9 +39,13 @@ struct FormatInt {
 };
 
 static std::optional<FormatInt>
-getIntFormat(llvm::Instruction &I, llvm::Use &U, const model::Binary &Model);
+getIntFormat(llvm::Instruction &I, llvm::Use &U, ModelTypeCache &TypeCache);
 
 struct PrettyIntFormatting : public llvm::FunctionPass {
+private:
+  /// The types deserialized from LLVM strings, shared by all the functions
+  std::optional<ModelTypeCache> TypeCache;
+
 public:
   static char ID;
 
@@ -49,6 +53,11 @@ public:
 
   bool runOnFunction(llvm::Function &F) override;
 
+  bool doFinalization(llvm::Module &M) override {
+    TypeCache.reset();
+    return false;
+  }
+
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesCFG();
     AU.addRequired<LoadModelWrapperPass>();
@@ -62,6 +71,8 @@ bool PrettyIntFormatting::runOnFunction(llvm::Function &F) {
 
   const model::Binary
     &Model = *getAnalysis<LoadModelWrapperPass>().get().getReadOnlyModel();
+  if (not TypeCache.has_value() or &TypeCache->getModel() != &Model)
+    TypeCache.emplace(Model);
 
   OpaqueFunctionsPool<llvm::Type *> HexIntegerPool(F.getParent(), false);
   initHexPrintPool(HexIntegerPool);
@@ -79,7 +90,7 @@ bool PrettyIntFormatting::runOnFunction(llvm::Function &F) {
 
   for (llvm::Instruction &I : llvm::instructions(F)) {
     for (llvm::Use &U : I.operands()) {
-      if (auto formatting = getIntFormat(I, U, Model); formatting) {
+      if (auto formatting = getIntFormat(I, U, *TypeCache); formatting) {
         IntsToBeFormatted.push_back(*formatting);
       }
     }
@@ -118,7 +129,7 @@ bool PrettyIntFormatting::runOnFunction(llvm::Function &F) {
 }
 
 std::optional<FormatInt>
-getIntFormat(llvm::Instruction &I, llvm::Use &U, const model::Binary &Model) {
+getIntFormat(llvm::Instruction &I, llvm::Use &U, ModelTypeCache &TypeCache) {
   auto &Context = I.getContext();
 
   // We cannot print properly characters when they are part of switch
@@ -180,7 +191,7 @@ getIntFormat(llvm::Instruction &I, llvm::Use &U, const model::Binary &Model) {
       if (IntConstant->isZero()) {
         // If it's a ModelCast casting a zero constant to a pointer, then we
         // decorate the constant so that it's printed as NULL.
-        auto Type = fromLLVMString(Call->getArgOperand(0), Model);
+        const auto &Type = TypeCache.get(Call->getArgOperand(0));
         if (Type->isPointer())
           return FormatInt{ IntFormatting::NULLPTR, &U };
       }
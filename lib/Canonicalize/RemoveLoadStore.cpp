@@ -31,6 +31,7 @@ public:
 
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.addRequired<LoadModelWrapperPass>();
+    AU.addRequired<InitModelTypesAnalysis>();
     AU.setPreservesCFG();
   }
 };
@@ -70,11 +71,10 @@ bool RemoveLoadStore::runOnFunction(llvm::Function &F) {
   const auto
     &Model = getAnalysis<LoadModelWrapperPass>().get().getReadOnlyModel().get();
 
-  // Collect model types
-  auto TypeMap = initModelTypes(F,
-                                llvmToModelFunction(*Model, F),
-                                *Model,
-                                /* PointersOnly = */ false);
+  // Collect model types. This pass records the types of the calls it injects
+  // and doesn't preserve the analysis, so take the cached map over.
+  ModelTypesMap TypeMap = getAnalysis<InitModelTypesAnalysis>()
+                            .take(/* PointersOnly = */ false);
 
   // Initialize the IR builder to inject functions
   llvm::LLVMContext &LLVMCtx = F.getContext();
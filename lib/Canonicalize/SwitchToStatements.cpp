@@ -52,6 +52,7 @@ public:
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.setPreservesCFG();
     AU.addRequired<LoadModelWrapperPass>();
+    AU.addRequired<InitModelTypesAnalysis>();
   }
 
   bool runOnFunction(Function &F) override;
@@ -841,15 +842,13 @@ private:
   std::unordered_map<const Instruction *, size_t> ProgramOrdering;
 };
 
-using TypeMap = std::map<const Value *, const model::UpcastableType>;
-
 class VariableBuilder {
 public:
   VariableBuilder(Function &TheF,
                   const model::Binary &TheModel,
-                  TypeMap &&TMap) :
+                  const ModelTypesMap &TMap) :
     Model(TheModel),
-    TheTypeMap(std::move(TMap)),
+    TheTypeMap(TMap),
     F(TheF),
     Builder(TheF.getContext()),
     LocalVarPool(TheF.getParent(), false),
@@ -879,6 +878,7 @@ public:
                                         "Copy");
       auto *Copy = Builder.CreateCall(CopyFunction, { TheAddress });
       TheUse->set(Copy);
+      Changed = true;
     }
 
     for (Instruction *I : Picked.AssignToRemove) {
@@ -899,7 +899,7 @@ private:
 
 private:
   const model::Binary &Model;
-  const TypeMap TheTypeMap;
+  const ModelTypesMap &TheTypeMap;
   Function &F;
   IRBuilder<> Builder;
   OpaqueFunctionsPool<Type *> LocalVarPool;
@@ -1036,16 +1036,12 @@ bool SwitchToStatements::runOnFunction(Function &F) {
   auto &ModelWrapper = getAnalysis<LoadModelWrapperPass>().get();
   const TupleTree<model::Binary> &Model = ModelWrapper.getReadOnlyModel();
 
-  auto ModelFunction = llvmToModelFunction(*Model, F);
-  revng_assert(ModelFunction != nullptr);
+  auto &Types = getAnalysis<InitModelTypesAnalysis>();
 
   InstructionToSerializePicker InstructionPicker{ F, Graph, Result };
   VariableBuilder VarBuilder{ F,
                               *Model,
-                              initModelTypes(F,
-                                             ModelFunction,
-                                             *Model,
-                                             /*PointerOnly*/ false) };
+                              Types.get(/*PointerOnly*/ false) };
 
   bool Changed = VarBuilder.run(InstructionPicker.pick());
 
@@ -71,6 +71,8 @@ bool DLAPass::runOnModule(llvm::Module &M) {
   //
   // Graph optimization phase
   //
+  // Each weakly connected component is optimized on its own.
+  SM.splitComponents();
   revng_check(SM.addStep<dla::CollapseSingleChild>());
   revng_check(SM.addStep<dla::DeduplicateFields>());
   revng_check(SM.addStep<dla::MergePointeesOfPointerUnion>(PtrSize));
@@ -3,9 +3,11 @@
 //
 
 #include <algorithm>
+#include <limits>
 #include <string>
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
@@ -212,8 +214,9 @@ LayoutTypeSystemNode *LayoutTypeSystem::createArtificialLayoutType() {
   revng_assert(New);
   ++NID;
   EqClasses.growBy1();
-  bool Success = Layouts.insert(New).second;
-  revng_assert(Success);
+  revng_assert(New->ID == Layouts.size());
+  Layouts.push_back(New);
+  ++NumLayouts;
   return New;
 }
 
@@ -233,37 +236,28 @@ static void fixPredSucc(LayoutTypeSystemNode *From,
   uint64_t FromID = From->ID;
   using IDBasedKey = std::pair<uint64_t, const TypeLinkTag *>;
 
+  // Replace all the links to From in Neighbors with links to Into, preserving
+  // the tags.
+  const auto RedirectToInto = [FromID, Into](auto &Neighbors) {
+    auto It = Neighbors.lower_bound(IDBasedKey{ FromID, nullptr });
+    auto End = Neighbors.upper_bound(IDBasedKey{ FromID + 1, nullptr });
+    llvm::SmallVector<const TypeLinkTag *, 2> Tags;
+    for (const auto &[Neighbor, Tag] : llvm::make_range(It, End))
+      Tags.push_back(Tag);
+    Neighbors.erase(It, End);
+    for (const TypeLinkTag *Tag : Tags)
+      Neighbors.insert({ Into, Tag });
+  };
+
   // All the predecessors of all the successors of From are updated so that they
   // point to Into
-  for (auto &[Successor, Tag] : From->Successors) {
-    auto It = Successor->Predecessors.lower_bound(IDBasedKey{ FromID,
-                                                              nullptr });
-    auto End = Successor->Predecessors.upper_bound(IDBasedKey{ FromID + 1,
-                                                               nullptr });
-    while (It != End) {
-      auto Next = std::next(It);
-      auto Extracted = Successor->Predecessors.extract(It);
-      revng_assert(Extracted);
-      Successor->Predecessors.insert({ Into, Extracted.value().second });
-      It = Next;
-    }
-  }
+  for (auto &[Successor, Tag] : From->Successors)
+    RedirectToInto(Successor->Predecessors);
 
   // All the successors of all the predecessors of From are updated so that they
   // point to Into
-  for (auto &[Predecessor, Tag] : From->Predecessors) {
-    auto It = Predecessor->Successors.lower_bound(IDBasedKey{ FromID,
-                                                              nullptr });
-    auto End = Predecessor->Successors.upper_bound(IDBasedKey{ FromID + 1,
-                                                               nullptr });
-    while (It != End) {
-      auto Next = std::next(It);
-      auto Extracted = Predecessor->Successors.extract(It);
-      revng_assert(Extracted);
-      Predecessor->Successors.insert({ Into, Extracted.value().second });
-      It = Next;
-    }
-  }
+  for (auto &[Predecessor, Tag] : From->Predecessors)
+    RedirectToInto(Predecessor->Successors);
 
   // Merge all the predecessors and successors.
   {
@@ -292,6 +286,10 @@ static void fixPredSucc(LayoutTypeSystemNode *From,
 
 static Logger<> MergeLog("dla-merge-nodes");
 
+bool LayoutTypeSystem::isLoggingEnabled() {
+  return MergeLog.isEnabled();
+}
+
 void LayoutTypeSystem::mergeNodes(llvm::ArrayRef<LayoutTypeSystemNode *>
                                     ToMerge) {
   revng_assert(ToMerge.size() > 0ULL);
@@ -325,10 +323,7 @@ void LayoutTypeSystem::mergeNodes(llvm::ArrayRef<LayoutTypeSystemNode *>
     fixPredSucc(From, Into);
 
     // Remove From from Layouts
-    bool Erased = Layouts.erase(From);
-    revng_assert(Erased);
-    From->~LayoutTypeSystemNode();
-    NodeAllocator.Deallocate(From);
+    destroyNode(From);
   }
 }
 
@@ -354,70 +349,202 @@ void LayoutTypeSystem::removeNode(LayoutTypeSystemNode *ToRemove) {
     SuccOfPred.erase(It, End);
   }
 
-  bool Erased = Layouts.erase(ToRemove);
-  revng_assert(Erased);
-  ToRemove->~LayoutTypeSystemNode();
-  NodeAllocator.Deallocate(ToRemove);
+  destroyNode(ToRemove);
+}
+
+void LayoutTypeSystem::destroyNode(LayoutTypeSystemNode *N) {
+  revng_assert(hasLayout(N));
+  Layouts[N->ID] = nullptr;
+  --NumLayouts;
+  N->~LayoutTypeSystemNode();
+  NodeAllocator.Deallocate(N);
+}
+
+static void copyNodeContent(const LayoutTypeSystemNode &From,
+                            LayoutTypeSystemNode &To) {
+  To.Size = From.Size;
+  To.InterferingInfo = From.InterferingInfo;
+  To.NonScalar = From.NonScalar;
 }
 
-using NeighborIterator = LayoutTypeSystem::NeighborIterator;
+LayoutTypeSystem::ComponentVector LayoutTypeSystem::splitComponents() {
+  revng_assert(SplitNodes.empty());
+
+  ComponentVector Components;
+
+  // The index of the component of each node, and its copy in there, indexed by
+  // the ID of the node.
+  constexpr unsigned NoComponent = std::numeric_limits<unsigned>::max();
+  std::vector<unsigned> ComponentOf(Layouts.size(), NoComponent);
+  std::vector<LayoutTypeSystemNode *> Copies(Layouts.size(), nullptr);
+
+  // Each node that is not in a component yet is the one with the lowest ID of
+  // a new component, so the components are ordered by their lowest ID.
+  for (LayoutTypeSystemNode *Root : getLayoutsRange()) {
+    if (ComponentOf[Root->ID] != NoComponent)
+      continue;
+
+    unsigned Index = Components.size();
+    auto &Component = *Components.emplace_back(new LayoutTypeSystem());
+
+    llvm::SmallVector<LayoutTypeSystemNode *, 16> Members = { Root };
+    ComponentOf[Root->ID] = Index;
+    for (size_t I = 0; I < Members.size(); ++I) {
+      using NeighborsSet = LayoutTypeSystemNode::NeighborsSet;
+      for (const NeighborsSet *Neighbors :
+           { &Members[I]->Successors, &Members[I]->Predecessors }) {
+        for (const auto &[Neighbor, Tag] : *Neighbors) {
+          if (ComponentOf[Neighbor->ID] == NoComponent) {
+            ComponentOf[Neighbor->ID] = Index;
+            Members.push_back(Neighbor);
+          }
+        }
+      }
+    }
+
+    // Create the copies in the order of the original IDs, so that the
+    // neighbors of each node are visited in the same order.
+    llvm::sort(Members, [](const LayoutTypeSystemNode *LHS,
+                           const LayoutTypeSystemNode *RHS) {
+      return LHS->ID < RHS->ID;
+    });
+    for (LayoutTypeSystemNode *N : Members) {
+      LayoutTypeSystemNode *Copy = Component.createArtificialLayoutType();
+      copyNodeContent(*N, *Copy);
+      Copies[N->ID] = Copy;
+      SplitNodes.push_back({ N->ID, Index, Copy->ID });
+    }
+  }
+
+  for (LayoutTypeSystemNode *N : getLayoutsRange()) {
+    LayoutTypeSystem &Component = *Components[ComponentOf[N->ID]];
+    for (const auto &[Successor, Tag] : N->Successors)
+      Component.addLink(Copies[N->ID], Copies[Successor->ID], *Tag);
+  }
+
+  // All the edges of the original nodes go to other original nodes, so they
+  // can be destroyed without fixing their neighbors. Their equivalence classes
+  // are left untouched: joinComponents merges them with the classes of the
+  // nodes replacing them.
+  for (LayoutTypeSystemNode *N : getLayoutsRange())
+    destroyNode(N);
+  revng_assert(NumLayouts == 0);
+
+  return Components;
+}
+
+void LayoutTypeSystem::joinComponents(ComponentVector &&Components) {
+  revng_assert(NumLayouts == 0);
+
+  // The node replacing each node of each component, indexed by the index of
+  // the component and by the ID of the node in it.
+  std::vector<std::vector<LayoutTypeSystemNode *>> Copies(Components.size());
+  for (unsigned Index = 0; Index < Components.size(); ++Index) {
+    const LayoutTypeSystem *Component = Components[Index].get();
+    Copies[Index].resize(Component->Layouts.size(), nullptr);
+    for (LayoutTypeSystemNode *N : Component->getLayoutsRange()) {
+      LayoutTypeSystemNode *Copy = createArtificialLayoutType();
+      copyNodeContent(*N, *Copy);
+      Copies[Index][N->ID] = Copy;
+    }
+  }
+
+  for (unsigned Index = 0; Index < Components.size(); ++Index) {
+    const LayoutTypeSystem *Component = Components[Index].get();
+    const auto &ComponentCopies = Copies[Index];
+    for (LayoutTypeSystemNode *N : Component->getLayoutsRange())
+      for (const auto &[Successor, Tag] : N->Successors)
+        addLink(ComponentCopies[N->ID], ComponentCopies[Successor->ID], *Tag);
+  }
+
+  // In each component, every equivalence class that has not been removed has
+  // exactly one node left. Find it through the leader of the class.
+  std::vector<llvm::DenseMap<unsigned, LayoutTypeSystemNode *>>
+    NodeOfLeader(Components.size());
+  for (unsigned Index = 0; Index < Components.size(); ++Index) {
+    const LayoutTypeSystem *Component = Components[Index].get();
+    const VectEqClasses &ComponentClasses = Component->EqClasses;
+    for (LayoutTypeSystemNode *N : Component->getLayoutsRange()) {
+      unsigned Leader = ComponentClasses.findLeader(N->ID);
+      NodeOfLeader[Index][Leader] = Copies[Index][N->ID];
+    }
+  }
+
+  for (const SplitNode &Split : SplitNodes) {
+    const VectEqClasses &ComponentClasses = Components[Split.Component]
+                                              ->EqClasses;
+    if (ComponentClasses.isRemoved(Split.ComponentID)) {
+      EqClasses.remove(Split.OriginalID);
+      continue;
+    }
+
+    unsigned Leader = ComponentClasses.findLeader(Split.ComponentID);
+    LayoutTypeSystemNode *Replacement = NodeOfLeader[Split.Component]
+                                          .lookup(Leader);
+    revng_assert(Replacement != nullptr);
+    EqClasses.join(Split.OriginalID, Replacement->ID);
+  }
+
+  SplitNodes.clear();
+  Components.clear();
+}
 
 static void moveEdgeTargetWithoutSumming(LayoutTypeSystemNode *OldTgt,
                                          LayoutTypeSystemNode *NewTgt,
-                                         NeighborIterator InverseEdgeIt) {
+                                         const LayoutTypeSystemNode::Link
+                                           &InverseEdge) {
+  const auto &[Src, Tag] = InverseEdge;
 
   // First, move the successor from OldTgt to NewTgt
-  LayoutTypeSystemNode *Src = InverseEdgeIt->first;
-  auto SuccHandle = Src->Successors.extract({ OldTgt, InverseEdgeIt->second });
-  revng_assert(not SuccHandle.empty());
-  SuccHandle.value().first = NewTgt;
-  Src->Successors.insert(std::move(SuccHandle));
+  bool Erased = Src->Successors.erase({ OldTgt, Tag });
+  revng_assert(Erased);
+  Src->Successors.insert({ NewTgt, Tag });
 
   // Then, move the predecessor edge from OldTgt to NewTgt
-  auto PredHandle = OldTgt->Predecessors.extract(InverseEdgeIt);
-  revng_assert(not PredHandle.empty());
-  NewTgt->Predecessors.insert(std::move(PredHandle));
+  Erased = OldTgt->Predecessors.erase(InverseEdge);
+  revng_assert(Erased);
+  NewTgt->Predecessors.insert(InverseEdge);
 }
 
 static void moveEdgeSourceWithoutSumming(LayoutTypeSystemNode *OldSrc,
                                          LayoutTypeSystemNode *NewSrc,
-                                         NeighborIterator EdgeIt) {
+                                         const LayoutTypeSystemNode::Link
+                                           &Edge) {
+  const auto &[Tgt, Tag] = Edge;
+
   // First, move the predecessor edge from OldSrc to NewSrc.
-  LayoutTypeSystemNode *Tgt = EdgeIt->first;
-  auto PredHandle = Tgt->Predecessors.extract({ OldSrc, EdgeIt->second });
-  revng_assert(not PredHandle.empty());
-  PredHandle.value().first = NewSrc;
-  Tgt->Predecessors.insert(std::move(PredHandle));
+  bool Erased = Tgt->Predecessors.erase({ OldSrc, Tag });
+  revng_assert(Erased);
+  Tgt->Predecessors.insert({ NewSrc, Tag });
 
   // Then, move the successor edge from OldSrc to NewSrc
-  auto SuccHandle = OldSrc->Successors.extract(EdgeIt);
-  revng_assert(not SuccHandle.empty());
-  NewSrc->Successors.insert(std::move(SuccHandle));
+  Erased = OldSrc->Successors.erase(Edge);
+  revng_assert(Erased);
+  NewSrc->Successors.insert(Edge);
 }
 
 void LayoutTypeSystem::moveEdgeTarget(LayoutTypeSystemNode *OldTgt,
                                       LayoutTypeSystemNode *NewTgt,
-                                      NeighborIterator InverseEdgeIt,
+                                      Link InverseEdge,
                                       int64_t OffsetToSum) {
 
   if (not OldTgt or not NewTgt)
     return;
 
   if (not OffsetToSum)
-    return moveEdgeTargetWithoutSumming(OldTgt, NewTgt, InverseEdgeIt);
+    return moveEdgeTargetWithoutSumming(OldTgt, NewTgt, InverseEdge);
 
-  LayoutTypeSystemNode *Src = InverseEdgeIt->first;
+  const auto &[Src, EdgeTag] = InverseEdge;
 
   // Erase info in Src that represent the fact that OldTgt was a successor.
-  bool Erased = Src->Successors.erase({ OldTgt, InverseEdgeIt->second });
+  bool Erased = Src->Successors.erase({ OldTgt, EdgeTag });
   revng_assert(Erased);
 
-  // Extract the predecessor edge to be moved from OldTgt to NewTgt
-  auto OldPredHandle = OldTgt->Predecessors.extract(InverseEdgeIt);
-  revng_assert(not OldPredHandle.empty());
+  // Erase the predecessor edge to be moved from OldTgt to NewTgt
+  Erased = OldTgt->Predecessors.erase(InverseEdge);
+  revng_assert(Erased);
 
   // Add new instance links with adjusted offsets from Src to NewTgt.
-  const TypeLinkTag *EdgeTag = OldPredHandle.value().second;
   switch (EdgeTag->getKind()) {
 
   case TypeLinkTag::LK_Instance: {
@@ -435,27 +562,26 @@ void LayoutTypeSystem::moveEdgeTarget(LayoutTypeSystemNode *OldTgt,
 
 void LayoutTypeSystem::moveEdgeSource(LayoutTypeSystemNode *OldSrc,
                                       LayoutTypeSystemNode *NewSrc,
-                                      NeighborIterator EdgeIt,
+                                      Link Edge,
                                       int64_t OffsetToSum) {
 
   if (not OldSrc or not NewSrc)
     return;
 
   if (not OffsetToSum)
-    return moveEdgeSourceWithoutSumming(OldSrc, NewSrc, EdgeIt);
+    return moveEdgeSourceWithoutSumming(OldSrc, NewSrc, Edge);
 
-  LayoutTypeSystemNode *Tgt = EdgeIt->first;
+  const auto &[Tgt, EdgeTag] = Edge;
 
   // Erase info in Tgt that represent the fact that OldSrc was a predecessor.
-  bool Erased = Tgt->Predecessors.erase({ OldSrc, EdgeIt->second });
+  bool Erased = Tgt->Predecessors.erase({ OldSrc, EdgeTag });
   revng_assert(Erased);
 
-  // Extract the successor edge to be moved from OldSrc to NewSrc
-  auto OldSuccHandle = OldSrc->Successors.extract(EdgeIt);
-  revng_assert(not OldSuccHandle.empty());
+  // Erase the successor edge to be moved from OldSrc to NewSrc
+  Erased = OldSrc->Successors.erase(Edge);
+  revng_assert(Erased);
 
   // Add new instance links with adjusted offsets from NewSrc to Tgt.
-  const TypeLinkTag *EdgeTag = OldSuccHandle.value().second;
   switch (EdgeTag->getKind()) {
 
   case TypeLinkTag::LK_Instance: {
@@ -471,29 +597,27 @@ void LayoutTypeSystem::moveEdgeSource(LayoutTypeSystemNode *OldSrc,
   }
 }
 
-NeighborIterator LayoutTypeSystem::eraseEdge(LayoutTypeSystemNode *Src,
-                                             NeighborIterator EdgeIt) {
-  LayoutTypeSystemNode *Tgt = EdgeIt->first;
+void LayoutTypeSystem::eraseEdge(LayoutTypeSystemNode *Src, Link Edge) {
+  const auto &[Tgt, Tag] = Edge;
 
   // Erase the inverse edge from Tgt to Src
-  bool Erased = Tgt->Predecessors.erase({ Src, EdgeIt->second });
+  bool Erased = Tgt->Predecessors.erase({ Src, Tag });
   revng_assert(Erased);
 
   // Erase the actual forward edge from Src to Tgt
-  return Src->Successors.erase(EdgeIt);
+  Erased = Src->Successors.erase(Edge);
+  revng_assert(Erased);
 }
 
 void LayoutTypeSystem::dropOutgoingEdges(LayoutTypeSystemNode *N) {
-  auto It = N->Successors.begin();
-  auto End = N->Successors.end();
-  while (It != End)
-    It = eraseEdge(N, It);
+  while (not N->Successors.empty())
+    eraseEdge(N, *N->Successors.begin());
 }
 
 static Logger<> VerifyDLALog("dla-verify-strict");
 
 bool LayoutTypeSystem::verifyConsistency() const {
-  for (LayoutTypeSystemNode *NodePtr : Layouts) {
+  for (LayoutTypeSystemNode *NodePtr : getLayoutsRange()) {
     if (not NodePtr) {
       if (VerifyDLALog.isEnabled())
         revng_check(false);
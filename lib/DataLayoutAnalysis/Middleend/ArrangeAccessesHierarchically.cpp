@@ -120,27 +120,26 @@ getVolatileChildren(LayoutTypeSystemNode *Parent) {
   return Result;
 }
 
-using NeighborIterator = LayoutTypeSystem::NeighborIterator;
+using Link = LayoutTypeSystemNode::Link;
 
 // This struct represents if an edge in LayoutTypeSystem can be pushed down
 // another edge in LayoutTypeSystem, along with the resulting OffsetExpression
 // if the push down takes place.
 struct PushThroughComparisonResult {
-  NeighborIterator ToPush;
-  NeighborIterator Through;
+  Link ToPush;
+  Link Through;
   OffsetExpression OEAfterPush;
 };
 
 static OffsetExpression
-computeOffsetAfterPush(NeighborIterator ToBePushed,
-                       NeighborIterator ToBePushedThrough) {
+computeOffsetAfterPush(const Link &ToBePushed, const Link &ToBePushedThrough) {
   OffsetExpression Final;
 
-  revng_assert(isInstanceEdge(*ToBePushed));
-  revng_assert(isInstanceEdge(*ToBePushedThrough));
+  revng_assert(isInstanceEdge(ToBePushed));
+  revng_assert(isInstanceEdge(ToBePushedThrough));
 
-  const auto &ToPushOE = ToBePushed->second->getOffsetExpr();
-  const auto &ThroughOE = ToBePushedThrough->second->getOffsetExpr();
+  const auto &ToPushOE = ToBePushed.second->getOffsetExpr();
+  const auto &ThroughOE = ToBePushedThrough.second->getOffsetExpr();
 
   revng_assert(ToPushOE.Strides.empty() or ToPushOE.Strides.size() == 1);
   revng_assert(ThroughOE.Strides.empty() or ThroughOE.Strides.size() == 1);
@@ -169,37 +168,36 @@ computeOffsetAfterPush(NeighborIterator ToBePushed,
     Final.Offset %= ThroughOE.Strides.front();
   }
 
-  uint64_t ThroughElemSize = ToBePushedThrough->first->Size;
-  uint64_t PushedFieldSize = getFieldSize(ToBePushed->first,
-                                          ToBePushed->second);
+  uint64_t ThroughElemSize = ToBePushedThrough.first->Size;
+  uint64_t PushedFieldSize = getFieldSize(ToBePushed.first, ToBePushed.second);
   revng_assert(ThroughElemSize >= PushedFieldSize + Final.Offset);
 
   return Final;
 }
 
-// Compare the edges *AIt and *BIt to check if any of them can be pushed through
-// the other. If so return proper info.
+// Compare the edges A and B to check if any of them can be pushed through the
+// other. If so return proper info.
 static std::optional<PushThroughComparisonResult>
-canPushThrough(const NeighborIterator &AIt, const NeighborIterator &BIt) {
+canPushThrough(const Link &A, const Link &B) {
   revng_log(Log, "canPushThrough");
   LoggerIndent Indent{ Log };
 
   // An edge can never be pushed through itself
-  if (AIt == BIt) {
+  if (A == B) {
     revng_log(Log, "nullopt: same");
     return std::nullopt;
   }
 
   // If any edge is not an instance edge, the edges are not comparable.
-  if (not isInstanceEdge(*AIt) or not isInstanceEdge(*BIt)) {
+  if (not isInstanceEdge(A) or not isInstanceEdge(B)) {
     revng_log(Log, "nullopt: not instance");
     return std::nullopt;
   }
 
   // Here both edges are instance edges.
 
-  const auto &[AChild, ATag] = *AIt;
-  const auto &[BChild, BTag] = *BIt;
+  const auto &[AChild, ATag] = A;
+  const auto &[BChild, BTag] = B;
 
   if (isLeaf(AChild) and isLeaf(BChild)) {
     revng_log(Log, "nullopt: child");
@@ -260,8 +258,8 @@ canPushThrough(const NeighborIterator &AIt, const NeighborIterator &BIt) {
   // Detect what is the case.
   bool AIsOuter = AFieldSize > BFieldSize;
 
-  auto OuterIt = AIsOuter ? AIt : BIt;
-  const auto &[Outer, OuterTag] = *OuterIt;
+  const Link &OuterEdge = AIsOuter ? A : B;
+  const auto &[Outer, OuterTag] = OuterEdge;
 
   // If the larger node is a leaf we cannot push the other down, so we bail out.
   if (isLeaf(Outer)) {
@@ -269,8 +267,8 @@ canPushThrough(const NeighborIterator &AIt, const NeighborIterator &BIt) {
     return std::nullopt;
   }
 
-  auto InnerIt = AIsOuter ? BIt : AIt;
-  const auto &[Inner, InnerTag] = *InnerIt;
+  const Link &InnerEdge = AIsOuter ? B : A;
+  const auto &[Inner, InnerTag] = InnerEdge;
 
   const auto &InnerOffset = InnerTag->getOffsetExpr().Offset;
   const auto &[OuterOffset, OuterStrides, _] = OuterTag->getOffsetExpr();
@@ -293,27 +291,12 @@ canPushThrough(const NeighborIterator &AIt, const NeighborIterator &BIt) {
   }
 
   return PushThroughComparisonResult{
-    .ToPush = InnerIt,
-    .Through = OuterIt,
-    .OEAfterPush = computeOffsetAfterPush(InnerIt, OuterIt)
+    .ToPush = InnerEdge,
+    .Through = OuterEdge,
+    .OEAfterPush = computeOffsetAfterPush(InnerEdge, OuterEdge)
   };
 }
 
-// Helper ordering for NeighborIterators. We need it here because we need to use
-// such iterators and keys in associative containers.
-// Notice that this might have undefined behaviour if dereferencing either LHS
-// or RHS is undefined behaviour itself.
-// The bottom line is that we should never insert invalid iterators into
-// associative containers.
-static std::weak_ordering operator<=>(const NeighborIterator &LHS,
-                                      const NeighborIterator &RHS) {
-  const auto &[LHSSucc, LHSTag] = *LHS;
-  const auto &[RHSSucc, RHSTag] = *RHS;
-  if (auto Cmp = LHSSucc <=> RHSSucc; Cmp != 0)
-    return Cmp;
-  return LHSTag <=> RHSTag;
-}
-
 static llvm::SmallPtrSet<LayoutTypeSystemNode *, 8>
 absorbVolatileChildren(LayoutTypeSystem &TS, LayoutTypeSystemNode *Parent) {
   revng_log(Log, "absorbVolatileChildren of: " << Parent->ID);
@@ -395,6 +378,10 @@ static void absorbVolatileChildren(LayoutTypeSystem &TS) {
   }
 }
 
+bool ArrangeAccessesHierarchically::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool ArrangeAccessesHierarchically::runOnTypeSystem(LayoutTypeSystem &TS) {
   if (VerifyLog.isEnabled())
     revng_assert(TS.verifyDAG());
@@ -471,37 +458,29 @@ bool ArrangeAccessesHierarchically::runOnTypeSystem(LayoutTypeSystem &TS) {
           ToAnalyze.erase(A);
       }
 
-      // Represents an edge iterator pointing to an instance edge, along with an
-      // OffsetExpression that is not the one currently attached to the instance
-      // edge, but that it is used to move the edge around.
+      // Represents an instance edge, along with an OffsetExpression that is not
+      // the one currently attached to the instance edge, but that it is used to
+      // move the edge around.
       struct EdgeWithOffset {
-        NeighborIterator Edge;
+        Link Edge;
         OffsetExpression FinalOE;
       };
 
       revng_log(Log, "Initialize ChildrenHierarchy");
-      // A map whose key is an edge iterator representing an instance edge, and
-      // the mapped type is a vector of other edges that can be pushed through
-      // the key, along the updated offsets that they will have after pushing
-      // them through it.
-      // In particular, we only keep in this map the neighbor iterator that are
-      // the roots of the hierarchy of instance edges, i.e. the instance edges
-      // that cannot be pushed through any other edge.
-      std::map<NeighborIterator, llvm::SmallVector<EdgeWithOffset>>
-        ChildrenHierarchy;
-
-      using GT = llvm::GraphTraits<LayoutTypeSystemNode *>;
+      // A map whose key is an instance edge, and the mapped type is a vector
+      // of other edges that can be pushed through the key, along the updated
+      // offsets that they will have after pushing them through it.
+      // In particular, we only keep in this map the edges that are the roots
+      // of the hierarchy of instance edges, i.e. the instance edges that cannot
+      // be pushed through any other edge.
+      std::map<Link, llvm::SmallVector<EdgeWithOffset>> ChildrenHierarchy;
 
       // Initialize the ChildrenHierarchy.
       // At the beginning, all children edges are roots, and none of them has
       // other edges that can be pushed through them.
-      for (auto AIt = GT::child_edge_begin(Parent),
-                ChildEnd = GT::child_edge_end(Parent);
-           AIt != ChildEnd;
-           ++AIt) {
-        if (isInstanceEdge(*AIt))
-          ChildrenHierarchy[AIt];
-      }
+      for (const Link &AEdge : Parent->Successors)
+        if (isInstanceEdge(AEdge))
+          ChildrenHierarchy[AEdge];
 
       revng_log(Log, "Compare children edges");
       // Now compare each root only with other roots
@@ -511,49 +490,49 @@ bool ArrangeAccessesHierarchically::runOnTypeSystem(LayoutTypeSystem &TS) {
       for (; ARootIt != HierarchyEnd; ARootIt = ARootNext) {
         LoggerIndent ChildIndent{ Log };
 
-        auto &[AEdgeIt, PushedInsideA] = *ARootIt;
+        auto &[AEdge, PushedInsideA] = *ARootIt;
 
         revng_log(Log,
-                  "comparing AEdge: " << AEdgeIt->first->ID
-                                      << " label: " << AEdgeIt->second);
+                  "comparing AEdge: " << AEdge.first->ID
+                                      << " label: " << AEdge.second);
 
-        // A vector of instance edges that are contained in AEdgeIt and that
+        // A vector of instance edges that are contained in AEdge and that
         // should be pushed through it, along with the new offsets they will
         // have after the push through.
         llvm::SmallVector<EdgeWithOffset> ContainedInA;
 
-        // A vector of instance edges that contain AEdgeIt. AEdgeIt will have to
+        // A vector of instance edges that contain AEdge. AEdge will have to
         // be pushed through all of them. The FinalOE in EdgeWithOffset here
-        // represents the new offset that AEdgeIt will have after being pushed
+        // represents the new offset that AEdge will have after being pushed
         // through them.
         llvm::SmallVector<EdgeWithOffset> ContainsA;
 
         for (auto BRootIt = ARootNext; BRootIt != HierarchyEnd; ++BRootIt) {
           LoggerIndent OtherChildIndent{ Log };
 
-          auto &[BEdgeIt, ContainedInB] = *BRootIt;
+          auto &[BEdge, ContainedInB] = *BRootIt;
           revng_log(Log,
-                    "with BEdge: " << BEdgeIt->first->ID
-                                   << " label: " << BEdgeIt->second);
+                    "with BEdge: " << BEdge.first->ID
+                                   << " label: " << BEdge.second);
 
-          auto MaybePushThrough = canPushThrough(AEdgeIt, BEdgeIt);
+          auto MaybePushThrough = canPushThrough(AEdge, BEdge);
           if (not MaybePushThrough.has_value())
             continue;
 
           auto &[ToPush, Through, OEAfterPush] = MaybePushThrough.value();
-          revng_assert(ToPush == AEdgeIt or ToPush == BEdgeIt);
-          revng_assert(Through == AEdgeIt or Through == BEdgeIt);
+          revng_assert(ToPush == AEdge or ToPush == BEdge);
+          revng_assert(Through == AEdge or Through == BEdge);
           revng_assert(Through != ToPush);
-          if (ToPush == AEdgeIt) {
-            revng_assert(Through == BEdgeIt);
-            // AEdgeIt can be pushed inside BEdgeIt
-            auto BWithNewAOffset = EdgeWithOffset{ BEdgeIt,
+          if (ToPush == AEdge) {
+            revng_assert(Through == BEdge);
+            // AEdge can be pushed inside BEdge
+            auto BWithNewAOffset = EdgeWithOffset{ BEdge,
                                                    std::move(OEAfterPush) };
             ContainsA.push_back(std::move(BWithNewAOffset));
           } else {
-            revng_assert(ToPush == BEdgeIt and Through == AEdgeIt);
-            // BEdgeIt can be pushed inside AEdgeIt
-            auto BWithNewBOffset = EdgeWithOffset{ BEdgeIt,
+            revng_assert(ToPush == BEdge and Through == AEdge);
+            // BEdge can be pushed inside AEdge
+            auto BWithNewBOffset = EdgeWithOffset{ BEdge,
                                                    std::move(OEAfterPush) };
             ContainedInA.push_back(std::move(BWithNewBOffset));
           }
@@ -589,18 +568,18 @@ bool ArrangeAccessesHierarchically::runOnTypeSystem(LayoutTypeSystem &TS) {
               PushedThroughLargerThanA.push_back(EdgeWithOffset{
                 EdgeToPush, computeOffsetAfterPush(EdgeToPush, LargerThanA) });
             }
-            // Then also AEdgeIt can be pushed through LargerThanA. The final
-            // offset of AEdgeIt after being pushed through has already been
+            // Then also AEdge can be pushed through LargerThanA. The final
+            // offset of AEdge after being pushed through has already been
             // computed in advance, so we just use that.
-            PushedThroughLargerThanA.push_back({ AEdgeIt, std::move(FinalOE) });
+            PushedThroughLargerThanA.push_back({ AEdge, std::move(FinalOE) });
           }
-          // Now AEdgeIt is not a root anymore, so we have to erase it and
+          // Now AEdge is not a root anymore, so we have to erase it and
           // update ARootNext.
           ARootNext = ChildrenHierarchy.erase(ARootIt);
         }
       }
 
-      llvm::SmallSet<NeighborIterator, 4> EdgesToErase;
+      llvm::SmallSet<Link, 4> EdgesToErase;
       {
         revng_log(Log, "Collect EdgesToErase");
         LoggerIndent IndentCollect{ Log };
@@ -609,12 +588,12 @@ bool ArrangeAccessesHierarchically::runOnTypeSystem(LayoutTypeSystem &TS) {
           if (EdgesToPush.empty())
             continue;
 
-          auto *ToPushThrough = EdgeToPushThrough->first;
+          auto *ToPushThrough = EdgeToPushThrough.first;
           ToAnalyze.insert(ToPushThrough);
 
-          for (auto &[PushedEdgeIt, FinalOE] : EdgesToPush) {
-            EdgesToErase.insert(PushedEdgeIt);
-            auto *ToPushDown = PushedEdgeIt->first;
+          for (auto &[PushedEdge, FinalOE] : EdgesToPush) {
+            EdgesToErase.insert(PushedEdge);
+            auto *ToPushDown = PushedEdge.first;
 
             revng_assert(not isLeaf(ToPushThrough));
             TS.addInstanceLink(ToPushThrough, ToPushDown, std::move(FinalOE));
@@ -628,8 +607,8 @@ bool ArrangeAccessesHierarchically::runOnTypeSystem(LayoutTypeSystem &TS) {
         LoggerIndent IndentErase{ Log };
         for (const auto &ToErase : EdgesToErase) {
           revng_log(Log,
-                    "erase: " << Parent->ID << " -> " << ToErase->first->ID
-                              << " label: " << ToErase->second);
+                    "erase: " << Parent->ID << " -> " << ToErase.first->ID
+                              << " label: " << ToErase.second);
           TS.eraseEdge(Parent, ToErase);
         }
       }
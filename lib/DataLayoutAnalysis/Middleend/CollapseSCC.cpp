@@ -10,7 +10,6 @@
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SetVector.h"
-#include "llvm/Support/Progress.h"
 
 #include "revng/ADT/FilteredGraphTraits.h"
 #include "revng/Support/Debug.h"
@@ -134,15 +133,8 @@ static bool collapseSCCs(LayoutTypeSystem &TS) {
       // For each leader we erase all the non-pointer edges going to other
       // leaders.
       auto *Leader = *LeaderIt;
-      using DLAGraph = llvm::GraphTraits<LayoutTypeSystemNode *>;
-      auto EdgeIt = DLAGraph::child_edge_begin(Leader);
-      auto EdgeEnd = DLAGraph::child_edge_end(Leader);
-      auto EdgeNext = DLAGraph::child_edge_end(Leader);
-
-      for (; EdgeIt != EdgeEnd; EdgeIt = EdgeNext) {
-
-        EdgeNext = std::next(EdgeIt);
-        auto &Edge = *EdgeIt;
+      llvm::SmallVector<LayoutTypeSystemNode::Link> ToErase;
+      for (const auto &Edge : Leader->Successors) {
 
         // Skip pointers
         if (isPointerEdge(Edge))
@@ -154,9 +146,12 @@ static bool collapseSCCs(LayoutTypeSystem &TS) {
         if (not Leaders.contains(Child))
           continue;
 
-        TS.eraseEdge(Leader, EdgeIt);
+        ToErase.push_back(Edge);
       }
 
+      for (const auto &Edge : ToErase)
+        TS.eraseEdge(Leader, Edge);
+
       // Then, for each leader, we add an instance-at-offset-0 edge to the next
       // leader, which is the one with immediately lower size.
       if (auto NextLeaderIt = std::next(LeaderIt); NextLeaderIt != LeaderEnd)
@@ -175,6 +170,10 @@ static bool collapseInstanceAtOffset0SCC(LayoutTypeSystem &TS) {
   return collapseSCCs<InstanceOffset0EdgeT>(TS);
 }
 
+bool CollapseEqualitySCC::isLoggingEnabled() const {
+  return LogVerbose.isEnabled();
+}
+
 bool CollapseEqualitySCC::runOnTypeSystem(LayoutTypeSystem &TS) {
 
   if (VerifyLog.isEnabled())
@@ -192,13 +191,14 @@ bool CollapseEqualitySCC::runOnTypeSystem(LayoutTypeSystem &TS) {
   return Changed;
 }
 
-bool CollapseInstanceAtOffset0SCC::runOnTypeSystem(LayoutTypeSystem &TS) {
-  Task T(2, "runOnTypeSystem");
+bool CollapseInstanceAtOffset0SCC::isLoggingEnabled() const {
+  return LogVerbose.isEnabled() or isRemoveBackedgesLoggingEnabled();
+}
 
+bool CollapseInstanceAtOffset0SCC::runOnTypeSystem(LayoutTypeSystem &TS) {
   if (VerifyLog.isEnabled())
     revng_assert(TS.verifyConsistency());
 
-  T.advance("collapseInstanceAtOffset0SCC");
   revng_log(LogVerbose, "#### Collapsing Instance-at-offset-0 SCC: ... ");
   bool Changed = collapseInstanceAtOffset0SCC(TS);
   revng_log(LogVerbose, "#### Collapsing Instance-at-offset-0 SCC: Done!");
@@ -208,7 +208,6 @@ bool CollapseInstanceAtOffset0SCC::runOnTypeSystem(LayoutTypeSystem &TS) {
     revng_assert(TS.verifyInstanceAtOffset0DAG());
   }
 
-  T.advance("removeInstanceBackedgesFromInstanceAtOffset0Loops");
   Changed |= removeInstanceBackedgesFromInstanceAtOffset0Loops(TS);
 
   if (VerifyLog.isEnabled()) {
@@ -24,23 +24,7 @@ getTripCount(uint64_t StartOffset, uint64_t EndOffset, uint64_t Stride) {
 
 namespace dla {
 
-using NeighborIterator = LayoutTypeSystem::NeighborIterator;
-
-// Helper ordering for NeighborIterators. We need it here because we need to use
-// such iterators and keys in associative containers, and we want neighbors with
-// lower offset to come first.
-// Notice that this might have undefined behavior if dereferencing either LHS
-// or RHS is undefined behavior itself.
-// The bottom line is that we should never insert invalid iterators into
-// associative containers.
-static std::weak_ordering operator<=>(const NeighborIterator &LHS,
-                                      const NeighborIterator &RHS) {
-  const auto &[LHSSucc, LHSTag] = *LHS;
-  const auto &[RHSSucc, RHSTag] = *RHS;
-  if (auto Cmp = LHSTag <=> RHSTag; Cmp != 0)
-    return Cmp;
-  return LHSSucc <=> RHSSucc;
-}
+using Link = LayoutTypeSystemNode::Link;
 
 struct InstanceEdge {
   OffsetExpression OE;
@@ -290,9 +274,9 @@ using llvm::SetVector;
 using llvm::SmallSet;
 using llvm::SmallVector;
 
-using CompactedEdgeVector = SetVector<NeighborIterator,
-                                      SmallVector<NeighborIterator, 8>,
-                                      SmallSet<NeighborIterator, 8>>;
+using CompactedEdgeVector = SetVector<Link,
+                                      SmallVector<Link, 8>,
+                                      SmallSet<Link, 8>>;
 
 template<bool StridedEdges>
 static CompactedArrayInfo
@@ -312,7 +296,7 @@ getEdgeToCompactWithCurrent(LayoutTypeSystemNode *Parent,
     SiblingEdgeNext = std::next(SiblingEdgeIt);
 
     // If we have already compacted that, skip it.
-    if (CompactedWithCurrent.count(SiblingEdgeIt) > 0)
+    if (CompactedWithCurrent.count(*SiblingEdgeIt) > 0)
       continue;
 
     // Ignore edges that shouldn't be considered.
@@ -380,7 +364,7 @@ getEdgeToCompactWithCurrent(LayoutTypeSystemNode *Parent,
 
     // Here we know that ArraySibling can be compacted with the current
     // array we're tracking.
-    CompactedWithCurrent.insert(SiblingEdgeIt);
+    CompactedWithCurrent.insert(ArraySiblingEdge);
   }
   return Current;
 }
@@ -406,15 +390,15 @@ bool CompactCompatibleArrays::runOnTypeSystem(LayoutTypeSystem &TS) {
       if (isLeaf(Parent))
         continue;
 
-      auto ChildEdgeIt = GT::child_edge_begin(Parent);
-      auto ChildEdgeNext = ChildEdgeIt;
-      auto ChildEdgeEnd = GT::child_edge_end(Parent);
-      for (; ChildEdgeIt != ChildEdgeEnd; ChildEdgeIt = ChildEdgeNext) {
+      auto ChildEdgeIt = Parent->Successors.begin();
+      while (ChildEdgeIt != Parent->Successors.end()) {
 
-        ChildEdgeNext = std::next(ChildEdgeIt);
+        // Copy the edge, since compacting erases and adds successors of
+        // Parent, invalidating ChildEdgeIt.
+        const Link ArrayEdge = *ChildEdgeIt;
+        ChildEdgeIt = std::next(ChildEdgeIt);
 
         // Ignore edges that are not strided.
-        const auto &ArrayEdge = *ChildEdgeIt;
         if (not isStridedInstance(ArrayEdge))
           continue;
 
@@ -436,7 +420,7 @@ bool CompactCompatibleArrays::runOnTypeSystem(LayoutTypeSystem &TS) {
         // If we find an ArraySibling that strongly overlaps with the array
         // we're tracking we compact them and update our Current.
         CompactedEdgeVector CompactedWithCurrent = {};
-        CompactedWithCurrent.insert(ChildEdgeIt);
+        CompactedWithCurrent.insert(ArrayEdge);
 
         // Compact with strided edges first.
         Current = getEdgeToCompactWithCurrent<true>(Parent,
@@ -458,8 +442,8 @@ bool CompactCompatibleArrays::runOnTypeSystem(LayoutTypeSystem &TS) {
 
           // Helper lambda to compact the various components into the compacted
           // array.
-          auto Compact = [&](const NeighborIterator &ToCompactIt) {
-            auto &[TargetNode, EdgeTag] = *ToCompactIt;
+          auto Compact = [&](const Link &ToCompact) {
+            auto &[TargetNode, EdgeTag] = ToCompact;
             uint64_t OldOffset = EdgeTag->getOffsetExpr().Offset;
             revng_assert(OldOffset >= Current.StartOffset);
             uint64_t OffsetInArray = (OldOffset - Current.StartOffset)
@@ -467,20 +451,15 @@ bool CompactCompatibleArrays::runOnTypeSystem(LayoutTypeSystem &TS) {
             TS.addInstanceLink(New,
                                TargetNode,
                                OffsetExpression{ OffsetInArray });
-            return TS.eraseEdge(Parent, ToCompactIt);
+            TS.eraseEdge(Parent, ToCompact);
           };
 
           // Compact all the array components.
           const auto VectorToCompact = CompactedWithCurrent.takeVector();
-          revng_assert(VectorToCompact.front() == ChildEdgeIt);
-          for (const NeighborIterator &ToCompact :
-               llvm::drop_begin(VectorToCompact))
+          revng_assert(VectorToCompact.front() == ArrayEdge);
+          for (const Link &ToCompact : VectorToCompact)
             Compact(ToCompact);
 
-          // We compact ChildEdgeIt as last, so that it updates ChildEdgeNext
-          // properly to continue the outer iteration.
-          ChildEdgeNext = Compact(ChildEdgeIt);
-
           OffsetExpression NewStridedOffset{ Current.StartOffset };
           NewStridedOffset.Strides.push_back(Current.Stride);
           NewStridedOffset.TripCounts
@@ -488,9 +467,14 @@ bool CompactCompatibleArrays::runOnTypeSystem(LayoutTypeSystem &TS) {
                                     Current.EndOffset,
                                     Current.Stride));
           TS.addInstanceLink(Parent, New, std::move(NewStridedOffset));
+
+          // Continue the outer iteration from the first edge following
+          // ArrayEdge. The new edge from Parent to New follows all the others,
+          // since New is the most recently created node, so it is visited too.
+          ChildEdgeIt = Parent->Successors.upper_bound(ArrayEdge);
         } else {
           revng_assert(CompactedWithCurrent.size() == 1);
-          revng_assert(CompactedWithCurrent.front() == ChildEdgeIt);
+          revng_assert(CompactedWithCurrent.front() == ArrayEdge);
         }
       }
     }
@@ -34,7 +34,7 @@ bool CollapseSingleChild::collapseSingle(LayoutTypeSystem &TS,
   // Get nodes that have a single instance-at-offset-0 child
   bool Merged = true;
   while (Merged and HasSingleNonStridedChild(Node)) {
-    auto &ChildEdge = *(Node->Successors.begin());
+    LTSN::Link ChildEdge = *(Node->Successors.begin());
     auto &Off = ChildEdge.second->getOffsetExpr().Offset;
     LTSN *Child = ChildEdge.first;
 
@@ -93,13 +93,10 @@ bool CollapseSingleChild::collapseSingle(LayoutTypeSystem &TS,
       }
 
       // Move Node's predecessor edges to Child, adding Off.
-      auto PredIt = Node->Predecessors.begin();
-      auto PredEnd = Node->Predecessors.end();
-      while (PredIt != PredEnd) {
-        auto Next = std::next(PredIt);
-        TS.moveEdgeTarget(Node, Child, PredIt, Off);
-        PredIt = Next;
-      }
+      llvm::SmallVector<LTSN::Link> Predecessors(Node->Predecessors.begin(),
+                                                 Node->Predecessors.end());
+      for (const LTSN::Link &Pred : Predecessors)
+        TS.moveEdgeTarget(Node, Child, Pred, Off);
 
       TS.mergeNodes({ /*Into=*/Node, /*From=*/Child });
       Node->Size = ChildSize;
@@ -112,6 +109,10 @@ bool CollapseSingleChild::collapseSingle(LayoutTypeSystem &TS,
   return Changed;
 }
 
+bool CollapseSingleChild::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool CollapseSingleChild::runOnTypeSystem(LayoutTypeSystem &TS) {
   bool Changed = false;
   if (VerifyLog.isEnabled())
@@ -43,13 +43,13 @@ bool ComputeNonInterferingComponents::runOnTypeSystem(LayoutTypeSystem &TS) {
       revng_assert(N->Size);
 
       struct OrderedChild {
-        dla::LayoutTypeSystemNode::NeighborsSet::iterator ChildIt;
+        LTSN::Link Child;
         size_t FieldSize;
 
         // Make it sortable with a different order
         std::strong_ordering operator<=>(const OrderedChild &Other) const {
-          auto &ThisEdgeTag = *ChildIt->second;
-          auto &OtherEdgeTag = *Other.ChildIt->second;
+          auto &ThisEdgeTag = *Child.second;
+          auto &OtherEdgeTag = *Other.Child.second;
 
           // Stuff that starts earlier goes first
           if (auto Cmp = ThisEdgeTag <=> OtherEdgeTag; 0 != Cmp)
@@ -60,11 +60,11 @@ bool ComputeNonInterferingComponents::runOnTypeSystem(LayoutTypeSystem &TS) {
             return Cmp;
 
           // Finally sort by address
-          return ChildIt->first <=> Other.ChildIt->first;
+          return Child.first <=> Other.Child.first;
         }
 
         auto getBeginEndByte() const {
-          auto ChildBeginByte = ChildIt->second->getOffsetExpr().Offset;
+          auto ChildBeginByte = Child.second->getOffsetExpr().Offset;
           auto ChildEndByte = ChildBeginByte + FieldSize;
           return std::make_pair(ChildBeginByte, ChildEndByte);
         }
@@ -76,15 +76,13 @@ bool ComputeNonInterferingComponents::runOnTypeSystem(LayoutTypeSystem &TS) {
       // that has a dedicated <=> operator so that we can later sort the vector
       // according to it.
       ChildrenVec Children;
-      auto NChildIt = N->Successors.begin();
-      auto NChildEnd = N->Successors.end();
-      for (; NChildIt != NChildEnd; ++NChildIt) {
-        if (isPointerEdge(*NChildIt))
+      for (const LTSN::Link &NChild : N->Successors) {
+        if (isPointerEdge(NChild))
           continue;
 
         Children.push_back(OrderedChild{
-          .ChildIt = NChildIt,
-          .FieldSize = getFieldSize(NChildIt->first, NChildIt->second),
+          .Child = NChild,
+          .FieldSize = getFieldSize(NChild.first, NChild.second),
         });
       }
 
@@ -224,7 +222,7 @@ bool ComputeNonInterferingComponents::runOnTypeSystem(LayoutTypeSystem &TS) {
         using llvm::iterator_range;
         auto OrderedChildRange = iterator_range(C.StartChildIt, C.EndChildIt);
         for (auto &OrderedChild : OrderedChildRange)
-          TS.moveEdgeSource(N, New, OrderedChild.ChildIt, -C.StartByte);
+          TS.moveEdgeSource(N, New, OrderedChild.Child, -C.StartByte);
 
         // Add a link between N and the New node representing the component.
         // The component is at offset C.StartByte inside N.
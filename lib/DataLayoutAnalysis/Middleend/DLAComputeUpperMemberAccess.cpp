@@ -31,6 +31,10 @@ using NonPointerFilterT = EdgeFilteredGraph<GraphNodeT, isNotPointerEdge>;
 using ConstNonPointerFilterT = EdgeFilteredGraph<const LTSN *,
                                                  isNotPointerEdge>;
 
+bool ComputeUpperMemberAccesses::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool ComputeUpperMemberAccesses::runOnTypeSystem(LayoutTypeSystem &TS) {
   if (VerifyLog.isEnabled())
     revng_assert(TS.verifyDAG());
@@ -24,6 +24,10 @@ using LTSN = LayoutTypeSystemNode;
 using GraphNodeT = LTSN *;
 using NonPointerFilterT = EdgeFilteredGraph<GraphNodeT, isNotPointerEdge>;
 
+bool PruneLayoutNodesWithoutLayout::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool PruneLayoutNodesWithoutLayout::runOnTypeSystem(LayoutTypeSystem &TS) {
   bool Changed = false;
 
@@ -2,13 +2,38 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <string>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Progress.h"
 
 #include "revng/Support/Assert.h"
+#include "revng/Support/CommandLine.h"
 #include "revng/Support/Debug.h"
 
+#include "revng-c/Support/Parallel.h"
+
 #include "DLAStep.h"
 
+static llvm::cl::opt<unsigned> ComponentJobs("dla-component-jobs",
+                                             llvm::cl::desc("Number of threads "
+                                                            "used to run the "
+                                                            "DLA optimization "
+                                                            "steps on the "
+                                                            "independent "
+                                                            "components of "
+                                                            "the type system. "
+                                                            "0 means one per "
+                                                            "available core. "
+                                                            "1 means running "
+                                                            "them on the whole "
+                                                            "type system, "
+                                                            "without splitting "
+                                                            "it."),
+                                             llvm::cl::init(1),
+                                             llvm::cl::cat(MainCategory));
+
 namespace dla {
 
 const char ArrangeAccessesHierarchically::ID = 0;
@@ -124,8 +149,24 @@ void StepManager::run(LayoutTypeSystem &TS) {
   if (DLADumpDot.isEnabled())
     TS.dumpDotOnFile("type-system-0.dot", true);
 
-  llvm::Task T{ Schedule.size(), "StepManager::run" };
-  for (auto &S : Schedule) {
+  size_t SplitIndex = ComponentsBegin.value_or(Schedule.size());
+
+  // Loggers are not thread-safe
+  bool LoggingEnabled = DLAStepManagerLog.isEnabled() or DLADumpDot.isEnabled()
+                        or LayoutTypeSystem::isLoggingEnabled();
+  for (const auto &S : llvm::drop_begin(Schedule, SplitIndex))
+    LoggingEnabled = LoggingEnabled or S->isLoggingEnabled();
+  unsigned Jobs = LoggingEnabled ? 1 : ComponentJobs;
+
+  // Splitting the components only pays off if they are processed concurrently:
+  // otherwise, run all the steps on the whole LayoutTypeSystem.
+  if (Jobs == 1)
+    SplitIndex = Schedule.size();
+  bool HasComponentSteps = SplitIndex < Schedule.size();
+
+  llvm::Task T{ SplitIndex + (HasComponentSteps ? 1 : 0), "StepManager::run" };
+  for (auto &S : llvm::make_range(Schedule.begin(),
+                                  Schedule.begin() + SplitIndex)) {
     T.advance(getStepNameFromID(S->getStepID()));
     S->runOnTypeSystem(TS);
     ++x;
@@ -137,6 +178,44 @@ void StepManager::run(LayoutTypeSystem &TS) {
       TS.dumpDotOnFile(DotName.c_str(), true);
     }
   }
+
+  if (not HasComponentSteps)
+    return;
+
+  T.advance("Steps on each component");
+  size_t NumComponentSteps = Schedule.size() - SplitIndex;
+  auto ComponentSteps = llvm::make_range(Schedule.begin() + SplitIndex,
+                                         Schedule.end());
+
+  LayoutTypeSystem::ComponentVector Components = TS.splitComponents();
+  revng_log(DLAStepManagerLog,
+            "Running " << NumComponentSteps << " steps on "
+                       << Components.size() << " components");
+
+  parallelFor(Jobs, Components.size(), [&](unsigned, size_t I) {
+    LayoutTypeSystem &Component = *Components[I];
+    int ComponentX = x;
+    for (auto &S : ComponentSteps) {
+      S->runOnTypeSystem(Component);
+      ++ComponentX;
+      if (DLADumpDot.isEnabled()) {
+        revng_log(DLADumpDot,
+                  "Step " << getStepNameFromID(S->getStepID())
+                          << " Index: " << ComponentX << " Component: " << I);
+        std::string DotName = "type-system-" + std::to_string(ComponentX)
+                              + "-component-" + std::to_string(I) + ".dot";
+        Component.dumpDotOnFile(DotName.c_str(), true);
+      }
+    }
+  });
+
+  TS.joinComponents(std::move(Components));
+
+  if (DLADumpDot.isEnabled()) {
+    x += NumComponentSteps;
+    std::string DotName = "type-system-" + std::to_string(x) + ".dot";
+    TS.dumpDotOnFile(DotName.c_str(), true);
+  }
 }
 
 } // end namespace dla
@@ -6,12 +6,15 @@
 
 #include <algorithm>
 #include <memory>
+#include <optional>
 #include <type_traits>
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 
+#include "revng/Support/Assert.h"
+
 #include "revng-c/DataLayoutAnalysis/DLATypeSystem.h"
 
 namespace dla {
@@ -50,6 +53,9 @@ public:
   /// Runs the Step on TS, returns true if it has applied changes to TS.
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) = 0;
 
+  /// Returns true if any of the loggers used by the Step is enabled.
+  virtual bool isLoggingEnabled() const { return false; }
+
   IDSetConstRef getDependencies() const { return Dependencies; }
   IDSetConstRef getInvalidated() const { return Invalidated; }
 
@@ -71,6 +77,8 @@ public:
   virtual ~CollapseEqualitySCC() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// Collapses strongly connected components in the type system made of
@@ -86,6 +94,8 @@ public:
   virtual ~CollapseInstanceAtOffset0SCC() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that simplifies instance-at-offset-0 edges, to reduce the
@@ -106,6 +116,8 @@ public:
   virtual ~SimplifyInstanceAtOffset0() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that removes leaf nodes without valid layout information
@@ -124,6 +136,8 @@ public:
   virtual ~PruneLayoutNodesWithoutLayout() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that merge pointer nodes pointing to the same layout
@@ -138,6 +152,8 @@ public:
   virtual ~MergePointerNodes() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that takes all strided edges and decompose in edges with only one
@@ -178,6 +194,8 @@ public:
   virtual ~ComputeUpperMemberAccesses() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that removes invalid stride edges
@@ -198,6 +216,8 @@ public:
   virtual ~RemoveInvalidStrideEdges() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that merge pointee nodes of union of pointers
@@ -222,6 +242,8 @@ public:
   virtual ~MergePointeesOfPointerUnion() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that collapses nodes that have a single child at offset 0
@@ -242,6 +264,8 @@ public:
   virtual ~CollapseSingleChild() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that decompose the LayoutTypeSystem into components, each of which
@@ -319,6 +343,8 @@ public:
   virtual ~ArrangeAccessesHierarchically() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 /// dla::Step that tries to move pointer edges to push further down in the type
@@ -363,6 +389,8 @@ public:
   virtual ~DeduplicateFields() override = default;
 
   virtual bool runOnTypeSystem(LayoutTypeSystem &TS) override;
+
+  virtual bool isLoggingEnabled() const override;
 };
 
 inline DecomposeStridedEdges::DecomposeStridedEdges() :
@@ -405,11 +433,16 @@ public:
   llvm::SmallPtrSet<const void *, 16> InsertedSteps;
   llvm::SmallPtrSet<const void *, 16> InvalidatedSteps;
 
+  /// Index in Schedule of the first Step that runs on each weakly connected
+  /// component of the LayoutTypeSystem separately.
+  std::optional<size_t> ComponentsBegin;
+
   using sched_const_iterator = decltype(Schedule)::const_iterator;
   using sched_const_range = llvm::iterator_range<sched_const_iterator>;
 
 public:
-  StepManager() : Schedule(), InsertedSteps(), InvalidatedSteps() {}
+  StepManager() :
+    Schedule(), InsertedSteps(), InvalidatedSteps(), ComponentsBegin() {}
 
   /// Adds a Step to the StepManager, moving ownership into it.
   [[nodiscard]] bool addStep(std::unique_ptr<Step> S);
@@ -419,6 +452,18 @@ public:
     return addStep(std::make_unique<StepT>(std::forward<ArgsT &&>(Args)...));
   }
 
+  /// Makes all the Steps added from now on run on each weakly connected
+  /// component of the LayoutTypeSystem separately, using up to
+  /// `-dla-component-jobs` threads. With a single thread, the LayoutTypeSystem
+  /// is not split at all.
+  ///
+  /// \note The Steps added after this must never look at nodes that are not
+  ///       connected to the ones they are working on.
+  void splitComponents() {
+    revng_assert(not ComponentsBegin.has_value());
+    ComponentsBegin = Schedule.size();
+  }
+
   /// Runs the added steps
   void run(LayoutTypeSystem &TS);
 
@@ -427,6 +472,7 @@ public:
     Schedule.clear();
     InsertedSteps.clear();
     InvalidatedSteps.clear();
+    ComponentsBegin.reset();
   }
 
   bool hasValidSchedule() const {
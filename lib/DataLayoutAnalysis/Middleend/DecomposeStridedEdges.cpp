@@ -15,23 +15,18 @@ bool DecomposeStridedEdges::runOnTypeSystem(LayoutTypeSystem &TS) {
 
   for (LayoutTypeSystemNode *Parent : llvm::nodes(&TS)) {
 
-    using DLAGraph = llvm::GraphTraits<LayoutTypeSystemNode *>;
-    auto EdgeIt = DLAGraph::child_edge_begin(Parent);
-    auto EdgeEnd = DLAGraph::child_edge_end(Parent);
-    auto EdgeNext = DLAGraph::child_edge_end(Parent);
-
-    for (; EdgeIt != EdgeEnd; EdgeIt = EdgeNext) {
-      EdgeNext = std::next(EdgeIt);
-
-      auto &Edge = *EdgeIt;
-      if (not isInstanceEdge(Edge))
-        continue;
-
+    // Collect the multi-layered strided edges first, since decomposing them
+    // adds and erases successors of Parent.
+    llvm::SmallVector<LayoutTypeSystemNode::Link> MultiLayeredEdges;
+    for (const auto &Edge : Parent->Successors)
+      if (isInstanceEdge(Edge)
+          and Edge.second->getOffsetExpr().Strides.size() >= 2)
+        MultiLayeredEdges.push_back(Edge);
+
+    for (const auto &Edge : MultiLayeredEdges) {
       const auto &[Child, Tag] = Edge;
       const auto &OffsetExpr = Tag->getOffsetExpr();
       auto NLayers = OffsetExpr.Strides.size();
-      if (NLayers < 2)
-        continue;
 
       Changed = true;
 
@@ -82,7 +77,7 @@ bool DecomposeStridedEdges::runOnTypeSystem(LayoutTypeSystem &TS) {
       }
 
       // Remove the old strided edge
-      TS.eraseEdge(Parent, EdgeIt);
+      TS.eraseEdge(Parent, Edge);
     }
   }
 
@@ -6,9 +6,12 @@
 #include <compare>
 #include <cstdint>
 #include <iterator>
+#include <map>
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/EquivalenceClasses.h"
 #include "llvm/ADT/GraphTraits.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SetOperations.h"
@@ -285,9 +288,7 @@ static std::tuple<bool, NodeVec, NodeVec> areEquivSubtrees(const Link &Child1,
 ///\param ToMerge the root of the second subtree, will be collapsed if
 ///           equivalent to the subtree of \a ToKeep
 static std::tuple<bool, std::set<LTSN *>, std::set<LTSN *>>
-mergeIfTopologicallyEq(LayoutTypeSystem &TS,
-                       const Link &ToKeep,
-                       const Link &ToMerge) {
+mergeIfTopologicallyEq(LayoutTypeSystem &TS, Link ToKeep, Link ToMerge) {
 
   auto [AreEquiv, Subtree1, Subtree2] = areEquivSubtrees(ToKeep, ToMerge);
   if (not AreEquiv) {
@@ -341,6 +342,120 @@ mergeIfTopologicallyEq(LayoutTypeSystem &TS,
   return { true, PreservedNodes, ErasedNodes };
 }
 
+/// Lazily computed signatures of the subtrees reachable through non-pointer
+/// edges.
+///
+/// The signature of a node combines all the information that
+/// `exploreAndCompare` looks at: its size, its number of successors and of
+/// instance successors, the signatures of its instance children and the
+/// targets of its pointer edges. Hence, subtrees that `exploreAndCompare`
+/// considers equivalent always have the same signature, and comparing the
+/// signatures rules out most of the non-equivalent pairs without visiting
+/// them.
+///
+/// This only holds if there are no equality edges, which `exploreAndCompare`
+/// might pair with pointer edges.
+///
+/// Signatures are computed bottom-up, hence whenever a node has a signature,
+/// so do all the nodes reachable from it through non-pointer edges.
+class SubtreeSignatures {
+  llvm::DenseMap<const LTSN *, llvm::hash_code> Cache;
+
+public:
+  /// Drop the signatures that depend on \a Node. Must be called on each node
+  /// whose successors have changed (e.g., the one kept by `mergeNodes`).
+  ///
+  /// These are the signatures of \a Node, of its predecessors, which might
+  /// have been pointing to a node that has been merged into \a Node, and of
+  /// all the nodes that reach them through non-pointer edges.
+  void invalidate(const LTSN *Node) {
+    Cache.erase(Node);
+
+    llvm::SmallVector<const LTSN *, 8> Worklist;
+    for (const Link &L : Node->Predecessors)
+      Worklist.push_back(L.first);
+
+    while (not Worklist.empty()) {
+      const LTSN *Ancestor = Worklist.pop_back_val();
+
+      // If Ancestor has no signature, neither do its non-pointer ancestors
+      if (not Cache.erase(Ancestor))
+        continue;
+
+      for (const Link &L : Ancestor->Predecessors)
+        if (not isPointerEdge(L))
+          Worklist.push_back(L.first);
+    }
+  }
+
+  /// Drop the signature of a node that has been erased from the graph
+  void erase(const LTSN *Node) { Cache.erase(Node); }
+
+  llvm::hash_code get(const LTSN *Root) {
+    if (auto It = Cache.find(Root); It != Cache.end())
+      return It->second;
+
+    // Compute the signatures in post-order, without recursion, since the
+    // subtrees can be very deep.
+    llvm::SmallVector<const LTSN *, 8> Stack{ Root };
+    while (not Stack.empty()) {
+      const LTSN *Node = Stack.back();
+      if (Cache.count(Node)) {
+        Stack.pop_back();
+        continue;
+      }
+
+      bool ChildrenReady = true;
+      for (const Link &L : Node->Successors) {
+        if (not isPointerEdge(L) and not Cache.count(L.first)) {
+          Stack.push_back(L.first);
+          ChildrenReady = false;
+        }
+      }
+
+      if (ChildrenReady) {
+        Stack.pop_back();
+        Cache[Node] = compute(Node);
+      }
+    }
+
+    return Cache.lookup(Root);
+  }
+
+private:
+  llvm::hash_code compute(const LTSN *Node) const {
+    // `exploreAndCompare` pairs the children after sorting them by ID too,
+    // so the children are combined in a way that does not depend on their
+    // order.
+    size_t NumInstanceChildren = 0;
+    size_t InstanceChildren = 0;
+    size_t PointerChildren = 0;
+    for (const Link &L : Node->Successors) {
+      if (isPointerEdge(L)) {
+        PointerChildren += llvm::hash_value(L.first->ID);
+      } else {
+        InstanceChildren += Cache.lookup(L.first);
+        if (isInstanceEdge(L))
+          ++NumInstanceChildren;
+      }
+    }
+
+    return llvm::hash_combine(Node->Size,
+                              Node->Successors.size(),
+                              NumInstanceChildren,
+                              InstanceChildren,
+                              PointerChildren);
+  }
+};
+
+static bool hasEqualityEdges(LayoutTypeSystem &TS) {
+  for (LTSN *Node : llvm::nodes(&TS))
+    for (const Link &L : Node->Successors)
+      if (isEqualityEdge(L))
+        return true;
+  return false;
+}
+
 static auto getSuccEdgesToChild(LTSN *Parent, LTSN *Child) {
   auto &Succ = Parent->Successors;
   using IDBasedKey = std::pair<uint64_t, const TypeLinkTag *>;
@@ -350,6 +465,10 @@ static auto getSuccEdgesToChild(LTSN *Parent, LTSN *Child) {
                                                            nullptr }));
 }
 
+bool DeduplicateFields::isLoggingEnabled() const {
+  return Log.isEnabled() or CmpLog.isEnabled();
+}
+
 bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
   bool TypeSystemChanged = false;
   if (VerifyLog.isEnabled())
@@ -357,6 +476,16 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
 
   llvm::SmallPtrSet<LTSN *, 16> VisitedNodes;
 
+  SubtreeSignatures Signatures;
+  const bool UseSignatures = not hasEqualityEdges(TS);
+
+  // Without signatures, all the nodes are potentially equivalent
+  const auto SignatureOf = [&](const LTSN *Node) -> size_t {
+    if (not UseSignatures)
+      return 0;
+    return Signatures.get(Node);
+  };
+
   for (LTSN *Root : llvm::nodes(&TS)) {
     revng_assert(Root != nullptr);
     if (not isRoot(Root))
@@ -390,6 +519,15 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
       llvm::SmallSet<LTSN *, 8> OriginalFields;
       llvm::SmallSetVector<LTSN *, 8> AnalyzedNodesNotMerged;
 
+      // The AnalyzedNodesNotMerged, grouped by signature, in the same order
+      using NodesBySignature = std::map<size_t, llvm::SmallVector<LTSN *, 4>>;
+      NodesBySignature NotMergedBySignature;
+      const auto GroupBySignature = [&]() {
+        NotMergedBySignature.clear();
+        for (LTSN *Node : AnalyzedNodesNotMerged)
+          NotMergedBySignature[SignatureOf(Node)].push_back(Node);
+      };
+
       // We keep a separate list of successors since we might need to re-enqueue
       // some of them.
       revng_log(Log, "Children are:");
@@ -429,9 +567,18 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
 
           // We want to compare CurChild with all the other nodes that we have
           // looked at in previous iterations, and try to merge it with one of
-          // them.
-          for (LTSN *NotMergedNode : AnalyzedNodesNotMerged) {
+          // them. Only the ones with the same signature can be equivalent.
+          auto SameSignature = NotMergedBySignature.find(SignatureOf(CurChild));
+          if (SameSignature == NotMergedBySignature.end()) {
+            revng_log(CmpLog,
+                      "No analyzed node with the signature of "
+                        << CurChild->ID);
+            continue;
+          }
+
+          for (LTSN *NotMergedNode : SameSignature->second) {
             LoggerIndent MoreMoreIndent{ Log };
+
             revng_log(Log,
                       "Try to merge: " << CurLink.first->ID << " with "
                                        << NotMergedNode->ID);
@@ -446,7 +593,9 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
 
             bool AnalyzedNotMergedInvalidated = false;
             for (const Link &NotMergedLink : NotMergedEdges) {
-              const auto &[NotMergedNode, NotMergedTag] = NotMergedLink;
+              // Copy the link, since merging changes the successors of
+              // NodeWithFields, invalidating the references to them.
+              const auto [NotMergedNode, NotMergedTag] = NotMergedLink;
 
               LoggerIndent MoreMoreIndent{ Log };
               revng_log(Log, "Edge to merge with: " << *NotMergedTag);
@@ -465,6 +614,10 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
                 continue;
               }
               revng_log(Log, "Edge merged!");
+              for (LTSN *ErasedNode : Erased)
+                Signatures.erase(ErasedNode);
+              for (LTSN *PreservedNode : Preserved)
+                Signatures.invalidate(PreservedNode);
 
               // If we merged something, there should be at least one preserved
               // node and one erased node
@@ -483,9 +636,12 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
               {
                 // Copy the post_order into a SmallVector, since collapseSingle
                 // might mutate the graph and screw up the po_iterator.
+                // collapseSingle merges the children into N, so N is the only
+                // node that changes.
                 for (auto &N : llvm::SmallVector<LTSN *>{
                        post_order(NonPointerFilterT(NotMergedNode)) })
-                  CollapseSingleChild::collapseSingle(TS, N);
+                  if (CollapseSingleChild::collapseSingle(TS, N))
+                    Signatures.invalidate(N);
 
                 // Notice that collapseSingle can actually remove more nodes.
                 // In principle we should add them to Erased and remove them
@@ -548,9 +704,11 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
 
             if (AnalyzedNotMergedInvalidated) {
               // If we just merged CurChild into NotMergedNode we have
-              // invalidated the AnalyzedNodesNotMerged iterators.
-              // So we have to exit this loop and re-start iterating on
-              // FieldsToCompare.
+              // invalidated the AnalyzedNodesNotMerged iterators, and the
+              // signatures of some of them might have changed.
+              // So we have to group them again, exit this loop and re-start
+              // iterating on FieldsToCompare.
+              GroupBySignature();
               break;
             }
           }
@@ -567,6 +725,7 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
         // analyzed and not merged.
         if (not FieldsMerged) {
           AnalyzedNodesNotMerged.insert(CurChild);
+          NotMergedBySignature[SignatureOf(CurChild)].push_back(CurChild);
           revng_log(Log, "CurChild " << CurChild->ID << " not merged");
         }
       }
@@ -575,6 +734,8 @@ bool DeduplicateFields::runOnTypeSystem(LayoutTypeSystem &TS) {
       if (NodeWithFieldsChanged) {
         bool Changed = CollapseSingleChild::collapseSingle(TS, NodeWithFields);
         TypeSystemChanged |= Changed;
+        if (Changed)
+          Signatures.invalidate(NodeWithFields);
       }
     }
   }
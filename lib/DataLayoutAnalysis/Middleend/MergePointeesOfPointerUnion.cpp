@@ -46,6 +46,10 @@ static LTSN *getPointee(LTSN *Pointer) {
   return Pointer->Successors.begin()->first;
 }
 
+bool MergePointeesOfPointerUnion::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool MergePointeesOfPointerUnion::runOnTypeSystem(LayoutTypeSystem &TS) {
   bool Changed = false;
 
@@ -220,13 +224,11 @@ bool MergePointeesOfPointerUnion::runOnTypeSystem(LayoutTypeSystem &TS) {
           // Check if we merged more than one scalar that also was a pointer.
           // In that case we have to create a new union of their pointees,
           // enqueue it for further analysis
-          llvm::SmallVector<LTSN::NeighborIterator> PointerEdges;
+          llvm::SmallVector<LTSN::Link> PointerEdges;
           {
-            LTSN::NeighborIterator ChildIt = MergedScalar->Successors.begin();
-            LTSN::NeighborIterator ChildEnd = MergedScalar->Successors.end();
-            for (; ChildIt != ChildEnd; ++ChildIt)
-              if (isPointerEdge(*ChildIt))
-                PointerEdges.push_back(ChildIt);
+            for (const LTSN::Link &Child : MergedScalar->Successors)
+              if (isPointerEdge(Child))
+                PointerEdges.push_back(Child);
 
             revng_assert(PointerEdges.empty()
                          or MergedScalar->Size == PointerSize);
@@ -236,10 +238,10 @@ bool MergePointeesOfPointerUnion::runOnTypeSystem(LayoutTypeSystem &TS) {
             revng_log(Log,
                       "Merged scalar is a union of pointers: "
                         << MergedScalar->ID);
-            for (LTSN::NeighborIterator &PointerEdgeIt : PointerEdges) {
+            for (const LTSN::Link &PointerEdge : PointerEdges) {
               LTSN *NewPointer = TS.createArtificialLayoutType();
               NewPointer->Size = PointerSize;
-              TS.moveEdgeSource(MergedScalar, NewPointer, PointerEdgeIt, 0);
+              TS.moveEdgeSource(MergedScalar, NewPointer, PointerEdge, 0);
               TS.addInstanceLink(MergedScalar,
                                  NewPointer,
                                  OffsetExpression{ 0 });
@@ -279,9 +281,11 @@ bool MergePointeesOfPointerUnion::runOnTypeSystem(LayoutTypeSystem &TS) {
               };
             auto InverseEdgeIt = llvm::find_if(AggregateFromModel->Predecessors,
                                                PredecessorPointsToAggregate);
+            revng_assert(InverseEdgeIt
+                         != AggregateFromModel->Predecessors.end());
             TS.moveEdgeTarget(AggregateFromModel,
                               MergedAggregate,
-                              InverseEdgeIt,
+                              *InverseEdgeIt,
                               0);
 
             // We want to put an instance link at offset 0 from MergedAggregate
@@ -310,10 +314,11 @@ bool MergePointeesOfPointerUnion::runOnTypeSystem(LayoutTypeSystem &TS) {
           // First, we want all pointers that point to MergedScalar to actually
           // start pointing to MergedAggregate.
           for (LTSN *Pointer : PointersToScalars) {
-            const auto &[Pointee, PointerTag] = *Pointer->Successors.begin();
+            const auto [Pointee, PointerTag] = *Pointer->Successors.begin();
             auto InverseEdgeIt = Pointee->Predecessors.find({ Pointer,
                                                               PointerTag });
-            TS.moveEdgeTarget(Pointee, MergedAggregate, InverseEdgeIt, 0);
+            revng_assert(InverseEdgeIt != Pointee->Predecessors.end());
+            TS.moveEdgeTarget(Pointee, MergedAggregate, *InverseEdgeIt, 0);
           }
 
           // Second, we want to inject an instance of MergedScalar at offset 0
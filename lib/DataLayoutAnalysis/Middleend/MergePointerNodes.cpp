@@ -19,6 +19,10 @@ using GraphNodeT = LTSN *;
 using PointerGraphNodeT = EdgeFilteredGraph<GraphNodeT, isPointerEdge>;
 using InversePointerGraphNodeT = llvm::Inverse<PointerGraphNodeT>;
 
+bool MergePointerNodes::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool MergePointerNodes::runOnTypeSystem(LayoutTypeSystem &TS) {
   bool Changed = false;
 
@@ -52,10 +56,9 @@ bool MergePointerNodes::runOnTypeSystem(LayoutTypeSystem &TS) {
 
       Changed = true;
 
-      // This does note invalidate our iteration on llvm::nodes, since the
-      // underlying container for nodes is a std::set, and the iterator that is
-      // being held on it points to Node, not to any of the nodes in ToMerge,
-      // so erasing the nodes in ToMerge never invalidats the iterator to Node
+      // This does not invalidate our iteration on llvm::nodes, since the
+      // iterator on nodes holds the index of Node, and erasing the nodes in
+      // ToMerge never changes the index of the other nodes.
       TS.mergeNodes(ToMerge);
     }
   }
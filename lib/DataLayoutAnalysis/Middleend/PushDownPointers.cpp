@@ -94,8 +94,8 @@ bool PushDownPointers::runOnTypeSystem(LayoutTypeSystem &TS) {
 
     for (LayoutTypeSystemNode *Pointer : PointersToGrandParents) {
       revng_assert(isPointerNode(Pointer) and Pointer->Successors.size() == 1);
-      auto PointerEdgeIt = Pointer->Successors.begin();
-      LayoutTypeSystemNode *Pointee = PointerEdgeIt->first;
+      LayoutTypeSystemNode::Link PointerEdge = *Pointer->Successors.begin();
+      LayoutTypeSystemNode *Pointee = PointerEdge.first;
       LayoutTypeSystemNode *NewPointee = nullptr;
       DFVisitSet Visited = getChildrenAtOffset0(Parent);
       for (LayoutTypeSystemNode *N :
@@ -109,7 +109,7 @@ bool PushDownPointers::runOnTypeSystem(LayoutTypeSystem &TS) {
       if (not NewPointee)
         NewPointee = Parent;
 
-      TS.eraseEdge(Pointer, PointerEdgeIt);
+      TS.eraseEdge(Pointer, PointerEdge);
       TS.addPointerLink(Pointer, NewPointee);
       Changed = true;
     }
@@ -12,7 +12,6 @@
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
-#include "llvm/Support/Progress.h"
 
 #include "revng/Support/Assert.h"
 #include "revng/Support/Debug.h"
@@ -86,8 +85,6 @@ static bool removeBackedgesFromSCC(LayoutTypeSystem &TS) {
 
   revng_log(Log, "Removing Backedges From Loops");
 
-  llvm::Task T(2, "removeBackedgesFromSCC");
-  T.advance("Detect SCC Node View Components");
   // Assign each node to a Component, except for those that have no incoming nor
   // outgoing SCCNodeView edges. The goal is to identify the subsets of nodes
   // that are connected by means of SCCNodeView edges. In this way we divide the
@@ -140,7 +137,6 @@ static bool removeBackedgesFromSCC(LayoutTypeSystem &TS) {
 
   using MixedNodeT = EdgeFilteredGraph<LTSN *, isMixedEdge<SCC>>;
 
-  T.advance("Remove Backedges");
   for (const auto &Root : llvm::nodes(&TS)) {
     revng_assert(Root != nullptr);
     // We start from SCCNodeView roots and look if we find an SCC with mixed
@@ -349,6 +345,10 @@ static bool removeBackedgesFromSCC(LayoutTypeSystem &TS) {
   return Changed;
 }
 
+bool isRemoveBackedgesLoggingEnabled() {
+  return Log.isEnabled();
+}
+
 bool removeInstanceBackedgesFromInstanceAtOffset0Loops(LayoutTypeSystem &TS) {
   return removeBackedgesFromSCC<InstanceOffsetZeroWithInstanceBackedge>(TS);
 }
@@ -11,4 +11,6 @@ class LayoutTypeSystem;
 extern bool
 removeInstanceBackedgesFromInstanceAtOffset0Loops(LayoutTypeSystem &TS);
 
+extern bool isRemoveBackedgesLoggingEnabled();
+
 } // end namespace dla
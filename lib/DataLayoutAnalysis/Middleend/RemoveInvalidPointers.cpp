@@ -14,26 +14,22 @@ bool dla::RemoveInvalidPointers::runOnTypeSystem(LayoutTypeSystem &TS) {
     if (PtrNode->Size == PointerSize)
       continue;
 
-    auto It = PtrNode->Successors.begin();
-    auto End = PtrNode->Successors.end();
-    auto Next = End;
-    for (; It != End; It = Next) {
-
-      Next = std::next(It);
+    llvm::SmallVector<LayoutTypeSystemNode::Link> ToErase;
+    for (const auto &Edge : PtrNode->Successors) {
 
       // Ignore non-pointer edges
-      if (not isPointerEdge(*It))
+      if (not isPointerEdge(Edge))
         continue;
 
       // If we reach this point PtrNode->Size is different from a pointer size
-      // and It points to a pointer edge that is outgoing from PtrNode.
+      // and Edge is a pointer edge that is outgoing from PtrNode.
       // That edge is invalid, because according to PtrNode->Size PtrNode cannot
       // be a pointer, so we remove the wrong edge.
-      LayoutTypeSystemNode *Pointee = It->first;
-      auto PredIt = Pointee->Predecessors.find({ PtrNode, It->second });
-      revng_assert(PredIt != Pointee->Predecessors.end());
-      Pointee->Predecessors.erase(PredIt);
-      PtrNode->Successors.erase(It);
+      ToErase.push_back(Edge);
+    }
+
+    for (const auto &Edge : ToErase) {
+      TS.eraseEdge(PtrNode, Edge);
       Changed = true;
     }
   }
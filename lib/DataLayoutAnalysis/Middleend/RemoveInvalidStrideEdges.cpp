@@ -49,6 +49,10 @@ static bool hasValidStrides(const LayoutTypeSystemNode::Link &Edge) {
   return true;
 }
 
+bool RemoveInvalidStrideEdges::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool RemoveInvalidStrideEdges::runOnTypeSystem(LayoutTypeSystem &TS) {
   bool Changed = false;
 
@@ -72,31 +76,26 @@ bool RemoveInvalidStrideEdges::runOnTypeSystem(LayoutTypeSystem &TS) {
     for (LayoutTypeSystemNode *N :
          llvm::post_order_ext(InstanceNodeT(Root), Visited)) {
 
-      auto It = N->Successors.begin();
-      auto End = N->Successors.end();
-      auto Next = End;
-      bool RemovedChild = false;
-      for (; It != End; It = Next) {
+      llvm::SmallVector<LayoutTypeSystemNode::Link> ToErase;
+      for (const auto &Edge : N->Successors) {
 
-        Next = std::next(It);
-
-        if (not isInstanceEdge(*It))
+        if (not isInstanceEdge(Edge))
           continue;
 
-        if (hasValidStrides(*It))
+        if (hasValidStrides(Edge))
           continue;
 
         // If we reach this point the edges has invalid strides, so we need to
-        // remove it, taking care of the fact that it's bidirectional.
-        LayoutTypeSystemNode *Succ = It->first;
-        auto PredIt = Succ->Predecessors.find({ N, It->second });
-        revng_assert(PredIt != Succ->Predecessors.end());
-        Succ->Predecessors.erase(PredIt);
-        N->Successors.erase(It);
-        RemovedChild = true;
-        Changed = true;
+        // remove it.
+        ToErase.push_back(Edge);
       }
 
+      // Erase the edges, taking care of the fact that they're bidirectional.
+      bool RemovedChild = not ToErase.empty();
+      for (const auto &Edge : ToErase)
+        TS.eraseEdge(N, Edge);
+      Changed |= RemovedChild;
+
       if (RemovedChild) {
         // If we reach this point, N had at least one outgoing instance edge
         // with strided access that was invalid.
@@ -28,34 +28,31 @@ struct ChildrenKey {
 
 using NodePredicate = const std::function<bool(const LayoutTypeSystemNode *)>;
 
-using NeighborIterator = LayoutTypeSystemNode::NeighborIterator;
+using Link = LayoutTypeSystemNode::Link;
 
-static bool neighborLess(const NeighborIterator &AIt,
-                         const NeighborIterator &BIt) {
-  const auto &[AChild, ATag] = *AIt;
-  const auto &[BChild, BTag] = *BIt;
+static bool neighborLess(const Link &A, const Link &B) {
+  const auto &[AChild, ATag] = A;
+  const auto &[BChild, BTag] = B;
   return (AChild < BChild) or (ATag < BTag);
 }
 
 using NeighborLess = std::integral_constant<decltype(&neighborLess),
                                             neighborLess>;
 
-using NeighborSet = std::set<NeighborIterator, NeighborLess>;
+using NeighborSet = std::set<Link, NeighborLess>;
 
 static SmallMap<ChildrenKey, NeighborSet, 8>
 getOverlappingLeafChildren(LayoutTypeSystemNode *N) {
 
   SmallMap<ChildrenKey, NeighborSet, 8> Result;
 
-  auto ChildIt = N->Successors.begin();
-  auto ChildEnd = N->Successors.end();
-  for (; ChildIt != ChildEnd; ++ChildIt) {
-    if (not isInstanceEdge(*ChildIt))
+  for (const Link &ChildEdge : N->Successors) {
+    if (not isInstanceEdge(ChildEdge))
       continue;
-    auto &[Child, Tag] = *ChildIt;
+    auto &[Child, Tag] = ChildEdge;
     if (not isLeaf(Child))
       continue;
-    Result[ChildrenKey{ getFieldSize(Child, Tag), Tag }].insert(ChildIt);
+    Result[ChildrenKey{ getFieldSize(Child, Tag), Tag }].insert(ChildEdge);
   }
 
   return Result;
@@ -192,16 +189,16 @@ static bool resolveUnion(LayoutTypeSystem &TS,
   for (; AIt != End; AIt = ANext) {
     ANext = std::next(AIt);
 
-    auto AChildIt = *AIt;
-    LayoutTypeSystemNode *AChild = AChildIt->first;
+    Link AChildEdge = *AIt;
+    LayoutTypeSystemNode *AChild = AChildEdge.first;
 
     auto BIt = ANext;
     auto BNext = BIt;
     for (; BIt != End; BIt = BNext) {
       BNext = std::next(BIt);
 
-      auto BChildIt = *BIt;
-      LayoutTypeSystemNode *BChild = BChildIt->first;
+      Link BChildEdge = *BIt;
+      LayoutTypeSystemNode *BChild = BChildEdge.first;
 
       auto Cmp = compareLeafTypes(AChild, BChild);
       // A can reach more types on the DLA graph than B.
@@ -210,7 +207,7 @@ static bool resolveUnion(LayoutTypeSystem &TS,
         BNext = ChildrenSet.erase(BIt);
         if (ANext == BIt)
           ANext = std::next(AIt);
-        TS.eraseEdge(Parent, BChildIt);
+        TS.eraseEdge(Parent, BChildEdge);
         Changed = true;
       }
 
@@ -218,7 +215,7 @@ static bool resolveUnion(LayoutTypeSystem &TS,
       // Remove A.
       if (Cmp < 0) {
         ANext = ChildrenSet.erase(AIt);
-        TS.eraseEdge(Parent, AChildIt);
+        TS.eraseEdge(Parent, AChildEdge);
         Changed = true;
         break;
       }
@@ -3,6 +3,7 @@
 //
 
 #include <iostream>
+#include <optional>
 
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DepthFirstIterator.h"
@@ -19,9 +20,6 @@
 using InstanceT = EdgeFilteredGraph<dla::LayoutTypeSystemNode *,
                                     dla::isInstanceEdge>;
 
-using InstanceZeroT = EdgeFilteredGraph<dla::LayoutTypeSystemNode *,
-                                        dla::isInstanceOff0>;
-
 using CInstanceT = EdgeFilteredGraph<const dla::LayoutTypeSystemNode *,
                                      dla::isInstanceEdge>;
 
@@ -170,6 +168,10 @@ getPostOrder(LayoutTypeSystemNode *Root) {
   return PostOrder;
 }
 
+bool SimplifyInstanceAtOffset0::isLoggingEnabled() const {
+  return Log.isEnabled();
+}
+
 bool SimplifyInstanceAtOffset0::runOnTypeSystem(LayoutTypeSystem &TS) {
 
   if (Log.isEnabled())
@@ -199,8 +201,16 @@ bool SimplifyInstanceAtOffset0::runOnTypeSystem(LayoutTypeSystem &TS) {
 
     // For each instance children of Node at offset 0, compute if it can be
     // collapsed into Node, and if it's possible collapse it.
-    for (LayoutTypeSystemNode *Child :
-         llvm::make_early_inc_range(llvm::children<InstanceZeroT>(Node))) {
+    // Collapsing a child changes the successors of Node, invalidating the
+    // iterators on them. So before collapsing we save the next edge to visit,
+    // and then we resume the iteration from it.
+    const auto &Successors = Node->Successors;
+    auto ChildEdgeIt = llvm::find_if(Successors, isInstanceOff0);
+    while (ChildEdgeIt != Successors.end()) {
+      LayoutTypeSystemNode *Child = ChildEdgeIt->first;
+      ChildEdgeIt = std::find_if(std::next(ChildEdgeIt),
+                                 Successors.end(),
+                                 isInstanceOff0);
 
       revng_log(Log, "Child: " << Child->ID);
       LoggerIndent ChildIndent(Log);
@@ -220,9 +230,16 @@ bool SimplifyInstanceAtOffset0::runOnTypeSystem(LayoutTypeSystem &TS) {
                          true);
       }
 
+      std::optional<LayoutTypeSystemNode::Link> NextChildEdge;
+      if (ChildEdgeIt != Successors.end())
+        NextChildEdge = *ChildEdgeIt;
+
       TS.mergeNodes({ Node, Child });
       Changed = true;
 
+      ChildEdgeIt = NextChildEdge ? Successors.lower_bound(*NextChildEdge) :
+                                    Successors.end();
+
       if (Log.isEnabled()) {
         TS.dumpDotOnFile((llvm::Twine(I) + "-after-" + llvm::Twine(IDToCollapse)
                           + ".dot")
@@ -2,6 +2,10 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <string>
+
+#include "llvm/Support/raw_ostream.h"
+
 #include "revng/Model/Binary.h"
 #include "revng/Pipeline/AllRegistries.h"
 #include "revng/Pipes/Kinds.h"
@@ -41,20 +45,40 @@ public:
            const BinaryFileContainer &SourceBinary,
            TypeDefinitionStringMap &ModelTypesContainer) {
     const model::Binary &Model = *getModelFromContext(EC);
-    for (const model::TypeDefinition &Type :
-         getTypeDefinitionsAndCommit(EC, ModelTypesContainer.name())) {
-      std::string &Result = ModelTypesContainer[Type.key()];
-      llvm::raw_string_ostream Out(Result);
 
-      ptml::CTypeBuilder B(Out,
-                           true,
-                           { .EnablePrintingOfTheMaximumEnumValue = true,
-                             .EnableExplicitPaddingMode = false,
-                             .EnableStructSizeAnnotation = true });
-      B.collectInlinableTypes(Model);
+    // Compute the dependency graph and the inlinable types once, and share
+    // them with the builders of all the type definitions.
+    //
+    // Whether a type is inlinable depends on all the other types, so every
+    // definition depends on what this reads from the model. This is why the
+    // definitions are committed all together at the end, rather than one by
+    // one through `getTypeDefinitionsAndCommit`: the reads performed here
+    // would otherwise not be attributed to any of them.
+    ptml::CTypeBuilder Prototype(llvm::nulls(),
+                                 true,
+                                 { .EnablePrintingOfTheMaximumEnumValue = true,
+                                   .EnableExplicitPaddingMode = false,
+                                   .EnableStructSizeAnnotation = true });
+    Prototype.collectInlinableTypes(Model);
 
+    // Each type gets a fresh builder, so that the artificial types (e.g. array
+    // wrappers) it depends on are printed along with it.
+    //
+    // Types are printed serially: reads from the model are tracked, and
+    // tracking is not thread safe.
+    for (const pipeline::Target &Target :
+         EC.getRequestedTargetsFor(ModelTypesContainer)) {
+      using KeyType = model::TypeDefinition::Key;
+      auto Key = cantFail(fromString<KeyType>(Target.getPathComponents()[0]));
+      const model::TypeDefinition &Type = *Model.TypeDefinitions().at(Key);
+      std::string &Result = ModelTypesContainer[Type.key()];
+      llvm::raw_string_ostream Out(Result);
+      ptml::CTypeBuilder B(Out, Prototype);
       B.printTypeDefinition(Type);
+      Out.flush();
     }
+
+    EC.commitAllFor(ModelTypesContainer);
   }
 };
 
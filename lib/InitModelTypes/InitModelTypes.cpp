@@ -8,6 +8,7 @@
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -23,6 +24,7 @@
 #include "revng/Model/Binary.h"
 #include "revng/Model/CABIFunctionDefinition.h"
 #include "revng/Model/IRHelpers.h"
+#include "revng/Model/LoadModelPass.h"
 #include "revng/Model/RawFunctionDefinition.h"
 #include "revng/Model/TypedefDefinition.h"
 #include "revng/Support/Assert.h"
@@ -45,8 +47,6 @@ template<typename T>
 using RPOT = llvm::ReversePostOrderTraversal<T>;
 
 using TypeVector = llvm::SmallVector<model::UpcastableType, 8>;
-using ModelTypesMap = std::map<const llvm::Value *,
-                               const model::UpcastableType>;
 
 /// Map each llvm::Argument of the given llvm::Function to its type in the model
 static void addArgumentsTypes(const llvm::Function &LLVMFunc,
@@ -152,13 +152,15 @@ static RecursiveCoroutine<bool> addOperandType(const llvm::Value *Operand,
 /// special rules apply to recover the returned type.
 static TypeVector getReturnTypes(const llvm::CallInst *Call,
                                  const model::Function *ParentFunc,
-                                 const model::Binary &Model,
+                                 ModelTypeCache &TypeCache,
                                  const ModelTypesMap &TypeMap) {
   if (Call->getType()->isVoidTy())
     return {};
 
+  const model::Binary &Model = TypeCache.getModel();
+
   // Check if we already have strong model information for this call
-  TypeVector ReturnTypes = getStrongModelInfo(Call, Model);
+  TypeVector ReturnTypes = getStrongModelInfo(Call, TypeCache);
   if (not ReturnTypes.empty())
     return ReturnTypes;
 
@@ -235,11 +237,14 @@ static TypeVector getReturnTypes(const llvm::CallInst *Call,
 /// one type, infect the uses of the returned value with those types.
 static void handleCallInstruction(const llvm::CallInst *Call,
                                   const model::Function *ParentFunc,
-                                  const model::Binary &Model,
+                                  ModelTypeCache &TypeCache,
                                   ModelTypesMap &TypeMap,
                                   bool PointersOnly) {
 
-  TypeVector ReturnedTypes = getReturnTypes(Call, ParentFunc, Model, TypeMap);
+  TypeVector ReturnedTypes = getReturnTypes(Call,
+                                            ParentFunc,
+                                            TypeCache,
+                                            TypeMap);
   if (ReturnedTypes.empty())
     return;
 
@@ -416,12 +421,13 @@ static RecursiveCoroutine<std::optional<model::UpcastableType>>
 initModelTypesImpl(const llvm::Instruction &I,
                    const llvm::Function &F,
                    const model::Function *ModelF,
-                   const model::Binary &Model,
+                   ModelTypeCache &TypeCache,
                    bool PointersOnly,
                    ModelTypesMap &TypeMap,
                    llvm::SmallPtrSet<const llvm::PHINode *, 8>
                      VisitedPHIs = {}) {
 
+  const model::Binary &Model = TypeCache.getModel();
   const auto *InstType = I.getType();
 
   // Ignore operands of some custom opcodes
@@ -457,7 +463,7 @@ initModelTypesImpl(const llvm::Instruction &I,
   // the binary or to special intrinsics used by the backend, so they need
   // to be handled separately
   if (auto *Call = dyn_cast<llvm::CallInst>(&I)) {
-    handleCallInstruction(Call, ModelF, Model, TypeMap, PointersOnly);
+    handleCallInstruction(Call, ModelF, TypeCache, TypeMap, PointersOnly);
     auto CallTypeIt = TypeMap.find(Call);
     if (CallTypeIt != TypeMap.end())
       rc_return CallTypeIt->second.copy();
@@ -588,7 +594,7 @@ initModelTypesImpl(const llvm::Instruction &I,
           IncomingType = rc_recur initModelTypesImpl(*IncomingInst,
                                                      F,
                                                      ModelF,
-                                                     Model,
+                                                     TypeCache,
                                                      PointersOnly,
                                                      TypeMap,
                                                      VisitedPHIs);
@@ -617,58 +623,154 @@ initModelTypesImpl(const llvm::Instruction &I,
   rc_return std::nullopt;
 }
 
-static RecursiveCoroutine<ModelTypesMap>
-initModelTypesImpl(const llvm::Function &F,
-                   const model::Function *ModelF,
-                   const model::Binary &Model,
-                   bool PointersOnly,
-                   llvm::SmallPtrSet<const llvm::PHINode *, 8>
-                     VisitedPHIs = {}) {
+/// Compute the type of \a I and, if there is one, add it to \a TypeMap
+static void addInstructionType(const llvm::Instruction &I,
+                               const llvm::Function &F,
+                               const model::Function *ModelF,
+                               ModelTypeCache &TypeCache,
+                               bool PointersOnly,
+                               ModelTypesMap &TypeMap) {
+  const model::Binary &Model = TypeCache.getModel();
+  std::optional<model::UpcastableType> Result = initModelTypesImpl(I,
+                                                                   F,
+                                                                   ModelF,
+                                                                   TypeCache,
+                                                                   PointersOnly,
+                                                                   TypeMap);
+  if (PointersOnly) {
+    // Skip if it's not a pointer and we are only interested in pointers
+    if (Result.has_value() and !Result->isEmpty() and (*Result)->isPointer())
+      TypeMap.insert({ &I, std::move(*Result) });
 
-  ModelTypesMap TypeMap;
+  } else if (Result.has_value()) {
+    TypeMap.insert({ &I, std::move(*Result) });
+
+  } else if (I.getType()->isIntOrPtrTy()) {
+    // As a fallback, use the LLVM type
+    TypeMap.insert({ &I, llvmIntToModelType(I.getType(), Model) });
+
+  } else if (auto *Call = llvm::dyn_cast<llvm::CallInst>(&I)) {
+    // TODO: is there more we can check here?
+
+  } else {
+    revng_abort("Couldn't process a type.");
+  }
+}
+
+ModelTypesMap initModelTypes(const llvm::Function &F,
+                             const model::Function *ModelF,
+                             ModelTypeCache &TypeCache,
+                             bool PointersOnly) {
+  const model::Binary &Model = TypeCache.getModel();
+
+  // Most arguments and instructions get a type, reserve room for them upfront
+  ModelTypesMap TypeMap(F.arg_size() + F.getInstructionCount());
 
   const auto *Prototype = Model.prototypeOrDefault(ModelF->prototype());
   auto Layout = abi::FunctionType::Layout::make(*Prototype);
   addArgumentsTypes(F, Layout, Model, TypeMap, PointersOnly);
 
-  for (const BasicBlock *BB : RPOT<const llvm::Function *>(&F)) {
-    for (const Instruction &I : *BB) {
-      std::optional<model::UpcastableType> Result = rc_recur
-        initModelTypesImpl(I,
-                           F,
-                           ModelF,
-                           Model,
-                           PointersOnly,
-                           TypeMap,
-                           VisitedPHIs);
-      if (PointersOnly) {
-        // Skip if it's not a pointer and we are only interested in pointers
-        if (Result.has_value() and !Result->isEmpty()
-            and (*Result)->isPointer())
-          TypeMap.insert({ &I, std::move(*Result) });
+  for (const BasicBlock *BB : RPOT<const llvm::Function *>(&F))
+    for (const Instruction &I : *BB)
+      addInstructionType(I, F, ModelF, TypeCache, PointersOnly, TypeMap);
 
-      } else if (Result.has_value()) {
-        TypeMap.insert({ &I, std::move(*Result) });
+  return TypeMap;
+}
 
-      } else if (I.getType()->isIntOrPtrTy()) {
-        // As a fallback, use the LLVM type
-        TypeMap.insert({ &I, llvmIntToModelType(I.getType(), Model) });
+char InitModelTypesAnalysis::ID = 0;
 
-      } else if (auto *Call = llvm::dyn_cast<llvm::CallInst>(&I)) {
-        // TODO: is there more we can check here?
+using Register = llvm::RegisterPass<InitModelTypesAnalysis>;
+static Register X("init-model-types",
+                  "Associate a model type to each instruction",
+                  false,
+                  true);
 
-      } else {
-        revng_abort("Couldn't process a type.");
-      }
-    }
-  }
+bool InitModelTypesAnalysis::runOnFunction(llvm::Function &F) {
+  releaseMemory();
+
+  this->F = &F;
+  Model = getAnalysis<LoadModelWrapperPass>().get().getReadOnlyModel().get();
+  ModelF = llvmToModelFunction(*Model, F);
+  revng_assert(ModelF != nullptr);
 
-  rc_return TypeMap;
+  // The types in TypeCache only depend on the model, keep them for the next
+  // functions
+  if (not TypeCache.has_value() or &TypeCache->getModel() != Model)
+    TypeCache.emplace(*Model);
+
+  return false;
 }
 
-ModelTypesMap initModelTypes(const llvm::Function &F,
-                             const model::Function *ModelF,
-                             const model::Binary &Model,
-                             bool PointersOnly) {
-  return initModelTypesImpl(F, ModelF, Model, PointersOnly);
+void InitModelTypesAnalysis::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+  AU.setPreservesAll();
+  AU.addRequired<LoadModelWrapperPass>();
+}
+
+const ModelTypesMap &InitModelTypesAnalysis::get(bool PointersOnly) {
+  revng_assert(F != nullptr);
+
+  std::optional<ModelTypesMap> &Types = Cache[PointersOnly];
+  if (not Types.has_value())
+    Types = initModelTypes(*F, ModelF, *TypeCache, PointersOnly);
+
+  return *Types;
+}
+
+ModelTypesMap InitModelTypesAnalysis::take(bool PointersOnly) {
+  get(PointersOnly);
+  ModelTypesMap Result = std::move(*Cache[PointersOnly]);
+  Cache[PointersOnly].reset();
+  return Result;
+}
+
+void InitModelTypesAnalysis::forget(const llvm::Value *V) {
+  for (std::optional<ModelTypesMap> &Types : Cache)
+    if (Types.has_value())
+      Types->erase(V);
+}
+
+void InitModelTypesAnalysis::update(const llvm::Instruction &I) {
+  revng_assert(I.getFunction() == F);
+
+  for (bool PointersOnly : { false, true }) {
+    std::optional<ModelTypesMap> &Types = Cache[PointersOnly];
+    if (not Types.has_value())
+      continue;
+
+    // Types flow from operands to users, so whenever the type of an
+    // instruction changes, its users have to be recomputed too. Each
+    // instruction is recomputed at most once, which guarantees termination in
+    // presence of loops through PHIs.
+    llvm::SmallPtrSet<const Instruction *, 16> Visited;
+    llvm::SmallVector<const Instruction *, 16> WorkList = { &I };
+    while (not WorkList.empty()) {
+      const Instruction *Current = WorkList.pop_back_val();
+      if (not Visited.insert(Current).second)
+        continue;
+
+      std::optional<model::UpcastableType> OldType;
+      if (auto It = Types->find(Current); It != Types->end()) {
+        OldType = It->second.copy();
+        Types->erase(It);
+      }
+
+      addInstructionType(*Current,
+                         *F,
+                         ModelF,
+                         *TypeCache,
+                         PointersOnly,
+                         *Types);
+
+      auto It = Types->find(Current);
+      bool HasType = It != Types->end();
+      bool Changed = HasType != OldType.has_value()
+                     or (HasType and It->second != *OldType);
+      if (not Changed)
+        continue;
+
+      for (const llvm::User *U : Current->users())
+        if (auto *UserInstruction = dyn_cast<Instruction>(U))
+          WorkList.push_back(UserInstruction);
+    }
+  }
 }
@@ -3,8 +3,12 @@
 //
 
 #include <optional>
+#include <vector>
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
 
 #include "revng/ABI/FunctionType/Layout.h"
 #include "revng/Model/IRHelpers.h"
@@ -20,6 +24,7 @@
 #include "revng-c/Pipes/Kinds.h"
 #include "revng-c/PromoteStackPointer/DetectStackSizePass.h"
 #include "revng-c/PromoteStackPointer/InstrumentStackAccessesPass.h"
+#include "revng-c/Support/FunctionLayoutCache.h"
 #include "revng-c/Support/FunctionTags.h"
 
 #include "Helpers.h"
@@ -93,17 +98,37 @@ public:
   FunctionStackInfo(model::Function &Function) : Function(Function) {}
 };
 
+/// A function lacking some information about its stack, and the calls to the
+/// stack markers in it
+struct FunctionToCollect {
+  model::Function *ModelFunction = nullptr;
+  /// Whether the stack frame type of the function is missing
+  bool NeedsStackFrame = false;
+  /// The prototype of the function, if its stack arguments type is missing.
+  /// Only RawFunctionDefinition stack arguments are detected.
+  RawFunctionDefinition *NeedsStackArguments = nullptr;
+
+  /// Calls to StackOffsetMarker-tagged functions
+  llvm::SmallVector<CallInst *, 8> StackOffsets;
+  /// Calls to stack_size_at_call_site
+  llvm::SmallVector<CallInst *, 4> CallSites;
+};
+
 namespace Architecture = model::Architecture;
 
 class DetectStackSize {
 private:
   TupleTree<model::Binary> &Binary;
   std::vector<FunctionStackInfo> FunctionsStackInfo;
+  llvm::MapVector<const llvm::Function *, FunctionToCollect> ToCollect;
   std::map<RawFunctionDefinition *, UpperBoundCollector>
     FunctionTypeStackArguments;
   const size_t CallInstructionPushSize = 0;
   /// Helper for fast model::TypeDefinition size computation
   model::VerifyHelper VH;
+  /// Layouts of the prototypes at call sites. Only used after all the
+  /// prototypes have their final stack arguments size.
+  FunctionLayoutCache Layouts;
 
 public:
   DetectStackSize(TupleTree<model::Binary> &B) :
@@ -112,9 +137,25 @@ public:
 
 public:
   void run(Module &M) {
+    // Find the functions that lack information about the stack first, so that
+    // only their markers are collected.
+    // Note that nothing is persisted across runs: a function is visited again
+    // only as long as its stack frame type or the stack arguments type of its
+    // prototype is missing from the model.
+    for (llvm::Function &F : FunctionTags::Isolated.functions(&M)) {
+      FunctionToCollect Function = getMissingStackInfo(F);
+      if (Function.NeedsStackFrame or Function.NeedsStackArguments != nullptr)
+        ToCollect.insert({ &F, std::move(Function) });
+    }
+
+    if (ToCollect.empty())
+      return;
+
+    collectMarkers(M);
+
     // Collect information about the stack of each function
-    for (llvm::Function &F : FunctionTags::Isolated.functions(&M))
-      collectStackBounds(F);
+    for (const FunctionToCollect &Function : llvm::make_second_range(ToCollect))
+      collectStackBounds(Function);
 
     // At this point we have populated two data structures:
     //
@@ -132,71 +173,122 @@ public:
   }
 
 private:
-  void collectStackBounds(Function &F);
+  FunctionToCollect getMissingStackInfo(Function &F);
+  void collectMarkers(Module &M);
+  void collectStackBounds(const FunctionToCollect &Function);
   void electStackArgumentsSize(RawFunctionDefinition &Prototype,
                                const UpperBoundCollector &Bound) const;
   void electFunctionStackFrameSize(FunctionStackInfo &FSI);
   std::optional<uint64_t> handleCallSite(const CallSite &CallSite);
 };
 
-void DetectStackSize::collectStackBounds(Function &F) {
-
-  // Obtain model::Function corresponding to this llvm::Function
+/// Check whether the stack frame type of \a F or the stack arguments type of
+/// its prototype still have to be detected
+FunctionToCollect DetectStackSize::getMissingStackInfo(Function &F) {
   MetaAddress Entry = getMetaAddressMetadata(&F, "revng.function.entry");
   model::Function &ModelFunction = Binary->Functions().at(Entry);
-  revng_log(Log, "Collecting stack bounds for " << ModelFunction.name().str());
-  LoggerIndent<> Indent(Log);
 
-  // Check if this function already has information about stack
-  // frame/arguments
-  bool NeedsStackFrame = ModelFunction.StackFrameType().isEmpty();
-  bool NeedsStackArguments = false;
-  auto &Prototype = *Binary->prototypeOrDefault(ModelFunction.prototype());
+  FunctionToCollect Result;
+  Result.ModelFunction = &ModelFunction;
+  Result.NeedsStackFrame = ModelFunction.StackFrameType().isEmpty();
 
   // We only upgrade the stack size of RawFunctionDefinition
-  RawFunctionDefinition *RawPrototype = nullptr;
-  if ((RawPrototype = llvm::dyn_cast<RawFunctionDefinition>(&Prototype)))
-    NeedsStackArguments = RawPrototype->StackArgumentsType().isEmpty();
+  auto &Prototype = *Binary->prototypeOrDefault(ModelFunction.prototype());
+  if (auto *RawPrototype = llvm::dyn_cast<RawFunctionDefinition>(&Prototype))
+    if (RawPrototype->StackArgumentsType().isEmpty())
+      Result.NeedsStackArguments = RawPrototype;
 
-  revng_log(Log, "NeedsStackFrame: " << NeedsStackFrame);
-  revng_log(Log, "NeedsStackArguments: " << NeedsStackArguments);
+  return Result;
+}
 
-  if (not NeedsStackFrame and not NeedsStackArguments)
+/// Record \a Call in \a Function, if it's a call to a stack marker
+static void recordMarker(CallInst *Call, FunctionToCollect &Function) {
+  auto *CalledValue = skipCasts(Call->getCalledOperand());
+  auto *CalledFunction = dyn_cast<llvm::Function>(CalledValue);
+  if (CalledFunction == nullptr)
     return;
 
+  if (FunctionTags::StackOffsetMarker.isTagOf(CalledFunction))
+    Function.StackOffsets.push_back(Call);
+  else if (CalledFunction->getName() == "stack_size_at_call_site")
+    Function.CallSites.push_back(Call);
+}
+
+/// Find the markers through their uses, so that the instructions that are not
+/// related to the stack are never visited. Only the functions in `ToCollect`
+/// are considered.
+void DetectStackSize::collectMarkers(Module &M) {
+  SmallVector<Use *, 16> Worklist;
+  auto EnqueueUses = [&Worklist](Value *V) {
+    for (Use &U : V->uses())
+      Worklist.push_back(&U);
+  };
+
+  for (llvm::Function &Marker : FunctionTags::StackOffsetMarker.functions(&M))
+    EnqueueUses(&Marker);
+
+  if (auto *SSACS = M.getFunction("stack_size_at_call_site"))
+    EnqueueUses(SSACS);
+
+  while (not Worklist.empty()) {
+    Use *U = Worklist.pop_back_val();
+    User *TheUser = U->getUser();
+
+    // Look through the casts, as the markers might be called through them
+    auto *Expression = dyn_cast<ConstantExpr>(TheUser);
+    if (isa<CastInst>(TheUser) or (Expression and Expression->isCast())) {
+      EnqueueUses(TheUser);
+      continue;
+    }
+
+    // Ignore anything that is not a call to the marker itself
+    auto *Call = dyn_cast<CallInst>(TheUser);
+    if (Call == nullptr or not Call->isCallee(U))
+      continue;
+
+    auto It = ToCollect.find(Call->getFunction());
+    if (It != ToCollect.end())
+      recordMarker(Call, It->second);
+  }
+}
+
+void DetectStackSize::collectStackBounds(const FunctionToCollect &Function) {
+  model::Function &ModelFunction = *Function.ModelFunction;
+  revng_log(Log, "Collecting stack bounds for " << ModelFunction.name().str());
+  LoggerIndent<> Indent(Log);
+
+  bool NeedsStackFrame = Function.NeedsStackFrame;
+  RawFunctionDefinition *RawPrototype = Function.NeedsStackArguments;
+  revng_log(Log, "NeedsStackFrame: " << NeedsStackFrame);
+  revng_log(Log, "NeedsStackArguments: " << (RawPrototype != nullptr));
+
+  revng_assert(NeedsStackFrame or RawPrototype != nullptr);
+
   FunctionStackInfo FSI(ModelFunction);
 
   // Go over all stack accesses and record the extremes
   UpperBoundCollector UpperBound;
   LowerBoundCollector LowerBound;
-  for (llvm::BasicBlock &BB : F) {
-    for (Instruction &I : BB) {
-      if (auto *Call = dyn_cast<CallInst>(&I)) {
-        auto *CalledValue = skipCasts(Call->getCalledOperand());
-        if (auto *CalledFunction = dyn_cast<llvm::Function>(CalledValue)) {
-          if (FunctionTags::StackOffsetMarker.isTagOf(CalledFunction)) {
-            revng_log(Log, "Considering stack offset marker " << getName(Call));
-            // This is a call to a stack_offset function, let's record the
-            // offset
-            setBound(LowerBound, Call->getArgOperand(1));
-            setBound(UpperBound, Call->getArgOperand(2));
-          } else if (CalledFunction->getName() == "stack_size_at_call_site") {
-            revng_log(Log, "Considering call site " << getName(Call));
-            auto &NewCallSite = FSI.CallSites.emplace_back();
-
-            // Try to get the stack offset
-            Value *StackOffsetArgument = Call->getArgOperand(0);
-            if (auto *Offset = dyn_cast<ConstantInt>(StackOffsetArgument))
-              NewCallSite.StackSize = Offset->getLimitedValue();
-
-            // Get the prototype
-            const auto &Proto = *getCallSitePrototype(*Binary.get(),
-                                                      findAssociatedCall(Call));
-            NewCallSite.CallType = Proto.key();
-          }
-        }
-      }
-    }
+  for (CallInst *Call : Function.StackOffsets) {
+    revng_log(Log, "Considering stack offset marker " << getName(Call));
+    // This is a call to a stack_offset function, let's record the offset
+    setBound(LowerBound, Call->getArgOperand(1));
+    setBound(UpperBound, Call->getArgOperand(2));
+  }
+
+  for (CallInst *Call : Function.CallSites) {
+    revng_log(Log, "Considering call site " << getName(Call));
+    auto &NewCallSite = FSI.CallSites.emplace_back();
+
+    // Try to get the stack offset
+    Value *StackOffsetArgument = Call->getArgOperand(0);
+    if (auto *Offset = dyn_cast<ConstantInt>(StackOffsetArgument))
+      NewCallSite.StackSize = Offset->getLimitedValue();
+
+    // Get the prototype
+    const auto &Proto = *getCallSitePrototype(*Binary.get(),
+                                              findAssociatedCall(Call));
+    NewCallSite.CallType = Proto.key();
   }
 
   if (NeedsStackFrame) {
@@ -211,7 +303,7 @@ void DetectStackSize::collectStackBounds(Function &F) {
     FunctionsStackInfo.push_back(std::move(FSI));
   }
 
-  if (NeedsStackArguments and UpperBound.hasValue()) {
+  if (RawPrototype != nullptr and UpperBound.hasValue()) {
     // For stack arguments, we reason prototype-wise, not function-wise.
     // Record for processing later.
     FunctionTypeStackArguments[RawPrototype].record(UpperBound.value());
@@ -292,7 +384,7 @@ DetectStackSize::handleCallSite(const CallSite &CallSite) {
   using namespace abi::FunctionType;
   uint64_t StackArgumentSize = 0;
   for (auto &Prototype = *Binary->TypeDefinitions().at(CallSite.CallType).get();
-       Layout::Argument & Argument : Layout::make(Prototype).Arguments) {
+       const Layout::Argument &Argument : Layouts.get(Prototype).Arguments) {
     if (Argument.Stack.has_value()) {
       StackArgumentSize = std::max(StackArgumentSize,
                                    Argument.Stack->Offset
@@ -6,6 +6,7 @@
 #include <set>
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
@@ -13,7 +14,6 @@
 #include "revng/ABI/FunctionType/Layout.h"
 #include "revng/BasicAnalyses/GeneratedCodeBasicInfo.h"
 #include "revng/MFP/MFP.h"
-#include "revng/MFP/SetLattices.h"
 #include "revng/Model/IRHelpers.h"
 #include "revng/Model/LoadModelPass.h"
 #include "revng/Model/VerifyHelper.h"
@@ -26,6 +26,8 @@
 
 #include "revng-c/Pipes/Kinds.h"
 #include "revng-c/PromoteStackPointer/InstrumentStackAccessesPass.h"
+#include "revng-c/PromoteStackPointer/StoredRanges.h"
+#include "revng-c/Support/FunctionLayoutCache.h"
 #include "revng-c/Support/FunctionTags.h"
 #include "revng-c/Support/IRHelpers.h"
 #include "revng-c/Support/ModelHelpers.h"
@@ -103,20 +105,6 @@ static std::optional<int64_t> getStackOffset(Instruction *I) {
   return {};
 }
 
-struct StoredByte {
-  int64_t StackOffset = 0;
-  llvm::StoreInst *Store = nullptr;
-  unsigned StoreOffset = 0;
-
-  bool operator<(const StoredByte &Other) const {
-    auto ThisTuple = std::tie(StackOffset, Store, StoreOffset);
-    auto OtherTuple = std::tie(Other.StackOffset,
-                               Other.Store,
-                               Other.StoreOffset);
-    return ThisTuple < OtherTuple;
-  }
-};
-
 class StackAccessRedirector {
 private:
   using Span = abi::FunctionType::Layout::Argument::StackSpan;
@@ -194,12 +182,21 @@ public:
   void dump() const debug_function { dump(dbg); }
 };
 
-using Lattice = std::set<StoredByte>;
-
-struct SegregateStackAccessesMFI : public SetUnionLattice<Lattice> {
+struct SegregateStackAccessesMFI {
+  using LatticeElement = StoredRanges;
   using Label = llvm::BasicBlock *;
   using GraphType = llvm::Function *;
 
+  static LatticeElement combineValues(const LatticeElement &LHS,
+                                      const LatticeElement &RHS) {
+    return StoredRanges::combineValues(LHS, RHS);
+  }
+
+  static bool isLessOrEqual(const LatticeElement &LHS,
+                            const LatticeElement &RHS) {
+    return StoredRanges::isLessOrEqual(LHS, RHS);
+  }
+
   static LatticeElement applyTransferFunction(llvm::BasicBlock *BB,
                                               const LatticeElement &Value) {
     using namespace llvm;
@@ -231,14 +228,11 @@ struct SegregateStackAccessesMFI : public SetUnionLattice<Lattice> {
       int64_t EndStackOffset = StartStackOffset + AccessSize;
 
       // Erase all the existing entries
-      // TODO: use lower_bound instead of scanning everything
-      StackBytes.erase(StackBytes.lower_bound(StoredByte{ StartStackOffset }),
-                       StackBytes.upper_bound(StoredByte{ EndStackOffset }));
+      StackBytes.erase(StartStackOffset, EndStackOffset);
 
       // If it's a store, record all of its bytes
       if (auto *Store = dyn_cast<StoreInst>(&I))
-        for (unsigned I = 0; I < AccessSize; ++I)
-          StackBytes.insert({ StartStackOffset + I, Store, I });
+        StackBytes.insert(Store, StartStackOffset, AccessSize);
     }
 
     return StackBytes;
@@ -254,8 +248,7 @@ struct SortByFunction {
 
 class SegregateStackAccesses : public pipeline::FunctionPassImpl {
 private:
-  using MFIResult = std::map<BasicBlock *,
-                             MFP::MFPResult<std::set<StoredByte>>>;
+  using MFIResult = std::map<BasicBlock *, MFP::MFPResult<StoredRanges>>;
 
 private:
   const model::Binary &Binary;
@@ -268,6 +261,8 @@ private:
   /// Builder for StackArgumentsAllocator calls
   IRBuilder<> SABuilder;
   model::VerifyHelper VH;
+  /// Layouts of the prototypes used by the function being processed.
+  FunctionLayoutCache Layouts;
   const size_t CallInstructionPushSize = 0;
   Type *StackPointerType = nullptr;
   std::map<Function *, Function *> OldToNew;
@@ -352,6 +347,10 @@ public:
 
   bool runOnFunction(const model::Function &ModelFunction,
                      llvm::Function &Function) final {
+    // Model reads are tracked per function, so a layout computed while
+    // processing another function cannot be reused here: we'd miss reading
+    // the corresponding prototype.
+    Layouts.clear();
 
     llvm::Function &NewFunction = upgradeLocalFunction(&Function);
     segregateStackAccesses(NewFunction);
@@ -900,7 +899,7 @@ private:
     // Obtain the prototype
     const auto &Prototype = *getCallSitePrototype(Binary, SSACSCall);
     using namespace abi::FunctionType;
-    abi::FunctionType::Layout Layout = Layout::make(Prototype);
+    const abi::FunctionType::Layout &Layout = Layouts.get(Prototype);
 
     // Find old call instruction
     CallInst *OldCall = findAssociatedCall(SSACSCall);
@@ -1274,7 +1273,7 @@ private:
 
     int64_t StackSizeAtCallSite = *MaybeStackSize;
 
-    // Identify all the StoredBytes targeting this call sites' stack
+    // Identify all the stored bytes targeting this call sites' stack
     // arguments
     struct StoreInfo {
       unsigned Count = 0;
@@ -1282,12 +1281,11 @@ private:
     };
     std::map<StoreInst *, StoreInfo> Stores;
     BasicBlock *BB = SSACSCall->getParent();
-    const std::set<StoredByte> &BlockFinalResult = AnalysisResult.at(BB)
-                                                     .OutValue;
-    for (const StoredByte &Byte : BlockFinalResult) {
-      StoreInfo &Info = Stores[Byte.Store];
-      Info.Count += 1;
-      Info.Offset = Byte.StackOffset - Byte.StoreOffset;
+    const StoredRanges &BlockFinalResult = AnalysisResult.at(BB).OutValue;
+    for (const StoredRange &Range : BlockFinalResult) {
+      StoreInfo &Info = Stores[Range.Store];
+      Info.Count += Range.End - Range.Start;
+      Info.Offset = Range.StoreStart;
     }
 
     // Process MarkedStores
@@ -1417,7 +1415,7 @@ private:
   recreateApplyingModelPrototype(Function *OldFunction,
                                  const model::TypeDefinition &Prototype) {
     using namespace abi::FunctionType;
-    auto Layout = Layout::make(Prototype);
+    const abi::FunctionType::Layout &Layout = Layouts.get(Prototype);
 
     Type *OldReturnType = OldFunction->getReturnType();
     FunctionType &NewType = layoutToLLVMFunctionType(Layout, OldReturnType);
@@ -37,11 +37,11 @@ private:
   private:
     Module &M;
     LLVMContext &Context;
-    const model::Binary &Model;
+    ModelTypeCache TypeCache;
 
   public:
     Impl(Module &TheModule, const model::Binary &TheModel) :
-      M(TheModule), Context(M.getContext()), Model(TheModel) {}
+      M(TheModule), Context(M.getContext()), TypeCache(TheModel) {}
 
     bool run();
 
@@ -88,8 +88,8 @@ bool CleanupIRPass::Impl::replaceInstructions(Function &F) {
           Callee and Callee->getName().startswith("revng_stack_frame")) {
         AllocatedSize = Call->getArgOperand(0);
       } else {
-        model::UpcastableType
-          AllocatedType = fromLLVMString(Call->getArgOperand(0), Model);
+        const model::UpcastableType
+          &AllocatedType = TypeCache.get(Call->getArgOperand(0));
         AllocatedSize = ConstantInt::get(Context,
                                          APInt(/*NumBits*/ 64,
                                                AllocatedType->size().value()));
@@ -9,6 +9,7 @@
 #include <iostream>
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Constants.h"
 
 #include "revng-c/RestructureCFG/ASTNode.h"
@@ -33,6 +34,8 @@ IfNode *ContinueNode::getComputationIfNode() const {
 // #### updateASTNodesPointers methods ####
 
 void IfNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
+  invalidateStructuralHashes();
+
   // Update the pointers to the `then` and `else` branches.
   if (hasThen()) {
     revng_assert(SubstitutionMap.contains(Then));
@@ -46,6 +49,7 @@ void IfNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
 }
 
 void ScsNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
+  invalidateStructuralHashes();
   if (RelatedCondition)
     RelatedCondition = llvm::cast<IfNode>(SubstitutionMap.at(RelatedCondition));
   revng_assert(Body);
@@ -53,6 +57,8 @@ void ScsNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
 }
 
 void SequenceNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
+  invalidateStructuralHashes();
+
   // Update all the pointers of the sequence node.
   for (auto NodeIt = NodeVec.begin(); NodeIt != NodeVec.end(); NodeIt++) {
     ASTNode *Node = *NodeIt;
@@ -63,6 +69,7 @@ void SequenceNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
 }
 
 void SwitchNode::updateASTNodesPointers(ASTNodeMap &SubstitutionMap) {
+  invalidateStructuralHashes();
 
   // The `default` case, if present, is now handled in the normal iteration over
   // the `case`s
@@ -127,19 +134,21 @@ bool IfNode::nodeIsEqual(const ASTNode *Node) const {
   if (OtherIf == nullptr)
     return false;
 
-  if ((getOriginalBB() != nullptr)
-      and (getOriginalBB() == OtherIf->getOriginalBB())) {
-
-    // TODO: this is necessary since we may not have one between `then` or
-    //       `else` branches, refactor in a more elegant way
-    bool ComparisonState = true;
-    if (hasThen())
-      ComparisonState = Then->isEqual(OtherIf->getThen());
-    if (hasElse())
-      ComparisonState = Else->isEqual(OtherIf->getElse());
-    return ComparisonState;
-  }
-  return false;
+  if ((getOriginalBB() == nullptr)
+      or (getOriginalBB() != OtherIf->getOriginalBB()))
+    return false;
+
+  // We may not have one between `then` or `else` branches, in which case the
+  // other `IfNode` must be missing it too.
+  const auto BranchIsEqual = [](const ASTNode *Branch,
+                                const ASTNode *OtherBranch) {
+    if (Branch == nullptr)
+      return OtherBranch == nullptr;
+    return Branch->isEqual(OtherBranch);
+  };
+
+  return BranchIsEqual(Then, OtherIf->getThen())
+         and BranchIsEqual(Else, OtherIf->getElse());
 }
 
 bool ScsNode::nodeIsEqual(const ASTNode *Node) const {
@@ -180,6 +189,68 @@ bool SequenceNode::nodeIsEqual(const ASTNode *Node) const {
   return true;
 }
 
+// #### Structural hash ####
+
+llvm::hash_code ASTNode::computeStructuralHash() const {
+  // Keep this in sync with the `nodeIsEqual` methods: whatever they don't look
+  // at (e.g., the conditions of `IfNode`s) must not contribute to the hash.
+  switch (getKind()) {
+  case NK_Code:
+    return llvm::hash_combine(getKind(), getOriginalBB());
+
+  case NK_Break:
+  case NK_Continue:
+  case NK_SwitchBreak:
+    return llvm::hash_combine(getKind());
+
+  case NK_If: {
+    auto *If = cast<IfNode>(this);
+    return llvm::hash_combine(getKind(),
+                              getOriginalBB(),
+                              getChildStructuralHash(If->getThen()),
+                              getChildStructuralHash(If->getElse()));
+  }
+
+  case NK_Scs: {
+    const ASTNode *Body = cast<ScsNode>(this)->getBody();
+    return llvm::hash_combine(getKind(), getChildStructuralHash(Body));
+  }
+
+  case NK_List: {
+    llvm::SmallVector<llvm::hash_code, 8> Hashes;
+    for (const ASTNode *Node : cast<SequenceNode>(this)->nodes())
+      Hashes.push_back(getChildStructuralHash(Node));
+    return llvm::hash_combine(getKind(),
+                              llvm::hash_combine_range(Hashes.begin(),
+                                                       Hashes.end()));
+  }
+
+  case NK_Switch: {
+    llvm::SmallVector<llvm::hash_code, 8> Hashes;
+    for (const auto &[Labels, Case] :
+         cast<SwitchNode>(this)->cases_const_range()) {
+      // Label sets are compared regardless of their order.
+      size_t LabelsHash = 0;
+      for (uint64_t Label : Labels)
+        LabelsHash += llvm::hash_value(Label);
+      Hashes.push_back(llvm::hash_combine(LabelsHash,
+                                          getChildStructuralHash(Case)));
+    }
+    return llvm::hash_combine(getKind(),
+                              getOriginalBB(),
+                              llvm::hash_combine_range(Hashes.begin(),
+                                                       Hashes.end()));
+  }
+
+  case NK_Set:
+    return llvm::hash_combine(getKind(),
+                              cast<SetNode>(this)->getStateVariableValue());
+
+  default:
+    revng_abort();
+  }
+}
+
 // #### Dump methods ####
 
 void CodeNode::dump(llvm::raw_fd_ostream &ASTFile) {
@@ -4,6 +4,7 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <atomic>
 #include <cstdlib>
 
 #include "llvm/Support/FileSystem.h"
@@ -18,8 +19,8 @@ using ASTNodeMap = std::map<ASTNode *, ASTNode *>;
 using ExprNodeMap = std::map<ExprNode *, ExprNode *>;
 
 // Helper to obtain a unique incremental counter (to give name to sequence
-// nodes).
-static int Counter = 1;
+// nodes). It's atomic since functions can be restructured concurrently.
+static std::atomic<int> Counter = 1;
 static std::string getID() {
   return std::to_string(Counter++);
 }
@@ -27,6 +28,7 @@ static std::string getID() {
 SwitchBreakNode *ASTTree::addSwitchBreak(SwitchNode *SN) {
   ASTNodeList.emplace_back(new SwitchBreakNode(SN));
   ASTNodeList.back()->setID(getNewID());
+  ASTNodeList.back()->setStructuralHashState(HashState.get());
   return llvm::cast<SwitchBreakNode>(ASTNodeList.back().get());
 }
 
@@ -35,6 +37,7 @@ SequenceNode *ASTTree::addSequenceNode() {
 
   // Set the Node ID
   ASTNodeList.back()->setID(getNewID());
+  ASTNodeList.back()->setStructuralHashState(HashState.get());
 
   return llvm::cast<SequenceNode>(ASTNodeList.back().get());
 }
@@ -49,6 +52,7 @@ ASTNode *ASTTree::addASTNodeImpl(ast_unique_ptr &&ASTObject) {
 
   // Set the Node ID
   ASTNode->setID(getNewID());
+  ASTNode->setStructuralHashState(HashState.get());
 
   return ASTNode;
 }
@@ -117,6 +121,7 @@ ASTNode *ASTTree::copyASTNodesFrom(ASTTree &OldAST) {
 
     // Set the Node ID
     NewASTNode->setID(getNewID());
+    NewASTNode->setStructuralHashState(HashState.get());
 
     BasicBlockNode<BasicBlock *> *OldCFGNode = OldAST.findCFGNode(Old);
     if (OldCFGNode != nullptr) {
@@ -131,10 +131,12 @@ static bool hasSideEffects(IfNode *If) {
 
 using UniqueExpr = ASTTree::expr_unique_ptr;
 
-// Helper function to simplify short-circuit IFs
+// Helper function to simplify short-circuit IFs.
+// It runs while the structural hashes are cached, hence it visits the children
+// through the const accessors.
 static void simplifyShortCircuit(ASTNode *RootNode, ASTTree &AST) {
 
-  if (auto *Sequence = llvm::dyn_cast<SequenceNode>(RootNode)) {
+  if (const auto *Sequence = llvm::dyn_cast<SequenceNode>(RootNode)) {
     for (ASTNode *Node : Sequence->nodes()) {
       simplifyShortCircuit(Node, AST);
     }
@@ -143,7 +145,7 @@ static void simplifyShortCircuit(ASTNode *RootNode, ASTTree &AST) {
     simplifyShortCircuit(Scs->getBody(), AST);
   } else if (auto *Switch = llvm::dyn_cast<SwitchNode>(RootNode)) {
 
-    for (auto &LabelCasePair : Switch->cases())
+    for (const auto &LabelCasePair : Switch->cases_const_range())
       simplifyShortCircuit(LabelCasePair.second, AST);
 
   } else if (auto *If = llvm::dyn_cast<IfNode>(RootNode)) {
@@ -983,7 +985,11 @@ void beautifyAST(const model::Binary &Model, Function &F, ASTTree &CombedAST) {
 
   // Simplify short-circuit nodes.
   revng_log(BeautifyLogger, "Performing short-circuit simplification\n");
-  simplifyShortCircuit(RootNode, CombedAST);
+  {
+    // Short-circuit simplification compares the same subtrees over and over
+    ASTTree::StructuralHashScope CacheHashes(CombedAST);
+    simplifyShortCircuit(RootNode, CombedAST);
+  }
   Dumper.log("after-short-circuit");
 
   // Flip IFs with empty then branches.
@@ -28,3 +28,81 @@ void ExprNode::deleteExprNode(ExprNode *E) {
     break;
   }
 }
+
+static bool compareIsEqual(const CompareNode *Compare,
+                           const CompareNode *OtherCompare) {
+  return Compare->getComparison() == OtherCompare->getComparison()
+         and Compare->getConstant() == OtherCompare->getConstant();
+}
+
+bool ExprNode::isEqual(const ExprNode *Other) const {
+  if (Other == nullptr or getKind() != Other->getKind())
+    return false;
+
+  switch (getKind()) {
+  case NodeKind::NK_ValueCompare: {
+    auto *Compare = llvm::cast<ValueCompareNode>(this);
+    auto *OtherCompare = llvm::cast<ValueCompareNode>(Other);
+    return Compare->getBasicBlock() == OtherCompare->getBasicBlock()
+           and compareIsEqual(Compare, OtherCompare);
+  }
+  case NodeKind::NK_LoopStateCompare: {
+    return compareIsEqual(llvm::cast<CompareNode>(this),
+                          llvm::cast<CompareNode>(Other));
+  }
+  case NodeKind::NK_Atomic: {
+    auto *Atomic = llvm::cast<AtomicNode>(this);
+    auto *OtherAtomic = llvm::cast<AtomicNode>(Other);
+    return Atomic->getConditionalBasicBlock()
+           == OtherAtomic->getConditionalBasicBlock();
+  }
+  case NodeKind::NK_Not: {
+    const ExprNode *Negated = llvm::cast<NotNode>(this)->getNegatedNode();
+    return Negated->isEqual(llvm::cast<NotNode>(Other)->getNegatedNode());
+  }
+  case NodeKind::NK_And:
+  case NodeKind::NK_Or: {
+    const auto &[Left, Right] = llvm::cast<BinaryNode>(this)
+                                  ->getInternalNodes();
+    const auto &[OtherLeft, OtherRight] = llvm::cast<BinaryNode>(Other)
+                                            ->getInternalNodes();
+    return Left->isEqual(OtherLeft) and Right->isEqual(OtherRight);
+  }
+  }
+
+  revng_abort();
+}
+
+llvm::hash_code ExprNode::getStructuralHash() const {
+  switch (getKind()) {
+  case NodeKind::NK_ValueCompare:
+  case NodeKind::NK_LoopStateCompare: {
+    auto *Compare = llvm::cast<CompareNode>(this);
+    llvm::BasicBlock *BB = nullptr;
+    if (auto *ValueCompare = llvm::dyn_cast<ValueCompareNode>(this))
+      BB = ValueCompare->getBasicBlock();
+    return llvm::hash_combine(getKind(),
+                              Compare->getComparison(),
+                              Compare->getConstant(),
+                              BB);
+  }
+  case NodeKind::NK_Atomic: {
+    auto *Atomic = llvm::cast<AtomicNode>(this);
+    return llvm::hash_combine(getKind(), Atomic->getConditionalBasicBlock());
+  }
+  case NodeKind::NK_Not: {
+    const ExprNode *Negated = llvm::cast<NotNode>(this)->getNegatedNode();
+    return llvm::hash_combine(getKind(), Negated->getStructuralHash());
+  }
+  case NodeKind::NK_And:
+  case NodeKind::NK_Or: {
+    const auto &[Left, Right] = llvm::cast<BinaryNode>(this)
+                                  ->getInternalNodes();
+    return llvm::hash_combine(getKind(),
+                              Left->getStructuralHash(),
+                              Right->getStructuralHash());
+  }
+  }
+
+  revng_abort();
+}
@@ -10,7 +10,12 @@
 // Explicit instantiation for the `RegionCFG` template class.
 template class RegionCFG<llvm::BasicBlock *>;
 
-unsigned DuplicationCounter = 0;
+// These are thread_local since functions can be restructured concurrently, see
+// `-decompiler-jobs`.
+thread_local unsigned DuplicationCounter = 0;
+thread_local unsigned UntangleDuplicationCounter = 0;
 
-unsigned UntangleTentativeCounter = 0;
-unsigned UntanglePerformedCounter = 0;
+thread_local unsigned UntangleTentativeCounter = 0;
+thread_local unsigned UntanglePerformedCounter = 0;
+
+thread_local unsigned DuplicationLimit = 0;
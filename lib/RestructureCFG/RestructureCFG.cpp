@@ -4,13 +4,18 @@
 
 #include <iterator>
 #include <limits>
+#include <map>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include "llvm/ADT/BreadthFirstIterator.h"
 #include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
@@ -29,9 +34,11 @@
 #include "revng-c/RestructureCFG/BasicBlockNodeImpl.h"
 #include "revng-c/RestructureCFG/GenerateAst.h"
 #include "revng-c/RestructureCFG/MetaRegionBB.h"
+#include "revng-c/RestructureCFG/MetaRegionBuilder.h"
 #include "revng-c/RestructureCFG/RegionCFGTreeBB.h"
 #include "revng-c/RestructureCFG/RestructureCFG.h"
 #include "revng-c/RestructureCFG/Utils.h"
+#include "revng-c/Support/Parallel.h"
 
 using namespace llvm;
 using namespace llvm::cl;
@@ -43,6 +50,12 @@ using std::string;
 // Debug logger.
 Logger<> CombLogger("restructure");
 Logger<> LogShortestPath("restructure-shortest-path");
+extern Logger<> GenericRegionInfoLogger;
+
+bool isRestructureLoggingEnabled() {
+  return CombLogger.isEnabled() or LogShortestPath.isEnabled()
+         or GenericRegionInfoLogger.isEnabled();
+}
 
 // EdgeDescriptor is a handy way to create and manipulate edges on the
 // RegionCFG.
@@ -55,201 +68,7 @@ template class RegionCFG<BasicBlock *>;
 using MetaRegionBB = MetaRegion<BasicBlock *>;
 using MetaRegionBBVect = std::vector<MetaRegionBB>;
 using MetaRegionBBPtrVect = std::vector<MetaRegionBB *>;
-using BackedgeMetaRegionMap = std::map<EdgeDescriptor, MetaRegionBB *>;
-
-static bool mergeSCSStep(MetaRegionBBVect &MetaRegions) {
-  for (auto RegionIt1 = MetaRegions.begin(); RegionIt1 != MetaRegions.end();
-       RegionIt1++) {
-    for (auto RegionIt2 = std::next(RegionIt1); RegionIt2 != MetaRegions.end();
-         RegionIt2++) {
-      bool Intersects = (*RegionIt1).intersectsWith(*RegionIt2);
-      bool IsIncluded = (*RegionIt1).isSubSet(*RegionIt2);
-      bool IsIncludedReverse = (*RegionIt2).isSubSet(*RegionIt1);
-      bool AreEquivalent = (*RegionIt1).nodesEquality(*RegionIt2);
-      if (Intersects
-          and (((!IsIncluded) and (!IsIncludedReverse)) or AreEquivalent)) {
-        (*RegionIt1).mergeWith(*RegionIt2);
-        MetaRegions.erase(RegionIt2);
-        return true;
-      }
-    }
-  }
-
-  return false;
-}
-
-static void simplifySCS(MetaRegionBBVect &MetaRegions) {
-  bool Changes = true;
-  while (Changes) {
-    Changes = mergeSCSStep(MetaRegions);
-  }
-}
-
-static bool
-mergeSCSAbnormalRetreating(MetaRegionBBVect &MetaRegions,
-                           const llvm::SmallDenseSet<EdgeDescriptor> &Backedges,
-                           BackedgeMetaRegionMap &BackedgeMetaRegionMap,
-                           std::set<MetaRegionBB *> &BlacklistedMetaregions) {
-  for (auto RegionIt = MetaRegions.begin(); RegionIt != MetaRegions.end();
-       RegionIt++) {
-    MetaRegionBB &Region = *RegionIt;
-
-    // Do not re-analyze blacklisted metaregions.
-    if (!BlacklistedMetaregions.contains(&Region)) {
-
-      // Iterate over all the backedges present in the graph, if the current
-      // region contains the source of a backedge, it should contain also the
-      // the target of that backedge. If not, merge the two SCSs.
-      for (EdgeDescriptor Backedge : Backedges) {
-        bool FirstIn = Region.containsNode(Backedge.first);
-        bool SecondIn = Region.containsNode(Backedge.second);
-        bool AbnormalIncoming = FirstIn and not SecondIn;
-        bool AbnormalOutgoing = not FirstIn and SecondIn;
-        if (AbnormalIncoming or AbnormalOutgoing) {
-
-          // Retrieve the Metaregion identified by the backedge with goes
-          // goes outside the scope of the current Metaregion.
-          MetaRegionBB *OtherRegion = BackedgeMetaRegionMap.at(Backedge);
-          Region.mergeWith(*OtherRegion);
-
-          // Blacklist the region which we have merged.
-          BackedgeMetaRegionMap[Backedge] = &Region;
-          BlacklistedMetaregions.insert(OtherRegion);
-          return true;
-
-          // Abort if we didn't find the metaregion to remove.
-          revng_abort("Not found the region to merge with.");
-        }
-      }
-    }
-  }
-
-  return false;
-}
-
-static void
-simplifySCSAbnormalRetreating(MetaRegionBBVect &MetaRegions,
-                              const llvm::SmallDenseSet<EdgeDescriptor>
-                                &Backedges) {
-
-  // Temporary map where to store the correspondence between the backedge and
-  // the SCS it gives origin to.
-  // HACK: this should be done at the same time of the metaregion creation.
-  unsigned MetaRegionIndex = 0;
-  std::map<EdgeDescriptor, MetaRegionBB *> BackedgeMetaRegionMap;
-  for (EdgeDescriptor Backedge : Backedges) {
-    BackedgeMetaRegionMap[Backedge] = &MetaRegions.at(MetaRegionIndex);
-    MetaRegionIndex++;
-  }
-
-  std::set<MetaRegionBB *> BlacklistedMetaregions;
-  bool Changes = true;
-  while (Changes) {
-    Changes = mergeSCSAbnormalRetreating(MetaRegions,
-                                         Backedges,
-                                         BackedgeMetaRegionMap,
-                                         BlacklistedMetaregions);
-  }
-
-  // Remove all the metaregion that have been merged with others, using the
-  // erase/remove idiom.
-  MetaRegions.erase(remove_if(MetaRegions.begin(),
-                              MetaRegions.end(),
-                              [&BlacklistedMetaregions](MetaRegionBB &M) {
-                                return BlacklistedMetaregions.count(&M) == 1;
-                              }),
-                    MetaRegions.end());
-}
-
-static void sortMetaRegions(MetaRegionBBVect &MetaRegions) {
-  std::sort(MetaRegions.begin(),
-            MetaRegions.end(),
-            [](MetaRegionBB &First, MetaRegionBB &Second) {
-              return First.getNodes().size() < Second.getNodes().size();
-            });
-}
-
-static bool checkMetaregionConsistency(const MetaRegionBBVect &MetaRegions,
-                                       const llvm::SmallDenseSet<EdgeDescriptor>
-                                         &Backedges) {
-  bool ComparisonState = true;
-  for (const MetaRegionBB &MetaRegion : MetaRegions) {
-    for (EdgeDescriptor Backedge : Backedges) {
-      BasicBlockNodeBB *Source = Backedge.first;
-      BasicBlockNodeBB *Target = Backedge.second;
-      bool HasSource = MetaRegion.containsNode(Source);
-      bool HasTarget = MetaRegion.containsNode(Target);
-      revng_assert(HasSource == HasTarget);
-      if (HasSource != HasTarget) {
-        ComparisonState = false;
-      }
-    }
-  }
-
-  return ComparisonState;
-}
-
-static void computeParents(MetaRegionBBVect &MetaRegions) {
-  for (MetaRegionBB &MetaRegion1 : MetaRegions) {
-    bool ParentFound = false;
-    for (MetaRegionBB &MetaRegion2 : MetaRegions) {
-      if (&MetaRegion1 != &MetaRegion2) {
-        if (MetaRegion1.isSubSet(MetaRegion2)) {
-
-          if (CombLogger.isEnabled()) {
-            CombLogger << "For metaregion: " << &MetaRegion1 << "\n";
-            CombLogger << "parent found\n";
-            CombLogger << &MetaRegion2 << "\n";
-          }
-
-          MetaRegion1.setParent(&MetaRegion2);
-          ParentFound = true;
-          break;
-        }
-      }
-    }
-
-    if (!ParentFound) {
-
-      if (CombLogger.isEnabled()) {
-        CombLogger << "For metaregion: " << &MetaRegion1 << "\n";
-        CombLogger << "no parent found\n";
-      }
-
-      MetaRegion1.setParent(nullptr);
-    }
-  }
-}
-
-static MetaRegionBBPtrVect applyPartialOrder(MetaRegionBBVect &V) {
-  MetaRegionBBPtrVect OrderedVector;
-  std::set<MetaRegionBB *> Processed;
-
-  while (V.size() != Processed.size()) {
-    for (auto RegionIt1 = V.begin(); RegionIt1 != V.end(); RegionIt1++) {
-      if (!Processed.contains(&*RegionIt1)) {
-        bool FoundParent = false;
-        for (auto RegionIt2 = V.begin(); RegionIt2 != V.end(); RegionIt2++) {
-          if ((RegionIt1 != RegionIt2) and !Processed.contains(&*RegionIt2)) {
-            if ((*RegionIt1).getParent() == &*RegionIt2) {
-              FoundParent = true;
-              break;
-            }
-          }
-        }
-
-        if (FoundParent == false) {
-          OrderedVector.push_back(&*RegionIt1);
-          Processed.insert(&*RegionIt1);
-          break;
-        }
-      }
-    }
-  }
-
-  std::reverse(OrderedVector.begin(), OrderedVector.end());
-  return OrderedVector;
-}
+using MetaRegionBuilderBB = MetaRegionBuilder<BasicBlock *>;
 
 static bool alreadyInMetaregion(MetaRegionBBVect &V, BasicBlockNodeBB *N) {
   for (MetaRegionBB &Region : V)
@@ -258,75 +77,34 @@ static bool alreadyInMetaregion(MetaRegionBBVect &V, BasicBlockNodeBB *N) {
   return false;
 }
 
-static MetaRegionBBVect
-createMetaRegions(const llvm::SmallDenseSet<EdgeDescriptor> &Backedges) {
-  std::map<BasicBlockNodeBB *, std::set<BasicBlockNodeBB *>> AdditionalSCSNodes;
-  std::vector<std::pair<BasicBlockNodeBB *, std::set<BasicBlockNodeBB *>>>
-    Regions;
-
-  for (auto &Backedge : Backedges) {
-
-    // Convert the `llvm::SmallSetVector` generated by the `nodesBetween` to a
-    // `std::set`, whose ordering properties are necessary for the following of
-    // the restructuring algorithm
-    auto SCSNodesSmall = nodesBetween(Backedge.second, Backedge.first);
-    std::set<BasicBlockNodeBB *> SCSNodes;
-    SCSNodes.insert(SCSNodesSmall.begin(), SCSNodesSmall.end());
-    AdditionalSCSNodes[Backedge.second].insert(SCSNodes.begin(),
-                                               SCSNodes.end());
-
-    if (CombLogger.isEnabled()) {
-      CombLogger << "SCS identified by: ";
-      CombLogger << Backedge.first->getNameStr() << " -> "
-                 << Backedge.second->getNameStr() << "\n";
-      CombLogger << "Is composed of nodes:\n";
-      for (auto Node : SCSNodes) {
-        CombLogger << Node->getNameStr() << "\n";
-      }
-    }
-
-    Regions.push_back(std::make_pair(Backedge.second, SCSNodes));
-  }
-
-  // Include in the regions found before other possible sub-regions, if an edge
-  // which is the target of a backedge is included in an outer region.
-  for (auto &Region : Regions) {
-    BasicBlockNodeBB *Head = Region.first;
-    std::set<BasicBlockNodeBB *> &Nodes = Region.second;
-    std::set<BasicBlockNodeBB *> AdditionalNodes;
-    std::set<BasicBlockNodeBB *> OldNodes;
-    do {
-      OldNodes = Nodes;
-      for (BasicBlockNodeBB *Node : Nodes) {
-        if ((Node != Head) and (AdditionalSCSNodes.contains(Node))) {
-          CombLogger << "Adding additional nodes for region with head: ";
-          CombLogger << Head->getNameStr();
-          CombLogger << " and relative to node: ";
-          CombLogger << Node->getNameStr() << "\n";
-          AdditionalNodes.insert(AdditionalSCSNodes[Node].begin(),
-                                 AdditionalSCSNodes[Node].end());
-        }
-      }
-      Nodes.insert(AdditionalNodes.begin(), AdditionalNodes.end());
-      AdditionalNodes.clear();
-    } while (Nodes != OldNodes);
-  }
-
-  MetaRegionBBVect MetaRegions;
-  int SCSIndex = 1;
-  for (size_t I = 0; I < Regions.size(); ++I) {
-    auto &SCS = Regions[I].second;
-    MetaRegions.push_back(MetaRegionBB(SCSIndex, SCS, true));
-    SCSIndex++;
-  }
-  return MetaRegions;
-}
-
 static cl::opt<std::string> MetricsOutputPath("restructure-metrics-output-dir",
                                               desc("Restructure metrics dir"),
                                               value_desc("restructure-dir"),
                                               cat(MainCategory));
 
+static cl::opt<unsigned> RegionJobs("restructure-region-jobs",
+                                    desc("Number of threads used to "
+                                         "restructure the independent regions "
+                                         "of a single function. 0 means one "
+                                         "per available core. Note that this "
+                                         "multiplies with -decompiler-jobs."),
+                                    init(1),
+                                    cat(MainCategory));
+
+static cl::opt<unsigned> DuplicationBudget("restructure-duplication-budget",
+                                           desc("Maximum number of nodes "
+                                                "that can be cloned while "
+                                                "restructuring a function. "
+                                                "Functions exceeding it are "
+                                                "restructured again, reaching "
+                                                "the nodes with several "
+                                                "predecessors through a "
+                                                "dispatcher instead of "
+                                                "cloning them, except within "
+                                                "loops. 0 means no limit."),
+                                           init(0),
+                                           cat(MainCategory));
+
 static void LogMetaRegions(const MetaRegionBBPtrVect &MetaRegions,
                            const std::string &HeaderMsg) {
   if (CombLogger.isEnabled()) {
@@ -458,14 +236,210 @@ static MetaRegionBB *computePredecessorsParent(MetaRegionBBPtrVect &MetaRegions,
   return mostNestedRegion(PredecessorMetaRegions);
 }
 
-bool restructureCFG(Function &F, ASTTree &AST) {
+using RegionT = RegionCFG<BasicBlock *>;
+
+/// Collect in \a Levels the regions nested in \a Region, grouped by their
+/// height in the region tree. Return the height of \a Region.
+static unsigned
+collectNestedRegions(RegionT &Region,
+                     std::map<RegionT *, unsigned> &Heights,
+                     std::vector<std::vector<RegionT *>> &Levels) {
+  unsigned Height = 0;
+  for (BasicBlockNodeBB *Node : Region.nodes()) {
+    if (not Node->isCollapsed())
+      continue;
+
+    RegionT *Body = Node->getCollapsedCFG();
+    auto It = Heights.find(Body);
+    if (It == Heights.end()) {
+      unsigned BodyHeight = collectNestedRegions(*Body, Heights, Levels);
+      It = Heights.insert({ Body, BodyHeight }).first;
+
+      if (Levels.size() <= BodyHeight)
+        Levels.resize(BodyHeight + 1);
+      Levels[BodyHeight].push_back(Body);
+    }
+
+    Height = std::max(Height, It->second + 1);
+  }
+
+  return Height;
+}
+
+namespace {
+
+/// Snapshot of the restructuring counters of the current thread
+struct RestructureCounters {
+  unsigned Duplications = 0;
+  unsigned UntangleDuplications = 0;
+  unsigned UntangleTentative = 0;
+  unsigned UntanglePerformed = 0;
+
+  static RestructureCounters current() {
+    return { DuplicationCounter,
+             UntangleDuplicationCounter,
+             UntangleTentativeCounter,
+             UntanglePerformedCounter };
+  }
+
+  void restore() const {
+    DuplicationCounter = Duplications;
+    UntangleDuplicationCounter = UntangleDuplications;
+    UntangleTentativeCounter = UntangleTentative;
+    UntanglePerformedCounter = UntanglePerformed;
+  }
+
+  /// Add what has been counted going from \a Before to \a After
+  void addDelta(const RestructureCounters &Before,
+                const RestructureCounters &After) {
+    Duplications += After.Duplications - Before.Duplications;
+    UntangleDuplications += After.UntangleDuplications
+                            - Before.UntangleDuplications;
+    UntangleTentative += After.UntangleTentative - Before.UntangleTentative;
+    UntanglePerformed += After.UntanglePerformed - Before.UntanglePerformed;
+  }
+};
+
+} // namespace
+
+/// Generate the ASTs of all the regions nested in \a RootCFG, bottom-up, so
+/// that `generateAst` on the root region finds all of them in \a CollapsedMap.
+///
+/// Regions at the same height in the region tree only depend on the ones
+/// below, so they are processed concurrently, using `-restructure-region-jobs`
+/// threads.
+static void
+generateNestedAsts(RegionT &RootCFG,
+                   std::map<RegionT *, ASTTree> &CollapsedMap) {
+  std::map<RegionT *, unsigned> Heights;
+  std::vector<std::vector<RegionT *>> Levels;
+  collectNestedRegions(RootCFG, Heights, Levels);
+
+  // When recursing top-down, the untangle phase of each region sees the
+  // weights of its collapsed nodes before they are inflated. Compute them all
+  // upfront to get the same result here.
+  for (const std::vector<RegionT *> &Level : Levels)
+    for (RegionT *Region : Level)
+      Region->computeUntangleWeight();
+
+  // Loggers are not thread-safe
+  unsigned Jobs = isRestructureLoggingEnabled() ? 1 : RegionJobs;
+
+  for (const std::vector<RegionT *> &Level : Levels) {
+    // All the regions of a level start counting from the same values, and
+    // what they count is merged afterwards, so that the results do not depend
+    // on the scheduling.
+    RestructureCounters Before = RestructureCounters::current();
+    std::vector<RestructureCounters> After(Level.size());
+    std::vector<ASTTree> ASTs(Level.size());
+
+    // Likewise, each region allocates its nodes and takes their IDs from its
+    // own fork of the arena.
+    const std::shared_ptr<RegionT::ArenaT> &Arena = RootCFG.getArena();
+    RegionT::ArenaT::ForkVector Forks = Arena->fork(Level.size());
+    unsigned Limit = DuplicationLimit;
+    parallelFor(Jobs, Level.size(), [&](unsigned, size_t I) {
+      Before.restore();
+      DuplicationLimit = Limit;
+      Level[I]->setArena(Forks[I]);
+      generateAst(*Level[I], ASTs[I], CollapsedMap);
+      Level[I]->setArena(Arena);
+      After[I] = RestructureCounters::current();
+    });
+    Arena->join(std::move(Forks));
+
+    RestructureCounters Merged = Before;
+    for (size_t I = 0; I < Level.size(); ++I) {
+      Merged.addDelta(Before, After[I]);
+      CollapsedMap.insert({ Level[I], std::move(ASTs[I]) });
+    }
+    Merged.restore();
+
+    // Don't bother with the upper levels, they are going to be discarded.
+    if (isDuplicationLimitExceeded())
+      return;
+  }
+}
+
+/// Make every node of \a RootCFG that has several predecessors, and that is
+/// not part of a loop, reachable only through an entry dispatcher.
+///
+/// Each edge reaching one of these nodes is redirected to a set node, which
+/// then jumps to the dispatcher, and the entry of \a RootCFG is reached in the
+/// same way. The dispatcher and everything that can reach it end up in a
+/// loop, whose body is a tree except for the loops it contains: combing never
+/// needs to clone the nodes of this body.
+///
+/// The nodes that are part of a loop are left alone, since redirecting the
+/// edges within a loop to the dispatcher would merge it with the loop of the
+/// dispatcher. Each loop is still restructured as a region of its own, whose
+/// merges are combed as usual: the clones it needs are not bounded by
+/// `-restructure-duplication-budget`.
+static void routeMergesThroughDispatcher(RegionCFG<BasicBlock *> &RootCFG) {
+  BasicBlockNodeBB *Entry = &RootCFG.getEntryNode();
+
+  SmallPtrSet<BasicBlockNodeBB *, 16> InLoop;
+  for (auto SCCIt = scc_begin(&RootCFG); not SCCIt.isAtEnd(); ++SCCIt)
+    if (SCCIt.hasCycle())
+      InLoop.insert(SCCIt->begin(), SCCIt->end());
+
+  std::vector<BasicBlockNodeBB *> Merges;
+  using RPOTraversal = ReversePostOrderTraversal<BasicBlockNodeBB *>;
+  for (BasicBlockNodeBB *Node : RPOTraversal{ Entry })
+    if (Node->predecessor_size() > 1 and not InLoop.contains(Node))
+      Merges.push_back(Node);
+
+  if (Merges.empty())
+    return;
+
+  revng_log(CombLogger,
+            "Routing " << Merges.size() << " nodes through a dispatcher");
+
+  using edge_label_t = typename BasicBlockNodeBB::edge_label_t;
+  using EdgeInfo = BasicBlockNodeBB::EdgeInfo;
+
+  BasicBlockNodeBB *Head = RootCFG.addEntryDispatcher();
+  auto AddTarget = [&RootCFG, Head](BasicBlockNodeBB *Target, unsigned Index) {
+    edge_label_t Labels;
+    Labels.insert(Index);
+    addEdge(EdgeDescriptor(Head, Target), EdgeInfo{ Labels, false });
+
+    SetVector<BasicBlockNodeBB *> Predecessors;
+    for (BasicBlockNodeBB *Predecessor : Target->predecessors())
+      if (Predecessor != Head)
+        Predecessors.insert(Predecessor);
+
+    for (BasicBlockNodeBB *Predecessor : Predecessors) {
+      auto *Set = RootCFG.addEntrySetStateNode(Index, Target->getName());
+      moveEdgeTarget(EdgeDescriptor(Predecessor, Target), Set);
+      addPlainEdge(EdgeDescriptor(Set, Head));
+    }
+  };
+
+  // The entry is reached through the dispatcher too, so that the retreating
+  // edges of the loop it might be the head of go through it as well.
+  unsigned Index = 0;
+  AddTarget(Entry, Index);
+  auto *EntrySet = RootCFG.addEntrySetStateNode(Index, Entry->getName());
+  addPlainEdge(EdgeDescriptor(EntrySet, Head));
+  RootCFG.setEntryNode(EntrySet);
+
+  for (BasicBlockNodeBB *Merge : Merges)
+    AddTarget(Merge, ++Index);
+}
+
+static bool restructureCFGImpl(Function &F, ASTTree &AST, bool UseDispatcher) {
   revng_log(CombLogger, "restructuring Function: " << F.getName());
   revng_log(CombLogger, "Num basic blocks: " << F.size());
 
   DuplicationCounter = 0;
+  UntangleDuplicationCounter = 0;
   UntangleTentativeCounter = 0;
   UntanglePerformedCounter = 0;
 
+  // Restructuring with a dispatcher is the fallback, it's never interrupted.
+  DuplicationLimit = UseDispatcher ? 0 : DuplicationBudget;
+
   // Clear graph object from the previous pass.
   RegionCFG<BasicBlock *> RootCFG;
 
@@ -476,6 +450,9 @@ bool restructureCFG(Function &F, ASTTree &AST) {
   // Initialize the RegionCFG object
   RootCFG.initialize(&F);
 
+  if (UseDispatcher)
+    routeMergesThroughDispatcher(RootCFG);
+
   if (CombLogger.isEnabled()) {
     CombLogger << "Analyzing function: " << F.getName() << "\n";
     RootCFG.dumpCFGOnFile(F.getName().str(), "restructure", "initial-state");
@@ -513,26 +490,19 @@ bool restructureCFG(Function &F, ASTTree &AST) {
   }
 
   // Create meta regions
-  MetaRegionBBVect MetaRegions = createMetaRegions(Backedges);
-  LogMetaRegions(MetaRegions, "Metaregions after nothing:");
+  MetaRegionBuilderBB Builder(Backedges);
 
   // Simplify SCS if they contain an edge which goes outside the scope of the
   // current region.
-  simplifySCSAbnormalRetreating(MetaRegions, Backedges);
-  LogMetaRegions(MetaRegions, "Metaregions after first simplification:");
-  revng_assert(checkMetaregionConsistency(MetaRegions, Backedges));
-
-  // Simplify SCS in a fixed-point fashion.
-  simplifySCS(MetaRegions);
-  LogMetaRegions(MetaRegions, "Metaregions after second simplification:");
-  revng_assert(checkMetaregionConsistency(MetaRegions, Backedges));
+  Builder.mergeAbnormalRetreating();
+  revng_assert(Builder.isConsistent());
 
-  // Sort the Metaregions in increasing number of composing nodes order.
-  sortMetaRegions(MetaRegions);
-  LogMetaRegions(MetaRegions, "Metaregions after second ordering:");
+  // Merge the SCSs that overlap, and compute the parent relations.
+  Builder.mergeOverlapping();
+  revng_assert(Builder.isConsistent());
 
-  // Compute parent relations for the identified SCSs.
-  computeParents(MetaRegions);
+  // Metaregions are sorted in increasing number of composing nodes order.
+  MetaRegionBBVect MetaRegions = Builder.createMetaRegions();
 
   // Print metaregions after ordering.
   LogMetaRegions(MetaRegions, "Metaregions parent relationship:");
@@ -540,7 +510,8 @@ bool restructureCFG(Function &F, ASTTree &AST) {
   // Find an ordering for the metaregions that satisfies the inclusion
   // relationship. We create a new "shadow" vector containing only pointers to
   // the "real" metaregions.
-  MetaRegionBBPtrVect OrderedMetaRegions = applyPartialOrder(MetaRegions);
+  MetaRegionBBPtrVect
+    OrderedMetaRegions = MetaRegionBuilderBB::applyPartialOrder(MetaRegions);
 
   // Print metaregions after ordering.
   LogMetaRegions(OrderedMetaRegions, "Metaregions after partial ordering:");
@@ -562,7 +533,8 @@ bool restructureCFG(Function &F, ASTTree &AST) {
 
   // Compute shortest path to reach all nodes from Entry.
   // Used later for picking the entry point of each region.
-  std::map<BasicBlockNodeBB *, size_t> ShortestPathFromEntry;
+  NodeIDMap<BasicBlock *, size_t>
+    ShortestPathFromEntry(RootCFG.getArena()->getIDBound());
   {
     revng_log(LogShortestPath, "Computing ShortestPathFromEntry");
     LoggerIndent Indent(LogShortestPath);
@@ -572,16 +544,14 @@ bool restructureCFG(Function &F, ASTTree &AST) {
       BasicBlockNodeBB *Node = *BFSIt;
       size_t Depth = BFSIt.getLevel();
       revng_log(LogShortestPath, "Node = " << Node);
-      auto ShortestIt = ShortestPathFromEntry.lower_bound(Node);
       LoggerIndent MoreIndent(LogShortestPath);
-      if (ShortestIt == ShortestPathFromEntry.end()
-          or Node < ShortestIt->first) {
+      if (not ShortestPathFromEntry.contains(Node)) {
         revng_log(LogShortestPath, "New shortest path Depth: " << Depth);
-        ShortestPathFromEntry.insert(ShortestIt, { Node, Depth });
+        ShortestPathFromEntry[Node] = Depth;
       } else {
-        revng_log(LogShortestPath,
-                  "Known shortest path Depth: " << ShortestIt->second);
-        revng_assert(ShortestIt->second <= Depth);
+        size_t Known = ShortestPathFromEntry.at(Node);
+        revng_log(LogShortestPath, "Known shortest path Depth: " << Known);
+        revng_assert(Known <= Depth);
       }
     }
   }
@@ -589,7 +559,8 @@ bool restructureCFG(Function &F, ASTTree &AST) {
   // Reserve enough space for all the OrderedMetaRegions.
   // The following algorithms stores pointers to the elements of this vector, so
   // we need to make sure that no reallocation happens.
-  std::vector<RegionCFG<BasicBlock *>> Regions(OrderedMetaRegions.size());
+  std::vector<RegionCFG<BasicBlock *>> Regions;
+  Regions.reserve(OrderedMetaRegions.size());
 
   for (MetaRegionBB *Meta : OrderedMetaRegions) {
     if (CombLogger.isEnabled()) {
@@ -912,7 +883,8 @@ bool restructureCFG(Function &F, ASTTree &AST) {
           // regions, we need to assign to them a value in the
           // `ShortestPathFromEntry` map
           if (Node->isCollapsed() or Node->isCode()) {
-            ShortestPathFromEntry[Clone] = ShortestPathFromEntry.at(Node);
+            size_t ShortestPath = ShortestPathFromEntry.at(Node);
+            ShortestPathFromEntry[Clone] = ShortestPath;
           }
           Clone->setName(Node->getName().str() + " outlined");
           ClonedMap[Node] = Clone;
@@ -1231,8 +1203,9 @@ bool restructureCFG(Function &F, ASTTree &AST) {
     // Collapse Region.
     // Create a new RegionCFG object for representing the collapsed region and
     // populate it with the internal nodes.
-    Regions.push_back(RegionCFG<BasicBlock *>());
-    RegionCFG<BasicBlock *> &CollapsedGraph = Regions.back();
+    // The collapsed region shares the node arena of the root one, so that node
+    // IDs are unique across the whole function.
+    auto &CollapsedGraph = Regions.emplace_back(RootCFG.getArena());
     RegionCFG<BasicBlock *>::BBNodeMap SubstitutionMap{};
     CollapsedGraph.setFunctionName(F.getName().str());
     CollapsedGraph.setRegionName(std::to_string(Meta->getIndex()));
@@ -1243,7 +1216,8 @@ bool restructureCFG(Function &F, ASTTree &AST) {
 
     // A collapsed node may become a candidate entry for an outer cyclic region
     // so we need to assign to it a value in the `ShortestPathFromEntry` map.
-    ShortestPathFromEntry[Collapsed] = ShortestPathFromEntry[Head];
+    size_t HeadShortestPath = ShortestPathFromEntry[Head];
+    ShortestPathFromEntry[Collapsed] = HeadShortestPath;
 
     {
       // Update the backedges set, checking that if a backedge of an outer
@@ -1401,8 +1375,15 @@ bool restructureCFG(Function &F, ASTTree &AST) {
 
   // Invoke the AST generation for the root region.
   std::map<RegionCFG<llvm::BasicBlock *> *, ASTTree> CollapsedMap;
+  if (RegionJobs != 1)
+    generateNestedAsts(RootCFG, CollapsedMap);
   generateAst(RootCFG, AST, CollapsedMap);
 
+  // Tell the caller to start over with a dispatcher, discarding this AST.
+  // `generateAst` gave up as soon as the budget has been exceeded.
+  if (isDuplicationLimitExceeded())
+    return true;
+
   // Scorporated this part which was previously inside the `generateAst` to
   // avoid having it run twice or more (it was run inside the recursive step
   // of the `generateAst`, and then another time for the final root AST, which
@@ -1456,10 +1437,27 @@ bool restructureCFG(Function &F, ASTTree &AST) {
                                                 + FunctionName,
                                               Output);
     OutputStream << "function,"
-                    "duplications,percentage,tuntangle,puntangle,iweight\n";
+                    "duplications,percentage,tuntangle,puntangle,iweight,"
+                    "uduplications,dispatcher\n";
     OutputStream << F.getName().data() << "," << DuplicationCounter << ","
                  << Increase << "," << UntangleTentativeCounter << ","
-                 << UntanglePerformedCounter << "," << InitialWeight << "\n";
+                 << UntanglePerformedCounter << "," << InitialWeight << ","
+                 << UntangleDuplicationCounter << "," << UseDispatcher
+                 << "\n";
+  }
+
+  return false;
+}
+
+bool restructureCFG(Function &F, ASTTree &AST) {
+  bool OverBudget = restructureCFGImpl(F, AST, false);
+  if (OverBudget) {
+    revng_log(CombLogger,
+              "Duplication budget exceeded, restructuring " << F.getName()
+                                                            << " again");
+    AST = ASTTree();
+    OverBudget = restructureCFGImpl(F, AST, true);
+    revng_assert(not OverBudget);
   }
 
   return false;
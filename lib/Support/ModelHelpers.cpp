@@ -135,6 +135,16 @@ model::UpcastableType fromLLVMString(llvm::Value *V,
   return *ParsedType;
 }
 
+const model::UpcastableType &ModelTypeCache::get(llvm::Value *V) {
+  llvm::StringRef Serialized = extractFromConstantStringPtr(V);
+
+  auto It = Types.find(Serialized);
+  if (It == Types.end())
+    It = Types.try_emplace(Serialized, fromLLVMString(V, Model)).first;
+
+  return It->second;
+}
+
 llvm::Constant *toLLVMString(const model::UpcastableType &Type,
                              llvm::Module &M) {
   return getUniqueString(&M, toString(Type));
@@ -179,10 +189,10 @@ static const model::Type &getFieldType(const model::Type &Parent,
   return getFieldType(Parent, NumericIdx);
 }
 
-static model::UpcastableType traverseModelGEP(const model::Binary &Model,
+static model::UpcastableType traverseModelGEP(ModelTypeCache &TypeCache,
                                               const llvm::CallInst *Call) {
   // Deduce the base type from the first argument
-  auto Type = fromLLVMString(Call->getArgOperand(0), Model);
+  const model::UpcastableType &Type = TypeCache.get(Call->getArgOperand(0));
 
   // Compute the first index of variadic arguments that represent the traversal
   // starting from the CurType.
@@ -261,7 +271,8 @@ handleReturnValue(const model::TypeDefinition &Prototype,
 }
 
 RecursiveCoroutine<llvm::SmallVector<model::UpcastableType, 8>>
-getStrongModelInfo(const llvm::Instruction *Inst, const model::Binary &Model) {
+getStrongModelInfo(const llvm::Instruction *Inst, ModelTypeCache &TypeCache) {
+  const model::Binary &Model = TypeCache.getModel();
 
   if (auto *Call = dyn_cast<llvm::CallInst>(Inst)) {
 
@@ -286,25 +297,24 @@ getStrongModelInfo(const llvm::Instruction *Inst, const model::Binary &Model) {
 
       if (FuncName.startswith("revng_call_stack_arguments")) {
         auto *Arg0Operand = Call->getArgOperand(0);
-        auto CallStackArgumentType = fromLLVMString(Arg0Operand, Model);
+        const auto &CallStackArgumentType = TypeCache.get(Arg0Operand);
         revng_assert(not CallStackArgumentType->isVoidPrimitive());
 
         rc_return{ CallStackArgumentType };
       } else if (FTags.contains(FunctionTags::ModelGEP)
                  or FTags.contains(FunctionTags::ModelGEPRef)) {
-        rc_return{ traverseModelGEP(Model, Call) };
+        rc_return{ traverseModelGEP(TypeCache, Call) };
 
       } else if (FTags.contains(FunctionTags::AddressOf)) {
         // The first argument is the base type (not the pointer's type)
-        auto Base = fromLLVMString(Call->getArgOperand(0), Model);
+        auto Base = TypeCache.get(Call->getArgOperand(0)).copy();
         rc_return{ model::PointerType::make(std::move(Base),
                                             Model.Architecture()) };
 
       } else if (FTags.contains(FunctionTags::ModelCast)
                  or FTags.contains(FunctionTags::LocalVariable)) {
         // The first argument is the returned type
-        auto Type = fromLLVMString(Call->getArgOperand(0), Model);
-        rc_return{ std::move(Type) };
+        rc_return{ TypeCache.get(Call->getArgOperand(0)) };
 
       } else if (FTags.contains(FunctionTags::StructInitializer)) {
         // Struct initializers are only used to pack together return values of
@@ -324,13 +334,13 @@ getStrongModelInfo(const llvm::Instruction *Inst, const model::Binary &Model) {
       } else if (FTags.contains(FunctionTags::Parentheses)) {
         const llvm::Value *Op = Call->getArgOperand(0);
         if (auto *OriginalInst = llvm::dyn_cast<llvm::Instruction>(Op))
-          rc_return rc_recur getStrongModelInfo(OriginalInst, Model);
+          rc_return rc_recur getStrongModelInfo(OriginalInst, TypeCache);
 
       } else if (FTags.contains(FunctionTags::OpaqueExtractValue)) {
         const llvm::Value *Op0 = Call->getArgOperand(0);
         if (auto *Aggregate = llvm::dyn_cast<llvm::Instruction>(Op0)) {
           llvm::SmallVector NestedRVs = rc_recur getStrongModelInfo(Aggregate,
-                                                                    Model);
+                                                                    TypeCache);
           const auto *Op1 = Call->getArgOperand(1);
           const auto *Index = llvm::cast<llvm::ConstantInt>(Op1);
           rc_return{ NestedRVs[Index->getZExtValue()] };
@@ -351,7 +361,8 @@ getStrongModelInfo(const llvm::Instruction *Inst, const model::Binary &Model) {
 }
 
 llvm::SmallVector<model::UpcastableType>
-getExpectedModelType(const llvm::Use *U, const model::Binary &Model) {
+getExpectedModelType(const llvm::Use *U, ModelTypeCache &TypeCache) {
+  const model::Binary &Model = TypeCache.getModel();
   llvm::Instruction *User = dyn_cast<llvm::Instruction>(U->getUser());
 
   if (not User)
@@ -411,7 +422,7 @@ getExpectedModelType(const llvm::Use *U, const model::Binary &Model) {
           return {};
 
         // The type of the base value is contained in the first operand
-        auto Base = fromLLVMString(Call->getArgOperand(0), Model);
+        auto Base = TypeCache.get(Call->getArgOperand(0)).copy();
         if (FTags.contains(FunctionTags::ModelGEP))
           Base = model::PointerType::make(std::move(Base),
                                           Model.Architecture());
@@ -419,10 +430,10 @@ getExpectedModelType(const llvm::Use *U, const model::Binary &Model) {
 
       } else if (isCallTo(Call, "revng_call_stack_arguments")) {
         auto *Arg0Operand = Call->getArgOperand(0);
-        auto CallStackArgumentType = fromLLVMString(Arg0Operand, Model);
+        const auto &CallStackArgumentType = TypeCache.get(Arg0Operand);
         revng_assert(not CallStackArgumentType.isEmpty());
 
-        return { std::move(CallStackArgumentType) };
+        return { CallStackArgumentType };
       } else if (FTags.contains(FunctionTags::StructInitializer)) {
         // Struct initializers are only used to pack together return values of
         // RawFunctionTypes that return multiple values, therefore they have
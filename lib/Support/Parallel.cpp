@@ -0,0 +1,81 @@
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <algorithm>
+#include <atomic>
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+#include "revng/Support/CommandLine.h"
+
+#include "revng-c/Support/Parallel.h"
+
+using namespace llvm::cl;
+
+namespace revng::options {
+
+opt<unsigned> DecompilerJobs("decompiler-jobs",
+                             desc("Number of threads used by the decompiler "
+                                  "steps that can process independent "
+                                  "functions concurrently. 0 means one per "
+                                  "available core. When decompiling to C, "
+                                  "only the restructuring of the functions "
+                                  "runs concurrently: beautification and C "
+                                  "emission always run on a single thread."),
+                             init(1),
+                             cat(MainCategory));
+
+} // namespace revng::options
+
+static unsigned getWorkerCount(unsigned Jobs, size_t Size) {
+  if (Size == 0)
+    return 1;
+
+  if (Jobs == 0)
+    Jobs = llvm::hardware_concurrency().compute_thread_count();
+
+  return std::max<unsigned>(1, std::min<size_t>(Jobs, Size));
+}
+
+unsigned getWorkerCount(size_t Size) {
+  return getWorkerCount(revng::options::DecompilerJobs, Size);
+}
+
+/// Number of functions assigned to each worker in a batch. Larger values
+/// improve load balancing, smaller values reduce memory usage.
+static constexpr size_t FunctionsPerWorker = 8;
+
+size_t getFunctionBatchSize(size_t Size) {
+  return FunctionsPerWorker * getWorkerCount(Size);
+}
+
+void parallelFor(size_t Size,
+                 llvm::function_ref<void(unsigned Worker, size_t Index)> Body) {
+  parallelFor(revng::options::DecompilerJobs, Size, Body);
+}
+
+void parallelFor(unsigned Jobs,
+                 size_t Size,
+                 llvm::function_ref<void(unsigned Worker, size_t Index)> Body) {
+  unsigned Workers = getWorkerCount(Jobs, Size);
+
+  if (Workers == 1) {
+    for (size_t I = 0; I < Size; ++I)
+      Body(0, I);
+    return;
+  }
+
+  // Work items are handed out dynamically, since their cost is usually very
+  // unbalanced (think of a huge function among thousands of small ones).
+  std::atomic<size_t> NextIndex = 0;
+  llvm::ThreadPool Pool(llvm::hardware_concurrency(Workers));
+  for (unsigned Worker = 0; Worker < Workers; ++Worker) {
+    Pool.async([&NextIndex, &Body, Size, Worker]() {
+      for (size_t I = NextIndex++; I < Size; I = NextIndex++)
+        Body(Worker, I);
+    });
+  }
+  Pool.wait();
+}
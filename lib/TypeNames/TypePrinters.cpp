@@ -311,10 +311,13 @@ void ptml::CTypeBuilder::printInlineDefinition(llvm::StringRef Name,
 static Logger<> InlineTypeLog{ "inline-type-selection" };
 
 void ptml::CTypeBuilder::collectInlinableTypes(const model::Binary &Binary) {
-  if (not DependencyCache.has_value())
-    DependencyCache = buildDependencyGraph(Binary.TypeDefinitions());
+  if (DependencyCache == nullptr)
+    DependencyCache = std::make_shared<const DependencyGraph>(
+      buildDependencyGraph(Binary.TypeDefinitions()));
 
-  StackFrameTypeCache = {};
+  auto Result = std::make_shared<InlinableTypes>();
+  auto &StackFrameTypeCache = Result->StackFrameTypes;
+  auto &TypesToInlineCache = Result->TypesToInline;
   for (const model::Function &Function : Binary.Functions())
     if (auto *StackFrame = Function.stackFrameType())
       StackFrameTypeCache.insert(StackFrame->key());
@@ -399,14 +402,15 @@ void ptml::CTypeBuilder::collectInlinableTypes(const model::Binary &Binary) {
     revng_log(InlineTypeLog, "}");
   }
 
-  InlinableCacheIsReady = true;
+  InlinableCache = std::move(Result);
 }
 
 static Logger<> TypePrinterLog{ "type-definition-printer" };
 
 void ptml::CTypeBuilder::printTypeDefinitions(const model::Binary &Binary) {
-  if (not DependencyCache.has_value())
-    DependencyCache = buildDependencyGraph(Binary.TypeDefinitions());
+  if (DependencyCache == nullptr)
+    DependencyCache = std::make_shared<const DependencyGraph>(
+      buildDependencyGraph(Binary.TypeDefinitions()));
 
   const auto &TypeNodes = DependencyCache->TypeNodes();
 
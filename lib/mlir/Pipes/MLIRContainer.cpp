@@ -2,8 +2,6 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
-#include <optional>
-
 #include "mlir/Bytecode/BytecodeReader.h"
 #include "mlir/Bytecode/BytecodeWriter.h"
 #include "mlir/Dialect/DLTI/DLTI.h"
@@ -14,7 +12,10 @@
 #include "mlir/Parser/Parser.h"
 #include "mlir/Target/LLVMIR/Dialect/All.h"
 
+#include "llvm/Support/CommandLine.h"
+
 #include "revng/Pipeline/RegisterContainerFactory.h"
+#include "revng/Support/MetaAddress.h"
 
 #include "revng-c/mlir/Dialect/Clift/IR/Clift.h"
 #include "revng-c/mlir/Dialect/Clift/Utils/Helpers.h"
@@ -33,6 +34,34 @@ using mlir::SymbolTable;
 using ContextPtr = std::unique_ptr<MLIRContext>;
 using OwningModuleRef = mlir::OwningOpRef<ModuleOp>;
 
+static llvm::cl::opt<bool> SharedContext("mlir-container-shared-context",
+                                         llvm::cl::desc("Let the containers "
+                                                        "produced by "
+                                                        "cloneFiltered share "
+                                                        "the MLIRContext of "
+                                                        "their source, instead "
+                                                        "of copying functions "
+                                                        "into a new context "
+                                                        "through bytecode. "
+                                                        "The containers must "
+                                                        "not be used from "
+                                                        "different threads."),
+                                         llvm::cl::init(false));
+
+static llvm::cl::opt<bool> LazyDeserialize("mlir-container-lazy-deserialize",
+                                           llvm::cl::desc("Load the body of "
+                                                          "the functions in "
+                                                          "the bytecode "
+                                                          "deserialized into "
+                                                          "MLIR containers "
+                                                          "only when they are "
+                                                          "actually needed. "
+                                                          "Malformed bodies "
+                                                          "are then reported "
+                                                          "only upon their "
+                                                          "first use."),
+                                           llvm::cl::init(false));
+
 static mlir::Block &getModuleBlock(ModuleOp Module) {
   revng_assert(Module);
   revng_assert(Module->getNumRegions() == 1);
@@ -142,6 +171,85 @@ static pipeline::Target makeTarget(const MetaAddress &MA) {
   return pipeline::Target(MA.toString(), kinds::MLIRFunctionKind);
 }
 
+// Clone into a new module, in the same context, the functions in Filter along
+// with the symbols they transitively use. Target functions not in Filter are
+// cloned as external functions, and only if they are used.
+//
+// Only the operations that end up in the new module are visited and cloned,
+// which makes this much cheaper than cloning the whole module and then pruning
+// it, especially when extracting a single function from a large module.
+static OwningModuleRef
+cloneFilteredModule(ModuleOp SourceModule,
+                    const pipeline::TargetsList &Filter) {
+  SymbolTable Symbols(SourceModule);
+
+  // The operations to be cloned, mapped to whether their regions should be
+  // cloned too
+  llvm::DenseMap<Operation *, bool> Required;
+  llvm::SmallVector<Operation *, 16> WorkList;
+
+  auto Require = [&](Operation *Op, bool WithRegions) {
+    auto [It, New] = Required.try_emplace(Op, WithRegions);
+    if (New and WithRegions)
+      WorkList.push_back(Op);
+  };
+
+  auto IsExcludedTarget = [&](FunctionOpInterface F) {
+    if (F.isExternal())
+      return false;
+
+    const MetaAddress MA = mlir::clift::getMetaAddress(F);
+    return MA.isValid() and not Filter.contains(makeTarget(MA));
+  };
+
+  for (Operation &Op : getModuleOperations(SourceModule)) {
+    if (auto F = mlir::dyn_cast<FunctionOpInterface>(&Op)) {
+      if (not F.isExternal() and not IsExcludedTarget(F)
+          and isTargetFunction(F))
+        Require(&Op, true);
+    } else if (not mlir::isa<SymbolOpInterface>(&Op)) {
+      Require(&Op, true);
+    }
+  }
+
+  while (not WorkList.empty()) {
+    Operation *Op = WorkList.pop_back_val();
+
+    const auto &Uses = SymbolTable::getSymbolUses(Op);
+    if (not Uses)
+      continue;
+
+    for (const SymbolTable::SymbolUse &Use : *Uses) {
+      const auto &SymbolRef = Use.getSymbolRef();
+      revng_assert(SymbolRef.getNestedReferences().empty());
+
+      Operation *const Symbol = Symbols.lookup(SymbolRef.getRootReference());
+      revng_assert(Symbol);
+
+      auto F = mlir::dyn_cast<FunctionOpInterface>(Symbol);
+      Require(Symbol, not F or not IsExcludedTarget(F));
+    }
+  }
+
+  // Clone preserving the order of the source module.
+  OwningModuleRef Result = ModuleOp::create(SourceModule.getLoc());
+  (*Result)->setAttrs(SourceModule->getAttrDictionary());
+
+  mlir::Block &Block = getModuleBlock(*Result);
+  mlir::IRMapping Mapping;
+  for (Operation &Op : getModuleOperations(SourceModule)) {
+    auto It = Required.find(&Op);
+    if (It == Required.end())
+      continue;
+
+    bool WithRegions = It->second;
+    Block.push_back(WithRegions ? Op.clone(Mapping) :
+                                  Op.cloneWithoutRegions(Mapping));
+  }
+
+  return Result;
+}
+
 static void makeExternal(FunctionOpInterface F) {
   revng_assert(F->getNumRegions() == 1);
 
@@ -184,11 +292,70 @@ static void pruneUnusedSymbols(ModuleOp Module) {
   });
 }
 
+// The bytecode reader, along with what it refers to, must be kept alive until
+// the body of all the functions it deferred has been loaded.
+struct MLIRContainer::LazyReader {
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  mlir::ParserConfig Config;
+  mlir::BytecodeReader Reader;
+
+  LazyReader(std::unique_ptr<llvm::MemoryBuffer> &&TheBuffer,
+             MLIRContext *Context) :
+    Buffer(std::move(TheBuffer)),
+    Config(Context),
+    Reader(Buffer->getMemBufferRef(), Config, /* lazyLoad */ true) {}
+};
+
 const char MLIRContainer::ID = 0;
 
+MLIRContainer::~MLIRContainer() = default;
+
+bool MLIRContainer::isExternal(FunctionOpInterface F) const {
+  if (not F.isExternal())
+    return false;
+
+  return not Lazy or not Lazy->Reader.isMaterializable(F);
+}
+
+llvm::Error MLIRContainer::load(const pipeline::TargetsList &Targets) const {
+  if (not Lazy)
+    return llvm::Error::success();
+
+  // Loading a body doesn't change the meaning of the module, hence this is
+  // allowed in const methods.
+  for (Operation &Op : getModuleOperations(*Module)) {
+    auto F = mlir::dyn_cast<FunctionOpInterface>(&Op);
+    if (not F or not Lazy->Reader.isMaterializable(F))
+      continue;
+
+    const MetaAddress MA = mlir::clift::getMetaAddress(F);
+    if (not MA.isValid() or not Targets.contains(makeTarget(MA)))
+      continue;
+
+    if (mlir::failed(Lazy->Reader.materialize(F)))
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "Cannot load MLIR function.");
+  }
+
+  return llvm::Error::success();
+}
+
+void MLIRContainer::loadAll() {
+  if (not Lazy)
+    return;
+
+  if (mlir::failed(Lazy->Reader.finalize()))
+    revng_abort("Cannot load MLIR module.");
+
+  Lazy.reset();
+}
+
 void MLIRContainer::setModule(OwningModuleRef &&NewModule) {
   revng_assert(NewModule);
 
+  // The old module is dropped, along with the functions still to be loaded
+  Lazy.reset();
+
   // Make any non-target functions external.
   visit(*NewModule, [&](FunctionOpInterface F) {
     if (not F.isExternal() and not isTargetFunction(F))
@@ -199,37 +366,33 @@ void MLIRContainer::setModule(OwningModuleRef &&NewModule) {
   Module = std::move(NewModule);
 }
 
-// 1. Temporarily clone the source module within the source context.
-// 2. Filter from the temporary module operations that we are not interested in.
-// 3. Clone the temporary module into the context of the new container.
+// 1. Clone the requested functions, and what they use, into a temporary module
+//    within the source context.
+// 2. Unless the context is shared, clone the temporary module into the context
+//    of the new container.
 //
 // Filtering in the source module and not after cloning into the new context
 // is important to avoid polluting the new context with types and attributes
 // not used by the remaining functions.
 std::unique_ptr<pipeline::ContainerBase>
 MLIRContainer::cloneFiltered(const pipeline::TargetsList &Filter) const {
+  if (llvm::Error Error = load(Filter))
+    revng_abort(llvm::toString(std::move(Error)).c_str());
+
   auto DestinationContainer = std::make_unique<MLIRContainer>(name());
 
   if (getModuleBlock(*Module).empty())
     return DestinationContainer;
 
   // The temporary module is automatically deleted at end of scope.
-  OwningModuleRef TemporaryModule(mlir::cast<ModuleOp>((*Module)->clone()));
-
-  bool RemovedSome = false;
-  visit(*TemporaryModule, [&](FunctionOpInterface F) {
-    if (F.isExternal())
-      return;
+  OwningModuleRef TemporaryModule = cloneFilteredModule(*Module, Filter);
 
-    const MetaAddress MA = mlir::clift::getMetaAddress(F);
-    if (MA.isValid() and not Filter.contains(makeTarget(MA))) {
-      makeExternal(F);
-      RemovedSome = true;
-    }
-  });
-
-  if (RemovedSome)
-    pruneUnusedSymbols(*TemporaryModule);
+  if (SharedContext) {
+    // Replace the module first, since it belongs to the current context.
+    DestinationContainer->Module = std::move(TemporaryModule);
+    DestinationContainer->Context = Context;
+    return DestinationContainer;
+  }
 
   MLIRContext &DestinationContext = *DestinationContainer->Context;
   DestinationContext.appendDialectRegistry(Context->getDialectRegistry());
@@ -242,6 +405,9 @@ MLIRContainer::cloneFiltered(const pipeline::TargetsList &Filter) const {
 }
 
 void MLIRContainer::mergeBackImpl(MLIRContainer &&SourceContainer) {
+  loadAll();
+  SourceContainer.loadAll();
+
   if (getModuleBlock(*SourceContainer.Module).empty())
     return;
 
@@ -251,13 +417,19 @@ void MLIRContainer::mergeBackImpl(MLIRContainer &&SourceContainer) {
     return;
   }
 
-  // Register the dialects of the other container in this container.
-  Context->appendDialectRegistry(SourceContainer.Context->getDialectRegistry());
-
-  // Clone the other container's module into this container's context.
   // This module is automatically erased at the end of scope.
-  OwningModuleRef TemporaryModule = cloneModuleInto(*SourceContainer.Module,
-                                                    *Context);
+  OwningModuleRef TemporaryModule;
+  if (SourceContainer.Context == Context) {
+    // The containers share the context: just steal the other module.
+    TemporaryModule = std::move(SourceContainer.Module);
+  } else {
+    // Register the dialects of the other container in this container.
+    const auto &Registry = SourceContainer.Context->getDialectRegistry();
+    Context->appendDialectRegistry(Registry);
+
+    // Clone the other container's module into this container's context.
+    TemporaryModule = cloneModuleInto(*SourceContainer.Module, *Context);
+  }
 
   mlir::Block &DestinationBlock = getModuleBlock(*Module);
   visit(*TemporaryModule, [&](SymbolOpInterface Symbol) {
@@ -283,7 +455,7 @@ pipeline::TargetsList MLIRContainer::enumerate() const {
   pipeline::TargetsList::List List;
 
   visit(Module.get(), [&](FunctionOpInterface F) {
-    if (F.isExternal())
+    if (isExternal(F))
       return;
 
     const MetaAddress MA = mlir::clift::getMetaAddress(F);
@@ -299,6 +471,8 @@ pipeline::TargetsList MLIRContainer::enumerate() const {
 }
 
 bool MLIRContainer::remove(const pipeline::TargetsList &List) {
+  loadAll();
+
   if (getModuleBlock(*Module).empty())
     return false;
 
@@ -331,6 +505,8 @@ bool MLIRContainer::remove(const pipeline::TargetsList &List) {
 }
 
 void MLIRContainer::clear() {
+  Lazy.reset();
+
   auto NewContext = makeContext();
 
   Module = ModuleOp::create(mlir::UnknownLoc::get(NewContext.get()));
@@ -338,16 +514,62 @@ void MLIRContainer::clear() {
 }
 
 llvm::Error MLIRContainer::serialize(llvm::raw_ostream &OS) const {
+  // As long as the reader is alive, the module has not been modified since it
+  // has been deserialized, hence the bytecode is still up to date.
+  if (Lazy) {
+    OS << Lazy->Buffer->getBuffer();
+    return llvm::Error::success();
+  }
+
   mlir::writeBytecodeToFile(*Module, OS);
   return llvm::Error::success();
 }
 
 llvm::Error MLIRContainer::deserialize(const llvm::MemoryBuffer &Buffer) {
+  // Drop the reader of the old module first, since it refers to it
+  Lazy.reset();
+
   auto NewContext = makeContext();
 
+  // Parsing the body of the functions can be deferred until they are actually
+  // needed. Many containers are loaded but never used, e.g., by a long-running
+  // daemon, or only some of their functions are.
+  if (LazyDeserialize and mlir::isBytecode(Buffer.getMemBufferRef())) {
+    auto Identifier = Buffer.getBufferIdentifier();
+    auto Copy = llvm::MemoryBuffer::getMemBufferCopy(Buffer.getBuffer(),
+                                                     Identifier);
+    auto NewLazy = std::make_unique<LazyReader>(std::move(Copy),
+                                                NewContext.get());
+
+    // Only the functions are loaded lazily, the module must not be.
+    auto IsLazy = [](Operation *Op) {
+      return mlir::isa<FunctionOpInterface>(Op);
+    };
+
+    // Serialised MLIR must be deserialised into a block, see cloneModuleInto.
+    mlir::Block OuterBlock;
+    auto &Operations = OuterBlock.getOperations();
+    auto Result = NewLazy->Reader.readTopLevel(&OuterBlock, IsLazy);
+    if (mlir::failed(Result) or Operations.size() != 1
+        or not mlir::isa<ModuleOp>(Operations.front()))
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "Cannot load MLIR module.");
+
+    auto NewModule = mlir::cast<ModuleOp>(Operations.front());
+    NewModule->remove();
+
+    Module = NewModule;
+    Context = std::move(NewContext);
+    if (NewLazy->Reader.getNumOpsToMaterialize() != 0)
+      Lazy = std::move(NewLazy);
+
+    return llvm::Error::success();
+  }
+
   const mlir::ParserConfig Config(NewContext.get());
-  OwningModuleRef
-    NewModule = mlir::parseSourceString<ModuleOp>(Buffer.getBuffer(), Config);
+  llvm::StringRef Content = Buffer.getBuffer();
+  OwningModuleRef NewModule = mlir::parseSourceString<ModuleOp>(Content,
+                                                                Config);
 
   if (not NewModule)
     return llvm::createStringError(llvm::inconvertibleErrorCode(),
@@ -361,7 +583,15 @@ llvm::Error MLIRContainer::deserialize(const llvm::MemoryBuffer &Buffer) {
 
 llvm::Error MLIRContainer::extractOne(llvm::raw_ostream &OS,
                                       const pipeline::Target &Target) const {
-  return cloneFiltered(pipeline::TargetsList::List{ Target })->serialize(OS);
+  // The filtered module is serialized right away, hence there's no need to
+  // move it to a context of its own.
+  pipeline::TargetsList Filter(pipeline::TargetsList::List{ Target });
+  if (llvm::Error Error = load(Filter))
+    return Error;
+
+  OwningModuleRef FilteredModule = cloneFilteredModule(*Module, Filter);
+  mlir::writeBytecodeToFile(*FilteredModule, OS);
+  return llvm::Error::success();
 }
 
 static pipeline::RegisterDefaultConstructibleContainer<MLIRContainer> X;
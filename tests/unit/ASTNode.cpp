@@ -0,0 +1,282 @@
+/// \file ASTNode.cpp
+/// Tests for the structural comparison and hashing of ASTNodes and ExprNodes
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <utility>
+
+#define BOOST_TEST_MODULE ASTNode
+bool init_unit_test();
+#include "boost/test/unit_test.hpp"
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "revng-c/RestructureCFG/ASTNode.h"
+#include "revng-c/RestructureCFG/ASTTree.h"
+#include "revng-c/RestructureCFG/ExprNode.h"
+
+using namespace llvm;
+
+struct IfFixture {
+  LLVMContext Context;
+  Module M{ "test", Context };
+  Function *F = nullptr;
+  ASTTree AST;
+
+  IfFixture() {
+    auto *FunctionTy = FunctionType::get(Type::getVoidTy(Context), false);
+    F = Function::Create(FunctionTy, GlobalValue::ExternalLinkage, "f", M);
+  }
+
+  BasicBlock *createBlock() { return BasicBlock::Create(Context, "", F); }
+
+  /// Create an `IfNode` originating from \a BB, with the given branches
+  IfNode *createIf(BasicBlock *BB, ASTNode *Then, ASTNode *Else) {
+    auto *If = new IfNode(nullptr, Then, Else, "if", false, BB);
+    ASTNode *Result = AST.addASTNode(ASTTree::ast_unique_ptr(If));
+    return llvm::cast<IfNode>(Result);
+  }
+
+  /// Create an `IfNode` with no branches, used as a leaf
+  IfNode *createLeaf(BasicBlock *BB) { return createIf(BB, nullptr, nullptr); }
+
+  SequenceNode *createSequence(std::initializer_list<ASTNode *> Nodes) {
+    SequenceNode *Sequence = AST.addSequenceNode();
+    for (ASTNode *Node : Nodes)
+      Sequence->addNode(Node);
+    return Sequence;
+  }
+
+  template<typename T, typename... Args>
+  ExprNode *createExpr(Args &&...TheArgs) {
+    ExprNode *Expr = new T(std::forward<Args>(TheArgs)...);
+    return AST.addCondExpr(ASTTree::expr_unique_ptr(Expr));
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE(IfNodeEqual, IfFixture) {
+  BasicBlock *Condition = createBlock();
+  BasicBlock *A = createBlock();
+  BasicBlock *B = createBlock();
+
+  IfNode *First = createIf(Condition, createLeaf(A), createLeaf(B));
+  IfNode *Second = createIf(Condition, createLeaf(A), createLeaf(B));
+
+  BOOST_TEST(First->isEqual(Second));
+  BOOST_TEST(Second->isEqual(First));
+}
+
+BOOST_FIXTURE_TEST_CASE(IfNodeDifferentThen, IfFixture) {
+  BasicBlock *Condition = createBlock();
+  BasicBlock *A = createBlock();
+  BasicBlock *B = createBlock();
+  BasicBlock *C = createBlock();
+
+  // The `else` branches are equal, the `then` ones are not
+  IfNode *First = createIf(Condition, createLeaf(A), createLeaf(B));
+  IfNode *Second = createIf(Condition, createLeaf(C), createLeaf(B));
+
+  BOOST_TEST(not First->isEqual(Second));
+  BOOST_TEST(not Second->isEqual(First));
+}
+
+BOOST_FIXTURE_TEST_CASE(IfNodeMissingElse, IfFixture) {
+  BasicBlock *Condition = createBlock();
+  BasicBlock *A = createBlock();
+  BasicBlock *B = createBlock();
+
+  IfNode *First = createIf(Condition, createLeaf(A), nullptr);
+  IfNode *Second = createIf(Condition, createLeaf(A), createLeaf(B));
+
+  BOOST_TEST(not First->isEqual(Second));
+  BOOST_TEST(not Second->isEqual(First));
+}
+
+BOOST_FIXTURE_TEST_CASE(IfNodeMissingThen, IfFixture) {
+  BasicBlock *Condition = createBlock();
+  BasicBlock *A = createBlock();
+  BasicBlock *B = createBlock();
+
+  IfNode *First = createIf(Condition, nullptr, createLeaf(B));
+  IfNode *Second = createIf(Condition, createLeaf(A), createLeaf(B));
+
+  BOOST_TEST(not First->isEqual(Second));
+  BOOST_TEST(not Second->isEqual(First));
+}
+
+// Two equal subtrees with a nested `IfNode`, in which the tests change things
+struct NestedFixture : public IfFixture {
+  BasicBlock *Condition = createBlock();
+  BasicBlock *Nested = createBlock();
+  BasicBlock *A = createBlock();
+  BasicBlock *B = createBlock();
+  BasicBlock *C = createBlock();
+
+  IfNode *FirstNested = nullptr;
+  IfNode *SecondNested = nullptr;
+  SequenceNode *FirstBody = nullptr;
+  SequenceNode *SecondBody = nullptr;
+  IfNode *First = nullptr;
+  IfNode *Second = nullptr;
+
+  NestedFixture() {
+    FirstNested = createIf(Nested, createLeaf(A), createLeaf(B));
+    SecondNested = createIf(Nested, createLeaf(A), createLeaf(B));
+    FirstBody = createSequence({ FirstNested, createLeaf(C) });
+    SecondBody = createSequence({ SecondNested, createLeaf(C) });
+    First = createIf(Condition, FirstBody, nullptr);
+    Second = createIf(Condition, SecondBody, nullptr);
+  }
+
+  /// Check that \a First and \a Second are equal, and that it's consistent
+  /// with their hashes
+  void checkEqual() {
+    BOOST_TEST(First->isEqual(Second));
+    BOOST_TEST(First->getStructuralHash() == Second->getStructuralHash());
+  }
+
+  /// Check that \a First and \a Second differ, which their hashes should tell
+  /// unless they have gone stale
+  void checkDifferent() {
+    BOOST_TEST(not First->isEqual(Second));
+    BOOST_TEST(First->getStructuralHash() != Second->getStructuralHash());
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashMatchesIsEqual, NestedFixture) {
+  checkEqual();
+
+  {
+    ASTTree::StructuralHashScope CacheHashes(AST);
+    checkEqual();
+  }
+
+  FirstNested->setElse(createLeaf(C));
+  checkDifferent();
+
+  {
+    ASTTree::StructuralHashScope CacheHashes(AST);
+    checkDifferent();
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashSetThen, NestedFixture) {
+  ASTTree::StructuralHashScope CacheHashes(AST);
+  checkEqual();
+
+  FirstNested->setThen(createLeaf(C));
+  checkDifferent();
+
+  SecondNested->setThen(createLeaf(C));
+  checkEqual();
+}
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashSetElse, NestedFixture) {
+  ASTTree::StructuralHashScope CacheHashes(AST);
+  checkEqual();
+
+  FirstNested->setElse(nullptr);
+  checkDifferent();
+
+  SecondNested->setElse(nullptr);
+  checkEqual();
+}
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashAddNode, NestedFixture) {
+  ASTTree::StructuralHashScope CacheHashes(AST);
+  checkEqual();
+
+  FirstBody->addNode(createLeaf(A));
+  checkDifferent();
+
+  SecondBody->addNode(createLeaf(A));
+  checkEqual();
+}
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashRemoveNode, NestedFixture) {
+  ASTTree::StructuralHashScope CacheHashes(AST);
+  checkEqual();
+
+  FirstBody->removeNode(FirstNested);
+  checkDifferent();
+
+  SecondBody->removeNode(SecondNested);
+  checkEqual();
+}
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashUpdatePointers, NestedFixture) {
+  ASTTree::StructuralHashScope CacheHashes(AST);
+  checkEqual();
+
+  ASTNode::ASTNodeMap FirstMap;
+  for (ASTNode *Node : std::as_const(*FirstBody).nodes())
+    FirstMap[Node] = Node;
+  FirstMap[FirstNested] = createLeaf(B);
+  FirstBody->updateASTNodesPointers(FirstMap);
+  checkDifferent();
+
+  ASTNode::ASTNodeMap SecondMap;
+  for (ASTNode *Node : std::as_const(*SecondBody).nodes())
+    SecondMap[Node] = Node;
+  SecondMap[SecondNested] = createLeaf(B);
+  SecondBody->updateASTNodesPointers(SecondMap);
+  checkEqual();
+}
+
+BOOST_FIXTURE_TEST_CASE(StructuralHashNewScope, NestedFixture) {
+  {
+    ASTTree::StructuralHashScope CacheHashes(AST);
+    checkEqual();
+  }
+
+  // Outside of a scope, the children can be changed without the nodes
+  // noticing: the hashes cached so far must not be used anymore.
+  *FirstBody->nodes().begin() = createLeaf(A);
+
+  {
+    ASTTree::StructuralHashScope CacheHashes(AST);
+    checkDifferent();
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(ExprNodeEqual, IfFixture) {
+  BasicBlock *A = createBlock();
+  BasicBlock *B = createBlock();
+
+  auto CreateExpr = [&](BasicBlock *Right, size_t Constant) {
+    using Comparison = CompareNode::ComparisonKind;
+    ExprNode *Left = createExpr<ValueCompareNode>(Comparison::Comparison_Equal,
+                                                  A,
+                                                  Constant);
+    ExprNode *Atomic = createExpr<AtomicNode>(Right);
+    return createExpr<AndNode>(Left, createExpr<NotNode>(Atomic));
+  };
+
+  ExprNode *First = CreateExpr(B, 1);
+  ExprNode *Second = CreateExpr(B, 1);
+  BOOST_TEST(First->isEqual(Second));
+  BOOST_TEST(First->getStructuralHash() == Second->getStructuralHash());
+
+  ExprNode *DifferentAtomic = CreateExpr(A, 1);
+  BOOST_TEST(not First->isEqual(DifferentAtomic));
+  BOOST_TEST(First->getStructuralHash()
+             != DifferentAtomic->getStructuralHash());
+
+  ExprNode *DifferentConstant = CreateExpr(B, 2);
+  BOOST_TEST(not First->isEqual(DifferentConstant));
+  BOOST_TEST(First->getStructuralHash()
+             != DifferentConstant->getStructuralHash());
+
+  ExprNode *Or = createExpr<OrNode>(createExpr<AtomicNode>(A),
+                                    createExpr<AtomicNode>(B));
+  ExprNode *And = createExpr<AndNode>(createExpr<AtomicNode>(A),
+                                      createExpr<AtomicNode>(B));
+  BOOST_TEST(not Or->isEqual(And));
+  BOOST_TEST(Or->getStructuralHash() != And->getStructuralHash());
+}
@@ -5,7 +5,12 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+#include <algorithm>
 #include <cstdlib>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 
 #define BOOST_TEST_MODULE CombingPass
 bool init_unit_test();
@@ -18,12 +23,17 @@ bool init_unit_test();
 #include "llvm/Support/SourceMgr.h"
 
 #include "revng/Support/Debug.h"
+#include "revng/Support/GraphAlgorithms.h"
 #include "revng/UnitTestHelpers/DotGraphObject.h"
 
 #include "revng-c/RestructureCFG/BasicBlockNode.h"
 #include "revng-c/RestructureCFG/BasicBlockNodeImpl.h"
+#include "revng-c/RestructureCFG/MetaRegion.h"
+#include "revng-c/RestructureCFG/MetaRegionBuilder.h"
+#include "revng-c/RestructureCFG/MetaRegionImpl.h"
 #include "revng-c/RestructureCFG/RegionCFGTree.h"
 #include "revng-c/RestructureCFG/RegionCFGTreeImpl.h"
+#include "revng-c/RestructureCFG/Utils.h"
 
 using namespace llvm;
 
@@ -88,6 +98,231 @@ static void runTest(TestType Type,
   }
 }
 
+// The construction of the metaregions as it was done before the introduction
+// of `MetaRegionBuilder`, which must produce the same result.
+namespace reference {
+
+using BasicBlockNodeDot = BasicBlockNode<DotNode *>;
+using EdgeDescriptor = BasicBlockNodeDot::EdgeDescriptor;
+using MetaRegionDot = MetaRegion<DotNode *>;
+using MetaRegionDotVect = std::vector<MetaRegionDot>;
+using MetaRegionDotPtrVect = std::vector<MetaRegionDot *>;
+using BackedgeSet = llvm::SmallDenseSet<EdgeDescriptor>;
+
+static MetaRegionDotVect createMetaRegions(const BackedgeSet &Backedges) {
+  std::map<BasicBlockNodeDot *, std::set<BasicBlockNodeDot *>>
+    AdditionalSCSNodes;
+  std::vector<std::pair<BasicBlockNodeDot *, std::set<BasicBlockNodeDot *>>>
+    Regions;
+
+  for (auto &Backedge : Backedges) {
+    auto SCSNodesSmall = nodesBetween(Backedge.second, Backedge.first);
+    std::set<BasicBlockNodeDot *> SCSNodes;
+    SCSNodes.insert(SCSNodesSmall.begin(), SCSNodesSmall.end());
+    AdditionalSCSNodes[Backedge.second].insert(SCSNodes.begin(),
+                                               SCSNodes.end());
+    Regions.push_back(std::make_pair(Backedge.second, SCSNodes));
+  }
+
+  for (auto &Region : Regions) {
+    BasicBlockNodeDot *Head = Region.first;
+    std::set<BasicBlockNodeDot *> &Nodes = Region.second;
+    std::set<BasicBlockNodeDot *> AdditionalNodes;
+    std::set<BasicBlockNodeDot *> OldNodes;
+    do {
+      OldNodes = Nodes;
+      for (BasicBlockNodeDot *Node : Nodes)
+        if ((Node != Head) and (AdditionalSCSNodes.contains(Node)))
+          AdditionalNodes.insert(AdditionalSCSNodes[Node].begin(),
+                                 AdditionalSCSNodes[Node].end());
+      Nodes.insert(AdditionalNodes.begin(), AdditionalNodes.end());
+      AdditionalNodes.clear();
+    } while (Nodes != OldNodes);
+  }
+
+  MetaRegionDotVect MetaRegions;
+  int SCSIndex = 1;
+  for (auto &Region : Regions) {
+    MetaRegions.push_back(MetaRegionDot(SCSIndex, Region.second, true));
+    SCSIndex++;
+  }
+  return MetaRegions;
+}
+
+static void simplifySCSAbnormalRetreating(MetaRegionDotVect &MetaRegions,
+                                          const BackedgeSet &Backedges) {
+  unsigned MetaRegionIndex = 0;
+  std::map<EdgeDescriptor, MetaRegionDot *> BackedgeMetaRegionMap;
+  for (EdgeDescriptor Backedge : Backedges) {
+    BackedgeMetaRegionMap[Backedge] = &MetaRegions.at(MetaRegionIndex);
+    MetaRegionIndex++;
+  }
+
+  std::set<MetaRegionDot *> Blacklisted;
+  bool Changes = true;
+  while (Changes) {
+    Changes = false;
+    for (MetaRegionDot &Region : MetaRegions) {
+      if (Blacklisted.contains(&Region))
+        continue;
+
+      for (EdgeDescriptor Backedge : Backedges) {
+        bool FirstIn = Region.containsNode(Backedge.first);
+        bool SecondIn = Region.containsNode(Backedge.second);
+        if (FirstIn != SecondIn) {
+          MetaRegionDot *OtherRegion = BackedgeMetaRegionMap.at(Backedge);
+          Region.mergeWith(*OtherRegion);
+          BackedgeMetaRegionMap[Backedge] = &Region;
+          Blacklisted.insert(OtherRegion);
+          Changes = true;
+          break;
+        }
+      }
+
+      if (Changes)
+        break;
+    }
+  }
+
+  std::erase_if(MetaRegions, [&Blacklisted](MetaRegionDot &M) {
+    return Blacklisted.contains(&M);
+  });
+}
+
+static bool mergeSCSStep(MetaRegionDotVect &MetaRegions) {
+  for (auto It1 = MetaRegions.begin(); It1 != MetaRegions.end(); ++It1) {
+    for (auto It2 = std::next(It1); It2 != MetaRegions.end(); ++It2) {
+      bool Intersects = It1->intersectsWith(*It2);
+      bool IsIncluded = It1->isSubSet(*It2);
+      bool IsIncludedReverse = It2->isSubSet(*It1);
+      bool AreEquivalent = It1->nodesEquality(*It2);
+      if (Intersects
+          and (((not IsIncluded) and (not IsIncludedReverse))
+               or AreEquivalent)) {
+        It1->mergeWith(*It2);
+        MetaRegions.erase(It2);
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static void computeParents(MetaRegionDotVect &MetaRegions) {
+  for (MetaRegionDot &MetaRegion1 : MetaRegions) {
+    MetaRegion1.setParent(nullptr);
+    for (MetaRegionDot &MetaRegion2 : MetaRegions) {
+      if (&MetaRegion1 != &MetaRegion2 and MetaRegion1.isSubSet(MetaRegion2)) {
+        MetaRegion1.setParent(&MetaRegion2);
+        break;
+      }
+    }
+  }
+}
+
+static MetaRegionDotPtrVect applyPartialOrder(MetaRegionDotVect &V) {
+  MetaRegionDotPtrVect OrderedVector;
+  std::set<MetaRegionDot *> Processed;
+
+  while (V.size() != Processed.size()) {
+    for (MetaRegionDot &Region1 : V) {
+      if (Processed.contains(&Region1))
+        continue;
+
+      bool FoundParent = false;
+      for (MetaRegionDot &Region2 : V) {
+        if (&Region1 != &Region2 and not Processed.contains(&Region2)
+            and Region1.getParent() == &Region2) {
+          FoundParent = true;
+          break;
+        }
+      }
+
+      if (not FoundParent) {
+        OrderedVector.push_back(&Region1);
+        Processed.insert(&Region1);
+        break;
+      }
+    }
+  }
+
+  std::reverse(OrderedVector.begin(), OrderedVector.end());
+  return OrderedVector;
+}
+
+static MetaRegionDotPtrVect
+buildMetaRegions(MetaRegionDotVect &MetaRegions, const BackedgeSet &Backedges) {
+  MetaRegions = createMetaRegions(Backedges);
+  simplifySCSAbnormalRetreating(MetaRegions, Backedges);
+  while (mergeSCSStep(MetaRegions))
+    ;
+
+  // This used to be an `std::sort`, which behaves as a stable sort on so few
+  // elements.
+  std::stable_sort(MetaRegions.begin(),
+                   MetaRegions.end(),
+                   [](const MetaRegionDot &First,
+                      const MetaRegionDot &Second) {
+                     return First.nodes_size() < Second.nodes_size();
+                   });
+  computeParents(MetaRegions);
+  return applyPartialOrder(MetaRegions);
+}
+
+} // namespace reference
+
+static void runMetaRegionTest(const std::string &InputFileName) {
+  using BasicBlockNodeDot = BasicBlockNode<DotNode *>;
+  using EdgeDescriptor = BasicBlockNodeDot::EdgeDescriptor;
+  using MetaRegionBuilderDot = MetaRegionBuilder<DotNode *>;
+
+  DotGraph InputDot = DotGraph();
+  InputDot.parseDotFromFile(InputFileName, "entry");
+  RegionCFG<DotNode *> Input = RegionCFG<DotNode *>();
+
+  Input.initialize(&InputDot);
+
+  // As `restructureCFG` does, make the source of each retreating edge a dummy
+  // node before identifying the SCSs.
+  auto Backedges = getBackedges(&Input.getEntryNode()).takeSet();
+  for (EdgeDescriptor Backedge : Backedges) {
+    BasicBlockNodeDot *OriginalTarget = Backedge.second;
+    BasicBlockNodeDot *Dummy = Input.addArtificialNode();
+    moveEdgeTarget(Backedge, Dummy);
+    addPlainEdge(EdgeDescriptor(Dummy, OriginalTarget));
+  }
+  Backedges = getBackedges(&Input.getEntryNode()).takeSet();
+  BOOST_TEST_REQUIRE(not Backedges.empty());
+
+  MetaRegionBuilderDot Builder(Backedges);
+  Builder.mergeAbnormalRetreating();
+  BOOST_TEST(Builder.isConsistent());
+  Builder.mergeOverlapping();
+  BOOST_TEST(Builder.isConsistent());
+  auto MetaRegions = Builder.createMetaRegions();
+  auto Ordered = MetaRegionBuilderDot::applyPartialOrder(MetaRegions);
+
+  reference::MetaRegionDotVect ReferenceMetaRegions;
+  auto ReferenceOrdered = reference::buildMetaRegions(ReferenceMetaRegions,
+                                                      Backedges);
+
+  // Check that the metaregions are the same, in the same order and with the
+  // same parents.
+  auto GetParentIndex = [](MetaRegion<DotNode *> *Region) {
+    MetaRegion<DotNode *> *Parent = Region->getParent();
+    return Parent != nullptr ? Parent->getIndex() : 0;
+  };
+
+  BOOST_TEST_REQUIRE(Ordered.size() == ReferenceOrdered.size());
+  for (size_t I = 0; I < Ordered.size(); ++I) {
+    BOOST_TEST(Ordered[I]->getIndex() == ReferenceOrdered[I]->getIndex());
+    BOOST_TEST((Ordered[I]->getNodes() == ReferenceOrdered[I]->getNodes()));
+    BOOST_TEST(GetParentIndex(Ordered[I])
+               == GetParentIndex(ReferenceOrdered[I]));
+  }
+}
+
 BOOST_FIXTURE_TEST_SUITE(FixtureTestSuite, ArgsFixture)
 
 BOOST_AUTO_TEST_CASE(TrivialGraphEqual) {
@@ -114,5 +349,20 @@ BOOST_AUTO_TEST_CASE(SimpleGraphNotEqual) {
   runTest(NotEqual, InputFileName, ReferenceFileName);
 }
 
+BOOST_AUTO_TEST_CASE(NestedSCSMetaRegions) {
+  std::string DotPath = argv[1];
+  runMetaRegionTest(DotPath + "nested-scs.dot");
+}
+
+BOOST_AUTO_TEST_CASE(OverlappingSCSMetaRegions) {
+  std::string DotPath = argv[1];
+  runMetaRegionTest(DotPath + "overlapping-scs.dot");
+}
+
+BOOST_AUTO_TEST_CASE(AbnormalRetreatingMetaRegions) {
+  std::string DotPath = argv[1];
+  runMetaRegionTest(DotPath + "abnormal-retreating.dot");
+}
+
 // End tag of test suite
 BOOST_AUTO_TEST_SUITE_END()
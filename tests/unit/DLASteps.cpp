@@ -807,3 +807,100 @@ BOOST_AUTO_TEST_CASE(DeduplicateFields_commonNodeAsymmetricCollapse) {
   checkNode(TS, NodeC, 10, AllChildrenAreNonInterfering, { 3 });
   checkNode(TS, NodeA1, 8, AllChildrenAreNonInterfering, { 4, 5, 6, 7 });
 }
+
+/// Test that the nodes are visited in ID order, skipping the removed ones
+BOOST_AUTO_TEST_CASE(LayoutsIterationOrder) {
+  dla::LayoutTypeSystem TS;
+
+  // Build TS
+  LTSN *Root = createRoot(TS);
+  LTSN *Node1 = addInstanceAtOffset(TS, Root, /*offset=*/0, /*size=*/8);
+  LTSN *Node2 = addInstanceAtOffset(TS, Root, /*offset=*/8, /*size=*/8);
+  LTSN *Node3 = addInstanceAtOffset(TS, Node2, /*offset=*/0, /*size=*/4);
+  TS.removeNode(Node1);
+
+  std::vector<LTSN *> Expected = { Root, Node2, Node3 };
+  std::vector<LTSN *> Visited;
+  for (LTSN *Node : llvm::nodes(&TS)) {
+    Visited.push_back(Node);
+
+    // Nodes created while iterating are visited too
+    if (Node == Node2)
+      Expected.push_back(createRoot(TS));
+  }
+
+  revng_check(Visited == Expected);
+  revng_check(TS.getNumLayouts() == 4);
+}
+
+/// Test moving the components into type systems of their own, changing them,
+/// and moving them back
+BOOST_AUTO_TEST_CASE(SplitAndJoinComponents) {
+  dla::LayoutTypeSystem TS;
+
+  // Build TS: two components, { 0, 1, 2 } and { 3, 4, 5 }
+  LTSN *Root = createRoot(TS, 16);
+  addInstanceAtOffset(TS, Root, /*offset=*/0, /*size=*/8);
+  addInstanceAtOffset(TS, Root, /*offset=*/8, /*size=*/8);
+  LTSN *Ptr = createRoot(TS, 8);
+  LTSN *Pointee = createRoot(TS, 4);
+  TS.addPointerLink(Ptr, Pointee);
+  addInstanceAtOffset(TS, Ptr, /*offset=*/0, /*size=*/4);
+
+  LayoutTypeSystem::ComponentVector Components = TS.splitComponents();
+  revng_check(TS.getNumLayouts() == 0);
+  revng_check(Components.size() == 2);
+
+  // The nodes of each component are in the order of the original IDs
+  auto GetNodes = [](const LayoutTypeSystem &Component) {
+    return std::vector<LTSN *>(llvm::nodes(&Component).begin(),
+                               llvm::nodes(&Component).end());
+  };
+  std::vector<LTSN *> First = GetNodes(*Components[0]);
+  std::vector<LTSN *> Second = GetNodes(*Components[1]);
+  revng_check(First.size() == 3);
+  revng_check(Second.size() == 3);
+  revng_check(First[0]->Size == 16 and First[0]->Successors.size() == 2);
+  revng_check(Second[0]->Size == 8 and Second[0]->Successors.size() == 2);
+
+  // Merge the two fields of Root, and drop the instance of Ptr
+  Components[0]->mergeNodes({ First[1], First[2] });
+  Components[1]->removeNode(Second[2]);
+
+  TS.joinComponents(std::move(Components));
+  dla::VectEqClasses &Eq = TS.getEqClasses();
+  Eq.compress();
+
+  // The nodes are replaced following the order of the components
+  std::vector<LTSN *> Joined = GetNodes(TS);
+  revng_check(TS.getNumLayouts() == 4);
+  revng_check(Joined.size() == 4);
+  LTSN *NewRoot = Joined[0];
+  LTSN *Field = Joined[1];
+  LTSN *NewPtr = Joined[2];
+  LTSN *NewPointee = Joined[3];
+
+  // Each original node is in the equivalence class of its replacement
+  revng_check(Eq.getNumElements() == 10);
+  revng_check(Eq.isRemoved(5));
+  checkNode(TS, NewRoot, 16, InterferingChildrenInfo::Unknown, { 0, 6 });
+  checkNode(TS, Field, 8, InterferingChildrenInfo::Unknown, { 1, 2, 7 });
+  checkNode(TS, NewPtr, 8, InterferingChildrenInfo::Unknown, { 3, 8 });
+  checkNode(TS, NewPointee, 4, InterferingChildrenInfo::Unknown, { 4, 9 });
+
+  // Check the edges
+  revng_check(NewRoot->Successors.size() == 2);
+  for (const auto &[Child, Tag] : llvm::children_edges<LTSN *>(NewRoot)) {
+    revng_check(Child == Field);
+    revng_check(Tag->getKind() == dla::TypeLinkTag::LK_Instance);
+  }
+  revng_check(Field->Predecessors.size() == 2);
+  revng_check(Field->Successors.empty());
+
+  revng_check(NewPtr->Successors.size() == 1);
+  const auto &[Child, Tag] = *(llvm::children_edges<LTSN *>(NewPtr).begin());
+  revng_check(Child == NewPointee);
+  revng_check(Tag->getKind() == dla::TypeLinkTag::LK_Pointer);
+  revng_check(NewPointee->Predecessors.size() == 1);
+  revng_check(NewPtr->Predecessors.empty());
+}
@@ -0,0 +1,210 @@
+/// \file StoredRanges.cpp
+/// Tests for StoredRanges
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+#include <vector>
+
+#define BOOST_TEST_MODULE StoredRanges
+bool init_unit_test();
+#include "boost/test/unit_test.hpp"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "revng-c/PromoteStackPointer/StoredRanges.h"
+
+using namespace llvm;
+
+using RangeVector = std::vector<StoredRange>;
+
+/// Provides a few distinct store instructions to tag the ranges with
+struct StoresFixture {
+  LLVMContext Context;
+  Module M;
+  SmallVector<StoreInst *, 4> Stores;
+
+  StoresFixture() : M("test", Context) {
+    auto *Int64 = IntegerType::get(Context, 64);
+    auto *Pointer = PointerType::get(Context, 0);
+    auto *Void = Type::getVoidTy(Context);
+    auto *FunctionTy = FunctionType::get(Void, { Pointer }, false);
+    auto *F = Function::Create(FunctionTy,
+                               GlobalValue::ExternalLinkage,
+                               "f",
+                               M);
+    IRBuilder<> Builder(BasicBlock::Create(Context, "", F));
+    for (unsigned I = 0; I < 4; ++I)
+      Stores.push_back(Builder.CreateStore(ConstantInt::get(Int64, I),
+                                           F->getArg(0)));
+    Builder.CreateRetVoid();
+  }
+};
+
+/// Check that \a Ranges contains exactly \a Expected, in any order
+static bool matches(const StoredRanges &Ranges, RangeVector Expected) {
+  llvm::sort(Expected);
+  return RangeVector(Ranges.begin(), Ranges.end()) == Expected;
+}
+
+BOOST_FIXTURE_TEST_SUITE(StoredRangesTestSuite, StoresFixture)
+
+BOOST_AUTO_TEST_CASE(PartialOverlapErase) {
+  StoreInst *S0 = Stores[0];
+  StoreInst *S1 = Stores[1];
+  StoreInst *S2 = Stores[2];
+  StoreInst *S3 = Stores[3];
+
+  StoredRanges Ranges;
+  Ranges.insert(S0, 0, 8);
+  Ranges.insert(S1, 8, 8);
+  Ranges.insert(S2, 16, 8);
+
+  // Erase the tail of the first range and the head of the second one
+  Ranges.erase(4, 12);
+  RangeVector Expected = { { 0, 4, S0, 0 },
+                           { 12, 16, S1, 8 },
+                           { 16, 24, S2, 16 } };
+  BOOST_TEST(matches(Ranges, Expected));
+
+  // Erase from the middle of a range, which is split in two
+  Ranges.erase(18, 20);
+  Expected = { { 0, 4, S0, 0 },
+               { 12, 16, S1, 8 },
+               { 16, 18, S2, 16 },
+               { 20, 24, S2, 16 } };
+  BOOST_TEST(matches(Ranges, Expected));
+
+  // Erasing bytes that are not tracked is a no-op
+  Ranges.erase(4, 12);
+  Ranges.erase(-8, 0);
+  BOOST_TEST(matches(Ranges, Expected));
+
+  // The erased bytes can be written again
+  Ranges.insert(S3, 4, 8);
+  Expected = { { 0, 4, S0, 0 },
+               { 4, 12, S3, 4 },
+               { 12, 16, S1, 8 },
+               { 16, 18, S2, 16 },
+               { 20, 24, S2, 16 } };
+  BOOST_TEST(matches(Ranges, Expected));
+}
+
+BOOST_AUTO_TEST_CASE(CopiesAreIndependent) {
+  StoredRanges Original;
+  Original.insert(Stores[0], 0, 8);
+
+  StoredRanges Copy = Original;
+  Copy.erase(0, 4);
+  Copy.insert(Stores[1], 0, 4);
+
+  RangeVector Expected = { { 0, 8, Stores[0], 0 } };
+  BOOST_TEST(matches(Original, Expected));
+  Expected = { { 0, 4, Stores[1], 0 }, { 4, 8, Stores[0], 0 } };
+  BOOST_TEST(matches(Copy, Expected));
+}
+
+BOOST_AUTO_TEST_CASE(JoinDifferentStoresOnSameBytes) {
+  StoreInst *S0 = Stores[0];
+  StoreInst *S1 = Stores[1];
+
+  StoredRanges LHS;
+  LHS.insert(S0, 0, 8);
+  StoredRanges RHS;
+  RHS.insert(S1, 0, 8);
+
+  BOOST_TEST(not StoredRanges::isLessOrEqual(LHS, RHS));
+  BOOST_TEST(not StoredRanges::isLessOrEqual(RHS, LHS));
+
+  // Both stores might have written the bytes
+  StoredRanges Result = StoredRanges::combineValues(LHS, RHS);
+  RangeVector Expected = { { 0, 8, S0, 0 }, { 0, 8, S1, 0 } };
+  BOOST_TEST(matches(Result, Expected));
+  BOOST_TEST(StoredRanges::isLessOrEqual(LHS, Result));
+  BOOST_TEST(StoredRanges::isLessOrEqual(RHS, Result));
+  BOOST_TEST(not StoredRanges::isLessOrEqual(Result, LHS));
+
+  // The result does not depend on the order of the operands
+  StoredRanges Swapped = StoredRanges::combineValues(RHS, LHS);
+  BOOST_TEST(matches(Swapped, Expected));
+
+  // A store overwriting the bytes replaces both of them
+  Result.erase(0, 8);
+  Result.insert(Stores[2], 0, 8);
+  Expected = { { 0, 8, Stores[2], 0 } };
+  BOOST_TEST(matches(Result, Expected));
+}
+
+BOOST_AUTO_TEST_CASE(JoinCoalescesRangesOfTheSameStore) {
+  StoreInst *S0 = Stores[0];
+
+  StoredRanges Whole;
+  Whole.insert(S0, 0, 8);
+
+  StoredRanges Head = Whole;
+  Head.erase(4, 8);
+  StoredRanges Tail = Whole;
+  Tail.erase(0, 4);
+
+  // Joining the two halves yields the same representation of the whole store
+  StoredRanges Result = StoredRanges::combineValues(Head, Tail);
+  RangeVector Expected = { { 0, 8, S0, 0 } };
+  BOOST_TEST(matches(Result, Expected));
+  BOOST_TEST(StoredRanges::isLessOrEqual(Result, Whole));
+  BOOST_TEST(StoredRanges::isLessOrEqual(Whole, Result));
+
+  // A range is covered only by a range of the same store
+  StoredRanges Other;
+  Other.insert(Stores[1], 0, 8);
+  BOOST_TEST(StoredRanges::isLessOrEqual(Head, Whole));
+  BOOST_TEST(not StoredRanges::isLessOrEqual(Head, Other));
+  BOOST_TEST(not StoredRanges::isLessOrEqual(Whole, Head));
+}
+
+BOOST_AUTO_TEST_CASE(LoopReachesFixedPoint) {
+  StoreInst *S0 = Stores[0];
+  StoreInst *S1 = Stores[1];
+
+  // The loop body partially overwrites what was stored before the loop
+  auto Transfer = [S1](const StoredRanges &Value) {
+    StoredRanges Result = Value;
+    Result.erase(4, 12);
+    Result.insert(S1, 8, 4);
+    return Result;
+  };
+
+  StoredRanges Entry;
+  Entry.insert(S0, 0, 8);
+
+  // Iterate the loop header as the MFP would, until the value coming from the
+  // back edge is included in the one of the header
+  StoredRanges Header = Entry;
+  unsigned Iterations = 0;
+  while (true) {
+    ++Iterations;
+    BOOST_TEST_REQUIRE(Iterations < 10);
+
+    StoredRanges BackEdge = Transfer(Header);
+    if (StoredRanges::isLessOrEqual(BackEdge, Header))
+      break;
+
+    Header = StoredRanges::combineValues(Header, BackEdge);
+  }
+
+  BOOST_TEST(Iterations == 2);
+  RangeVector Expected = { { 0, 8, S0, 0 }, { 8, 12, S1, 8 } };
+  BOOST_TEST(matches(Header, Expected));
+
+  // Joining again the header with the back edge does not change it
+  StoredRanges Joined = StoredRanges::combineValues(Header, Transfer(Header));
+  BOOST_TEST(matches(Joined, Expected));
+  BOOST_TEST(StoredRanges::isLessOrEqual(Joined, Header));
+}
+
+BOOST_AUTO_TEST_SUITE_END()